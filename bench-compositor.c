@@ -0,0 +1,891 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/input-event-codes.h>
+#include <linux/sockios.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server.h>
+#include <xkbcommon/xkbcommon.h>
+#include "xdg-shell-server-protocol.h"
+
+/*
+ * A headless stand-in for a compositor, which runs wev, maps its window and
+ * then floods it with input events at a fixed rate, or at a rate doubling
+ * every step, to measure how many events per second it keeps up with.
+ */
+
+#define BENCH_CHUNK 64 /* Events written between flushes */
+
+enum bench_event {
+	BENCH_POINTER_MOTION,
+	BENCH_POINTER_BUTTON,
+	BENCH_POINTER_AXIS,
+	BENCH_POINTER_FRAME,
+	BENCH_KEY,
+	BENCH_TOUCH_DOWN,
+	BENCH_TOUCH_MOTION,
+	BENCH_TOUCH_UP,
+	BENCH_TOUCH_FRAME,
+};
+
+/* Size of each event on the wire: an 8 byte header and 4 bytes per argument */
+static const uint32_t bench_event_size[] = {
+	[BENCH_POINTER_MOTION] = 20,
+	[BENCH_POINTER_BUTTON] = 24,
+	[BENCH_POINTER_AXIS] = 20,
+	[BENCH_POINTER_FRAME] = 8,
+	[BENCH_KEY] = 24,
+	[BENCH_TOUCH_DOWN] = 32,
+	[BENCH_TOUCH_MOTION] = 24,
+	[BENCH_TOUCH_UP] = 20,
+	[BENCH_TOUCH_FRAME] = 8,
+};
+
+/* Sent over and over; mostly pointer motion, as from a fast mouse */
+static const enum bench_event bench_script[] = {
+	BENCH_POINTER_MOTION, BENCH_POINTER_FRAME,
+	BENCH_POINTER_MOTION, BENCH_POINTER_FRAME,
+	BENCH_POINTER_MOTION, BENCH_POINTER_FRAME,
+	BENCH_POINTER_MOTION, BENCH_POINTER_FRAME,
+	BENCH_POINTER_BUTTON, BENCH_POINTER_FRAME,
+	BENCH_POINTER_MOTION, BENCH_POINTER_FRAME,
+	BENCH_POINTER_AXIS, BENCH_POINTER_FRAME,
+	BENCH_POINTER_BUTTON, BENCH_POINTER_FRAME,
+	BENCH_KEY, BENCH_KEY,
+	BENCH_TOUCH_DOWN, BENCH_TOUCH_FRAME,
+	BENCH_TOUCH_MOTION, BENCH_TOUCH_FRAME,
+	BENCH_TOUCH_MOTION, BENCH_TOUCH_FRAME,
+	BENCH_TOUCH_UP, BENCH_TOUCH_FRAME,
+	BENCH_POINTER_MOTION, BENCH_POINTER_FRAME,
+	BENCH_POINTER_MOTION, BENCH_POINTER_FRAME,
+};
+
+#define BENCH_SCRIPT_LEN (sizeof(bench_script) / sizeof(bench_script[0]))
+
+struct bench_step {
+	uint64_t rate; /* Offered, in events per second */
+	uint64_t start_ns;
+	uint64_t events, bytes; /* Sent during the step */
+	uint64_t skipped; /* Due while wev's socket was full, and never sent */
+	int backlog; /* Bytes not yet read by wev when the step began */
+};
+
+struct bench_state {
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_event_source *timer;
+	struct wl_client *client;
+	struct wl_listener client_destroy;
+	int sndbuf; /* Size of wev's socket buffer, as counted by SIOCOUTQ */
+	int peer; /* wev's end of the socket, kept until it exits */
+	pid_t child;
+	struct wl_event_source *child_exit;
+
+	struct wl_resource *surface;
+	struct wl_resource *xdg_surface;
+	struct wl_resource *toplevel;
+	struct wl_resource *pointer, *keyboard, *touch;
+	struct wl_list frame_callbacks;
+	bool configured, mapped;
+
+	struct xkb_context *xkb_context;
+	char *keymap;
+
+	/* Options */
+	uint64_t rate;
+	int steps;
+	uint64_t step_ns;
+
+	/* Progress */
+	int step;
+	struct bench_step current;
+	bool draining;
+	uint64_t drain_start_ns;
+	uint64_t flood_start_ns, flood_end_ns;
+	uint64_t events, bytes;
+	uint64_t blocked_ticks;
+	size_t script_pos;
+	uint32_t key_state, button_state;
+	wl_fixed_t x;
+	int fell_behind; /* Step at which wev stopped keeping up, or -1 */
+};
+
+static uint64_t monotonic_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * What wev's socket buffer holds, counted the way it fills up, which for
+ * Unix sockets is the memory taken rather than the bytes.
+ */
+static int client_queued(struct bench_state *state) {
+	int queued = 0;
+	if (ioctl(wl_client_get_fd(state->client), SIOCOUTQ, &queued) < 0) {
+		return 0;
+	}
+	return queued;
+}
+
+/* Bytes written to wev's socket which it has not read yet */
+static int client_backlog(struct bench_state *state) {
+	int unread = 0;
+	if (state->peer < 0 || ioctl(state->peer, FIONREAD, &unread) < 0) {
+		return 0;
+	}
+	return unread;
+}
+
+static void resource_destroy(struct wl_client *client,
+		struct wl_resource *resource) {
+	wl_resource_destroy(resource);
+}
+
+static void send_configure(struct bench_state *state) {
+	struct wl_array states;
+	wl_array_init(&states);
+	*(uint32_t *)wl_array_add(&states, sizeof(uint32_t)) =
+		XDG_TOPLEVEL_STATE_ACTIVATED;
+	xdg_toplevel_send_configure(state->toplevel, 640, 480, &states);
+	xdg_surface_send_configure(state->xdg_surface,
+			wl_display_next_serial(state->display));
+	wl_array_release(&states);
+}
+
+static void send_keymap(struct bench_state *state) {
+	if (!state->keymap) {
+		int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+		wl_keyboard_send_keymap(state->keyboard,
+				WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP, fd, 0);
+		close(fd);
+		return;
+	}
+	size_t size = strlen(state->keymap) + 1;
+	int fd = memfd_create("bench-keymap", MFD_CLOEXEC);
+	if (fd < 0 || write(fd, state->keymap, size) != (ssize_t)size) {
+		fprintf(stderr, "Failed to create keymap: %s\n", strerror(errno));
+		exit(1);
+	}
+	wl_keyboard_send_keymap(state->keyboard,
+			WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, fd, size);
+	close(fd);
+}
+
+static void step_start(struct bench_state *state, uint64_t now) {
+	state->current = (struct bench_step){
+		.rate = state->rate << state->step,
+		.start_ns = now,
+		.backlog = client_backlog(state),
+	};
+}
+
+/*
+ * wev keeps up with a step if it read nearly everything offered during it;
+ * whatever it did not read shows up as a larger backlog at the end.
+ */
+static void step_finish(struct bench_state *state, uint64_t now) {
+	struct bench_step *step = &state->current;
+	double seconds = (now - step->start_ns) / 1e9;
+	int backlog = client_backlog(state);
+	double read = step->bytes - (double)(backlog - step->backlog);
+	double per_event = step->events ? (double)step->bytes / step->events : 1;
+	double read_rate = read / per_event / seconds;
+	printf("%12" PRIu64 " %12.0f %12.0f %12d\n", step->rate,
+			step->events / seconds, read_rate, backlog);
+	fflush(stdout);
+	if (state->fell_behind < 0 && read_rate < step->rate * 0.95) {
+		state->fell_behind = state->step;
+	}
+}
+
+static void send_event(struct bench_state *state, uint32_t time) {
+	struct wl_display *display = state->display;
+	enum bench_event event = bench_script[state->script_pos];
+	state->script_pos = (state->script_pos + 1) % BENCH_SCRIPT_LEN;
+	switch (event) {
+	case BENCH_POINTER_MOTION:
+		state->x = (state->x + wl_fixed_from_int(1)) % wl_fixed_from_int(640);
+		wl_pointer_send_motion(state->pointer, time,
+				state->x, wl_fixed_from_int(240));
+		break;
+	case BENCH_POINTER_BUTTON:
+		state->button_state ^= 1;
+		wl_pointer_send_button(state->pointer, wl_display_next_serial(display),
+				time, BTN_LEFT, state->button_state);
+		break;
+	case BENCH_POINTER_AXIS:
+		wl_pointer_send_axis(state->pointer, time,
+				WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_int(10));
+		break;
+	case BENCH_POINTER_FRAME:
+		wl_pointer_send_frame(state->pointer);
+		break;
+	case BENCH_KEY:
+		state->key_state ^= 1;
+		wl_keyboard_send_key(state->keyboard, wl_display_next_serial(display),
+				time, KEY_A, state->key_state);
+		break;
+	case BENCH_TOUCH_DOWN:
+		wl_touch_send_down(state->touch, wl_display_next_serial(display),
+				time, state->surface, 0,
+				wl_fixed_from_int(100), wl_fixed_from_int(100));
+		break;
+	case BENCH_TOUCH_MOTION:
+		wl_touch_send_motion(state->touch, time, 0,
+				wl_fixed_from_int(110), wl_fixed_from_int(105));
+		break;
+	case BENCH_TOUCH_UP:
+		wl_touch_send_up(state->touch, wl_display_next_serial(display),
+				time, 0);
+		break;
+	case BENCH_TOUCH_FRAME:
+		wl_touch_send_frame(state->touch);
+		break;
+	}
+	state->current.events++;
+	state->current.bytes += bench_event_size[event];
+}
+
+/*
+ * Sends the events due since the last tick, in chunks, and stops early once
+ * wev's socket is half full. libwayland would otherwise buffer them without
+ * bound, or disconnect wev.
+ */
+static int handle_tick(void *data) {
+	struct bench_state *state = data;
+	uint64_t now = monotonic_ns();
+	wl_event_source_timer_update(state->timer, 1);
+
+	if (state->draining) {
+		if (client_backlog(state) == 0 ||
+				now - state->drain_start_ns > 10 * 1000000000ull) {
+			wl_event_source_remove(state->timer);
+			state->timer = NULL;
+			state->flood_end_ns = now;
+			xdg_toplevel_send_close(state->toplevel);
+			wl_client_flush(state->client);
+		}
+		return 0;
+	}
+
+	if (now - state->current.start_ns >= state->step_ns) {
+		state->events += state->current.events;
+		state->bytes += state->current.bytes;
+		step_finish(state, now);
+		if (++state->step == state->steps) {
+			state->draining = true;
+			state->drain_start_ns = now;
+			return 0;
+		}
+		step_start(state, now);
+	}
+
+	struct bench_step *step = &state->current;
+	uint64_t due = (now - step->start_ns) * step->rate / 1000000000;
+	uint32_t time = now / 1000000;
+	bool blocked = false;
+	while (step->events + step->skipped < due) {
+		if (client_queued(state) >= state->sndbuf / 2) {
+			blocked = true;
+			break;
+		}
+		for (int i = 0; i < BENCH_CHUNK &&
+				step->events + step->skipped < due; ++i) {
+			send_event(state, time);
+		}
+		wl_client_flush(state->client);
+	}
+	if (blocked) {
+		++state->blocked_ticks;
+		// Give up on what could not be sent, rather than bursting later
+		step->skipped = due - step->events;
+	}
+	return 0;
+}
+
+static void start_flood(struct bench_state *state) {
+	uint32_t serial = wl_display_next_serial(state->display);
+	struct wl_array keys;
+	wl_array_init(&keys);
+	send_keymap(state);
+	wl_keyboard_send_repeat_info(state->keyboard, 25, 600);
+	wl_keyboard_send_enter(state->keyboard, serial, state->surface, &keys);
+	wl_keyboard_send_modifiers(state->keyboard, serial, 0, 0, 0, 0);
+	wl_pointer_send_enter(state->pointer, wl_display_next_serial(state->display),
+			state->surface, 0, 0);
+	wl_pointer_send_frame(state->pointer);
+	wl_array_release(&keys);
+
+	printf("%12s %12s %12s %12s\n", "rate/s", "sent/s", "read/s", "backlog");
+	fflush(stdout);
+	state->timer = wl_event_loop_add_timer(state->loop, handle_tick, state);
+	state->flood_start_ns = monotonic_ns();
+	step_start(state, state->flood_start_ns);
+	wl_event_source_timer_update(state->timer, 1);
+}
+
+static void surface_attach(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *buffer,
+		int32_t x, int32_t y) {
+	struct bench_state *state = wl_resource_get_user_data(resource);
+	if (buffer) {
+		// Nothing is ever drawn, so the buffer can be handed back right away
+		wl_buffer_send_release(buffer);
+		state->mapped = state->configured;
+	}
+}
+
+static void surface_damage(struct wl_client *client,
+		struct wl_resource *resource,
+		int32_t x, int32_t y, int32_t width, int32_t height) {
+	/* No-op */
+}
+
+static void surface_frame(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct bench_state *state = wl_resource_get_user_data(resource);
+	struct wl_resource *callback =
+		wl_resource_create(client, &wl_callback_interface, 1, id);
+	wl_resource_set_implementation(callback, NULL, NULL,
+			(wl_resource_destroy_func_t)wl_list_remove);
+	wl_list_insert(state->frame_callbacks.prev,
+			wl_resource_get_link(callback));
+}
+
+static void surface_set_region(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *region) {
+	/* No-op */
+}
+
+static void surface_commit(struct wl_client *client,
+		struct wl_resource *resource) {
+	struct bench_state *state = wl_resource_get_user_data(resource);
+	struct wl_resource *callback, *tmp;
+	wl_resource_for_each_safe(callback, tmp, &state->frame_callbacks) {
+		wl_callback_send_done(callback, monotonic_ns() / 1000000);
+		wl_resource_destroy(callback);
+	}
+	if (state->toplevel && !state->configured) {
+		state->configured = true;
+		send_configure(state);
+	} else if (state->mapped && !state->timer && !state->draining) {
+		start_flood(state);
+	}
+}
+
+static void surface_set_int(struct wl_client *client,
+		struct wl_resource *resource, int32_t value) {
+	/* No-op */
+}
+
+static const struct wl_surface_interface surface_impl = {
+	.destroy = resource_destroy,
+	.attach = surface_attach,
+	.damage = surface_damage,
+	.frame = surface_frame,
+	.set_opaque_region = surface_set_region,
+	.set_input_region = surface_set_region,
+	.commit = surface_commit,
+	.set_buffer_transform = surface_set_int,
+	.set_buffer_scale = surface_set_int,
+	.damage_buffer = surface_damage,
+};
+
+static void region_add(struct wl_client *client, struct wl_resource *resource,
+		int32_t x, int32_t y, int32_t width, int32_t height) {
+	/* No-op */
+}
+
+static const struct wl_region_interface region_impl = {
+	.destroy = resource_destroy,
+	.add = region_add,
+	.subtract = region_add,
+};
+
+static void compositor_create_surface(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct bench_state *state = wl_resource_get_user_data(resource);
+	state->surface = wl_resource_create(client, &wl_surface_interface,
+			wl_resource_get_version(resource), id);
+	wl_resource_set_implementation(state->surface, &surface_impl, state, NULL);
+}
+
+static void compositor_create_region(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct wl_resource *region =
+		wl_resource_create(client, &wl_region_interface, 1, id);
+	wl_resource_set_implementation(region, &region_impl, NULL, NULL);
+}
+
+static const struct wl_compositor_interface compositor_impl = {
+	.create_surface = compositor_create_surface,
+	.create_region = compositor_create_region,
+};
+
+static void pointer_set_cursor(struct wl_client *client,
+		struct wl_resource *resource, uint32_t serial,
+		struct wl_resource *surface, int32_t x, int32_t y) {
+	/* No-op */
+}
+
+static const struct wl_pointer_interface pointer_impl = {
+	.set_cursor = pointer_set_cursor,
+	.release = resource_destroy,
+};
+
+static const struct wl_keyboard_interface keyboard_impl = {
+	.release = resource_destroy,
+};
+
+static const struct wl_touch_interface touch_impl = {
+	.release = resource_destroy,
+};
+
+static void seat_get_pointer(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct bench_state *state = wl_resource_get_user_data(resource);
+	state->pointer = wl_resource_create(client, &wl_pointer_interface,
+			wl_resource_get_version(resource), id);
+	wl_resource_set_implementation(state->pointer, &pointer_impl, NULL, NULL);
+}
+
+static void seat_get_keyboard(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct bench_state *state = wl_resource_get_user_data(resource);
+	state->keyboard = wl_resource_create(client, &wl_keyboard_interface,
+			wl_resource_get_version(resource), id);
+	wl_resource_set_implementation(state->keyboard, &keyboard_impl, NULL, NULL);
+}
+
+static void seat_get_touch(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct bench_state *state = wl_resource_get_user_data(resource);
+	state->touch = wl_resource_create(client, &wl_touch_interface,
+			wl_resource_get_version(resource), id);
+	wl_resource_set_implementation(state->touch, &touch_impl, NULL, NULL);
+}
+
+static const struct wl_seat_interface seat_impl = {
+	.get_pointer = seat_get_pointer,
+	.get_keyboard = seat_get_keyboard,
+	.get_touch = seat_get_touch,
+	.release = resource_destroy,
+};
+
+static void xdg_toplevel_set_parent(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *parent) {
+	/* No-op */
+}
+
+static void xdg_toplevel_set_string(struct wl_client *client,
+		struct wl_resource *resource, const char *value) {
+	/* No-op */
+}
+
+static void xdg_toplevel_show_window_menu(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *seat,
+		uint32_t serial, int32_t x, int32_t y) {
+	/* No-op */
+}
+
+static void xdg_toplevel_move(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *seat,
+		uint32_t serial) {
+	/* No-op */
+}
+
+static void xdg_toplevel_resize(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *seat,
+		uint32_t serial, uint32_t edges) {
+	/* No-op */
+}
+
+static void xdg_toplevel_set_size(struct wl_client *client,
+		struct wl_resource *resource, int32_t width, int32_t height) {
+	/* No-op */
+}
+
+static void xdg_toplevel_set_state(struct wl_client *client,
+		struct wl_resource *resource) {
+	/* No-op */
+}
+
+static void xdg_toplevel_set_fullscreen(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *output) {
+	/* No-op */
+}
+
+static const struct xdg_toplevel_interface xdg_toplevel_impl = {
+	.destroy = resource_destroy,
+	.set_parent = xdg_toplevel_set_parent,
+	.set_title = xdg_toplevel_set_string,
+	.set_app_id = xdg_toplevel_set_string,
+	.show_window_menu = xdg_toplevel_show_window_menu,
+	.move = xdg_toplevel_move,
+	.resize = xdg_toplevel_resize,
+	.set_max_size = xdg_toplevel_set_size,
+	.set_min_size = xdg_toplevel_set_size,
+	.set_maximized = xdg_toplevel_set_state,
+	.unset_maximized = xdg_toplevel_set_state,
+	.set_fullscreen = xdg_toplevel_set_fullscreen,
+	.unset_fullscreen = xdg_toplevel_set_state,
+	.set_minimized = xdg_toplevel_set_state,
+};
+
+static void xdg_surface_get_toplevel(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct bench_state *state = wl_resource_get_user_data(resource);
+	state->toplevel = wl_resource_create(client, &xdg_toplevel_interface,
+			wl_resource_get_version(resource), id);
+	wl_resource_set_implementation(state->toplevel,
+			&xdg_toplevel_impl, state, NULL);
+}
+
+static void xdg_surface_get_popup(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id,
+		struct wl_resource *parent, struct wl_resource *positioner) {
+	wl_resource_post_error(resource, XDG_WM_BASE_ERROR_ROLE,
+			"popups are not supported");
+}
+
+static void xdg_surface_set_window_geometry(struct wl_client *client,
+		struct wl_resource *resource,
+		int32_t x, int32_t y, int32_t width, int32_t height) {
+	/* No-op */
+}
+
+static void xdg_surface_ack_configure(struct wl_client *client,
+		struct wl_resource *resource, uint32_t serial) {
+	/* No-op */
+}
+
+static const struct xdg_surface_interface xdg_surface_impl = {
+	.destroy = resource_destroy,
+	.get_toplevel = xdg_surface_get_toplevel,
+	.get_popup = xdg_surface_get_popup,
+	.set_window_geometry = xdg_surface_set_window_geometry,
+	.ack_configure = xdg_surface_ack_configure,
+};
+
+static void wm_base_create_positioner(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	wl_resource_post_error(resource, XDG_WM_BASE_ERROR_ROLE,
+			"popups are not supported");
+}
+
+static void wm_base_get_xdg_surface(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id,
+		struct wl_resource *surface) {
+	struct bench_state *state = wl_resource_get_user_data(resource);
+	state->xdg_surface = wl_resource_create(client, &xdg_surface_interface,
+			wl_resource_get_version(resource), id);
+	wl_resource_set_implementation(state->xdg_surface,
+			&xdg_surface_impl, state, NULL);
+}
+
+static void wm_base_pong(struct wl_client *client,
+		struct wl_resource *resource, uint32_t serial) {
+	/* No-op */
+}
+
+static const struct xdg_wm_base_interface wm_base_impl = {
+	.destroy = resource_destroy,
+	.create_positioner = wm_base_create_positioner,
+	.get_xdg_surface = wm_base_get_xdg_surface,
+	.pong = wm_base_pong,
+};
+
+static void data_source_offer(struct wl_client *client,
+		struct wl_resource *resource, const char *mime_type) {
+	/* No-op */
+}
+
+static void data_source_set_actions(struct wl_client *client,
+		struct wl_resource *resource, uint32_t actions) {
+	/* No-op */
+}
+
+static const struct wl_data_source_interface data_source_impl = {
+	.offer = data_source_offer,
+	.destroy = resource_destroy,
+	.set_actions = data_source_set_actions,
+};
+
+static void data_device_start_drag(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *source,
+		struct wl_resource *origin, struct wl_resource *icon,
+		uint32_t serial) {
+	/* No-op */
+}
+
+static void data_device_set_selection(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *source,
+		uint32_t serial) {
+	/* No-op */
+}
+
+static const struct wl_data_device_interface data_device_impl = {
+	.start_drag = data_device_start_drag,
+	.set_selection = data_device_set_selection,
+	.release = resource_destroy,
+};
+
+static void data_device_manager_create_data_source(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id) {
+	struct wl_resource *source = wl_resource_create(client,
+			&wl_data_source_interface, wl_resource_get_version(resource), id);
+	wl_resource_set_implementation(source, &data_source_impl, NULL, NULL);
+}
+
+static void data_device_manager_get_data_device(struct wl_client *client,
+		struct wl_resource *resource, uint32_t id,
+		struct wl_resource *seat) {
+	struct wl_resource *device = wl_resource_create(client,
+			&wl_data_device_interface, wl_resource_get_version(resource), id);
+	wl_resource_set_implementation(device, &data_device_impl, NULL, NULL);
+}
+
+static const struct wl_data_device_manager_interface data_device_manager_impl = {
+	.create_data_source = data_device_manager_create_data_source,
+	.get_data_device = data_device_manager_get_data_device,
+};
+
+static void bind_compositor(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id) {
+	struct wl_resource *resource =
+		wl_resource_create(client, &wl_compositor_interface, version, id);
+	wl_resource_set_implementation(resource, &compositor_impl, data, NULL);
+}
+
+static void bind_seat(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id) {
+	struct wl_resource *resource =
+		wl_resource_create(client, &wl_seat_interface, version, id);
+	wl_resource_set_implementation(resource, &seat_impl, data, NULL);
+	wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_POINTER |
+			WL_SEAT_CAPABILITY_KEYBOARD | WL_SEAT_CAPABILITY_TOUCH);
+	if (version >= WL_SEAT_NAME_SINCE_VERSION) {
+		wl_seat_send_name(resource, "bench");
+	}
+}
+
+static void bind_wm_base(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id) {
+	struct wl_resource *resource =
+		wl_resource_create(client, &xdg_wm_base_interface, version, id);
+	wl_resource_set_implementation(resource, &wm_base_impl, data, NULL);
+}
+
+static void bind_data_device_manager(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id) {
+	struct wl_resource *resource = wl_resource_create(client,
+			&wl_data_device_manager_interface, version, id);
+	wl_resource_set_implementation(resource,
+			&data_device_manager_impl, data, NULL);
+}
+
+/* Lets go of wev's end of the socket, so that its exit hangs it up */
+static int handle_child_exit(int fd, uint32_t mask, void *data) {
+	struct bench_state *state = data;
+	close(state->peer);
+	state->peer = -1;
+	wl_event_source_remove(state->child_exit);
+	state->child_exit = NULL;
+	return 0;
+}
+
+static void client_destroyed(struct wl_listener *listener, void *data) {
+	struct bench_state *state =
+		wl_container_of(listener, state, client_destroy);
+	wl_display_terminate(state->display);
+}
+
+/* wev connects through WAYLAND_SOCKET, so no runtime directory is needed */
+static pid_t spawn_wev(int socket, const char *output, char **argv) {
+	pid_t pid = fork();
+	if (pid != 0) {
+		return pid;
+	}
+	int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", output, strerror(errno));
+		_exit(1);
+	}
+	char socket_str[16];
+	snprintf(socket_str, sizeof(socket_str), "%d", socket);
+	fcntl(socket, F_SETFD, 0);
+	setenv("WAYLAND_SOCKET", socket_str, 1);
+	unsetenv("WAYLAND_DISPLAY");
+	execvp(argv[0], argv);
+	fprintf(stderr, "Failed to run %s: %s\n", argv[0], strerror(errno));
+	_exit(1);
+}
+
+static double cpu_seconds(const struct timeval *tv) {
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void report(struct bench_state *state, const struct rusage *usage) {
+	if (state->flood_start_ns == 0) {
+		fprintf(stderr, "wev exited before its window was mapped\n");
+		return;
+	}
+	if (state->fell_behind >= 0) {
+		printf("wev fell behind at %" PRIu64 " events/s\n",
+				state->rate << state->fell_behind);
+	} else {
+		printf("wev kept up with every rate\n");
+	}
+	if (state->flood_end_ns == 0 || state->events == 0) {
+		return;
+	}
+	double seconds = (state->flood_end_ns - state->flood_start_ns) / 1e9;
+	double cpu = cpu_seconds(&usage->ru_utime) + cpu_seconds(&usage->ru_stime);
+	printf("%" PRIu64 " events in %.3f s, until wev read them all: "
+			"%.0f events/s sustained\n",
+			state->events, seconds, state->events / seconds);
+	printf("wev CPU time: %.3f s user, %.3f s system, %.3f us per event\n",
+			cpu_seconds(&usage->ru_utime), cpu_seconds(&usage->ru_stime),
+			cpu * 1e6 / state->events);
+	// If this is close to the elapsed time, the rate was limited here
+	struct rusage self;
+	getrusage(RUSAGE_SELF, &self);
+	printf("bench-compositor CPU time: %.3f s\n",
+			cpu_seconds(&self.ru_utime) + cpu_seconds(&self.ru_stime));
+	if (state->blocked_ticks) {
+		printf("wev's socket was full for %" PRIu64 " ms\n",
+				state->blocked_ticks);
+	}
+}
+
+static void show_usage(void) {
+	printf("Usage: bench-compositor [-r <events/s>] [-s <steps>] "
+			"[-d <seconds>] [-o <path>]\n"
+			"                        [--] <wev> [args...]\n");
+}
+
+int main(int argc, char *argv[]) {
+	struct bench_state state = {
+		.rate = 100000,
+		.steps = 1,
+		.step_ns = 5 * 1000000000ull,
+		.fell_behind = -1,
+		.peer = -1,
+	};
+	const char *output = "/dev/null";
+
+	int opt;
+	while ((opt = getopt(argc, argv, "+d:ho:r:s:")) != -1) {
+		switch (opt) {
+		case 'd':
+			state.step_ns = strtod(optarg, NULL) * 1e9;
+			break;
+		case 'h':
+			show_usage();
+			return 0;
+		case 'o':
+			output = optarg;
+			break;
+		case 'r':
+			state.rate = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			state.steps = atoi(optarg);
+			break;
+		default:
+			show_usage();
+			return 1;
+		}
+	}
+	if (optind >= argc || state.rate == 0 || state.steps <= 0 ||
+			state.steps > 32 || state.step_ns == 0) {
+		show_usage();
+		return 1;
+	}
+
+	state.xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	struct xkb_keymap *keymap = state.xkb_context ?
+		xkb_keymap_new_from_names(state.xkb_context, NULL, 0) : NULL;
+	if (keymap) {
+		state.keymap = xkb_keymap_get_as_string(keymap,
+				XKB_KEYMAP_FORMAT_TEXT_V1);
+		xkb_keymap_unref(keymap);
+	} else {
+		fprintf(stderr, "No XKB keymap available, sending keys without one\n");
+	}
+
+	state.display = wl_display_create();
+	state.loop = wl_display_get_event_loop(state.display);
+	wl_list_init(&state.frame_callbacks);
+	wl_display_init_shm(state.display);
+	wl_global_create(state.display, &wl_compositor_interface, 4,
+			&state, bind_compositor);
+	wl_global_create(state.display, &wl_seat_interface, 7,
+			&state, bind_seat);
+	wl_global_create(state.display, &xdg_wm_base_interface, 2,
+			&state, bind_wm_base);
+	wl_global_create(state.display, &wl_data_device_manager_interface, 3,
+			&state, bind_data_device_manager);
+
+	// wev is the only client; it gets one end of a socket pair
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+		return 1;
+	}
+	socklen_t len = sizeof(state.sndbuf);
+	if (getsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &state.sndbuf, &len) < 0) {
+		state.sndbuf = 212992;
+	}
+	state.client = wl_client_create(state.display, fds[0]);
+	state.client_destroy.notify = client_destroyed;
+	wl_client_add_destroy_listener(state.client, &state.client_destroy);
+
+	state.child = spawn_wev(fds[1], output, &argv[optind]);
+	state.peer = fds[1];
+	if (state.child < 0) {
+		fprintf(stderr, "Failed to start wev: %s\n", strerror(errno));
+		return 1;
+	}
+	int pidfd = syscall(SYS_pidfd_open, state.child, 0);
+	if (pidfd >= 0) {
+		// The event loop has its own copy
+		state.child_exit = wl_event_loop_add_fd(state.loop, pidfd,
+				WL_EVENT_READABLE, handle_child_exit, &state);
+		close(pidfd);
+	}
+	if (!state.child_exit) {
+		fprintf(stderr, "Failed to watch wev: %s\n", strerror(errno));
+		kill(state.child, SIGTERM);
+		return 1;
+	}
+
+	wl_display_run(state.display);
+
+	int status;
+	struct rusage usage;
+	while (wait4(state.child, &status, 0, &usage) < 0 && errno == EINTR) {
+		// Retry
+	}
+	report(&state, &usage);
+	wl_display_destroy(state.display);
+	free(state.keymap);
+	xkb_context_unref(state.xkb_context);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
@@ -0,0 +1,368 @@
+/*
+ * Microbenchmarks for the formatting and key lookup paths. wev.c and
+ * keycache.c are built into this file, so that their static functions can be
+ * called directly, with wev's own main renamed out of the way.
+ */
+#define main wev_main
+#include "wev.c"
+#undef main
+#include "keycache.c"
+#include <math.h>
+
+#define BENCH_SAMPLES 21
+#define BENCH_SAMPLE_NS 5000000 /* Each sample runs for about this long */
+
+/*
+ * A small self-contained keymap, so that the numbers do not depend on the
+ * xkeyboard-config installed.
+ */
+static const char bench_keymap[] =
+	"xkb_keymap {\n"
+	"xkb_keycodes \"bench\" {\n"
+	"	minimum = 8;\n"
+	"	maximum = 255;\n"
+	"	<ESC> = 9;\n"
+	"	<AE01> = 10;\n"
+	"	<TAB> = 23;\n"
+	"	<RTRN> = 36;\n"
+	"	<LCTL> = 37;\n"
+	"	<AC01> = 38;\n"
+	"	<LFSH> = 50;\n"
+	"	<SPCE> = 65;\n"
+	"	<CAPS> = 66;\n"
+	"};\n"
+	"xkb_types \"bench\" {\n"
+	"	type \"ONE_LEVEL\" {\n"
+	"		modifiers = none;\n"
+	"		level_name[Level1] = \"Any\";\n"
+	"	};\n"
+	"	type \"TWO_LEVEL\" {\n"
+	"		modifiers = Shift;\n"
+	"		map[Shift] = Level2;\n"
+	"		level_name[Level1] = \"Base\";\n"
+	"		level_name[Level2] = \"Shift\";\n"
+	"	};\n"
+	"	type \"ALPHABETIC\" {\n"
+	"		modifiers = Shift + Lock;\n"
+	"		map[Shift] = Level2;\n"
+	"		map[Lock] = Level2;\n"
+	"		level_name[Level1] = \"Base\";\n"
+	"		level_name[Level2] = \"Caps\";\n"
+	"	};\n"
+	"};\n"
+	"xkb_compatibility \"bench\" {\n"
+	"	interpret Shift_L { action = SetMods(modifiers = Shift); };\n"
+	"	interpret Control_L { action = SetMods(modifiers = Control); };\n"
+	"	interpret Caps_Lock { action = LockMods(modifiers = Lock); };\n"
+	"};\n"
+	"xkb_symbols \"bench\" {\n"
+	"	key <ESC> { [ Escape ] };\n"
+	"	key <AE01> { [ 1, exclam ] };\n"
+	"	key <TAB> { [ Tab, ISO_Left_Tab ] };\n"
+	"	key <RTRN> { [ Return ] };\n"
+	"	key <LCTL> { [ Control_L ] };\n"
+	"	key <AC01> { [ a, A ] };\n"
+	"	key <LFSH> { [ Shift_L ] };\n"
+	"	key <SPCE> { [ space ] };\n"
+	"	key <CAPS> { [ Caps_Lock ] };\n"
+	"	modifier_map Shift { <LFSH> };\n"
+	"	modifier_map Lock { <CAPS> };\n"
+	"	modifier_map Control { <LCTL> };\n"
+	"};\n"
+	"};\n";
+
+static const xkb_keycode_t bench_keys[] = { 9, 10, 23, 36, 38, 65 };
+#define BENCH_KEY_COUNT (sizeof(bench_keys) / sizeof(bench_keys[0]))
+
+/*
+ * Allocations are counted by wrapping glibc's allocator, which also catches
+ * those made inside libxkbcommon.
+ */
+#ifdef __GLIBC__
+#define BENCH_COUNT_ALLOCATIONS
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t bench_allocations;
+
+void *malloc(size_t size) {
+	++bench_allocations;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	++bench_allocations;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	++bench_allocations;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+	__libc_free(ptr);
+}
+#else
+static uint64_t bench_allocations;
+#endif
+
+struct bench_context {
+	struct wev_state *state;
+	/* Records for print_event, see bench_event */
+	struct wev_event *motion, *key;
+	/* "key == 30 && state == 1", compiled for key events */
+	struct wev_predicate_program *where;
+	volatile uint64_t sink; /* Keeps results from being optimized away */
+};
+
+struct bench {
+	const char *name;
+	void (*run)(struct bench_context *ctx, uint64_t iterations);
+};
+
+static struct wev_event *bench_event(enum wev_interface iface,
+		uint32_t opcode, int count, const uint32_t *args) {
+	struct wev_event *ev = calloc(1, sizeof(*ev));
+	ev->size = sizeof(*ev);
+	ev->id = 20;
+	ev->iface = iface;
+	ev->opcode = opcode;
+	for (int i = 0; i < count; ++i) {
+		ev->args[i].u = args[i];
+	}
+	return ev;
+}
+
+static void bench_event_prefix(struct bench_context *ctx, uint64_t iterations) {
+	struct wev_state *state = ctx->state;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		event_log(state, ctx->motion);
+		state->out.len = 0;
+	}
+}
+
+static void bench_print_motion(struct bench_context *ctx, uint64_t iterations) {
+	struct wev_state *state = ctx->state;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		ctx->motion->args[1].i = i & 0xFFFF;
+		print_event(state, ctx->motion);
+		state->out.len = 0;
+	}
+}
+
+static void bench_print_key(struct bench_context *ctx, uint64_t iterations) {
+	struct wev_state *state = ctx->state;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		ctx->key->args[2].u = bench_keys[i % BENCH_KEY_COUNT] - 8;
+		print_event(state, ctx->key);
+		state->out.len = 0;
+	}
+}
+
+static void bench_json_motion(struct bench_context *ctx, uint64_t iterations) {
+	struct wev_state *state = ctx->state;
+	state->opts.format = WEV_FORMAT_JSONL;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		ctx->motion->args[1].i = i & 0xFFFF;
+		print_event(state, ctx->motion);
+		state->out.len = 0;
+	}
+	state->opts.format = WEV_FORMAT_TEXT;
+}
+
+static void bench_predicate_run(struct bench_context *ctx,
+		uint64_t iterations) {
+	for (uint64_t i = 0; i < iterations; ++i) {
+		ctx->key->args[2].u = bench_keys[i % BENCH_KEY_COUNT] - 8;
+		ctx->sink += predicate_run(ctx->where, ctx->key);
+	}
+}
+
+static void bench_print_modifiers(struct bench_context *ctx,
+		uint64_t iterations) {
+	struct wev_state *state = ctx->state;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		print_modifiers(state, "depressed", i & 7);
+		state->out.len = 0;
+	}
+}
+
+static void bench_dnd_actions_str(struct bench_context *ctx,
+		uint64_t iterations) {
+	for (uint64_t i = 0; i < iterations; ++i) {
+		ctx->sink += (uintptr_t)dnd_actions_str(i & 7);
+	}
+}
+
+static void bench_escape_utf8(struct bench_context *ctx, uint64_t iterations) {
+	static const char *const texts[] = { "a", "\n", "\t", "", "\xc3\xa9" };
+	char buf[48];
+	for (uint64_t i = 0; i < iterations; ++i) {
+		strcpy(buf, texts[i % 5]);
+		escape_utf8(buf);
+		ctx->sink += buf[0];
+	}
+}
+
+static void bench_keycache_hit(struct bench_context *ctx, uint64_t iterations) {
+	struct wev_seat_state *seat = ctx->state->seat;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		const struct wev_keycache_entry *key = keycache_get(&seat->keycache,
+				seat->xkb_state, bench_keys[i % BENCH_KEY_COUNT],
+				seat->xkb_mods, seat->xkb_layout);
+		ctx->sink += key->sym_len;
+	}
+}
+
+static void bench_keycache_miss(struct bench_context *ctx,
+		uint64_t iterations) {
+	struct wev_seat_state *seat = ctx->state->seat;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		keycache_invalidate(&seat->keycache);
+		const struct wev_keycache_entry *key = keycache_get(&seat->keycache,
+				seat->xkb_state, bench_keys[i % BENCH_KEY_COUNT],
+				seat->xkb_mods, seat->xkb_layout);
+		ctx->sink += key->sym_len;
+	}
+}
+
+/* What wl_keyboard_key did for every key before the cache */
+static void bench_xkb_lookup(struct bench_context *ctx, uint64_t iterations) {
+	struct wev_seat_state *seat = ctx->state->seat;
+	char name[64], utf8[48];
+	for (uint64_t i = 0; i < iterations; ++i) {
+		xkb_keycode_t keycode = bench_keys[i % BENCH_KEY_COUNT];
+		xkb_keysym_t sym = xkb_state_key_get_one_sym(seat->xkb_state, keycode);
+		xkb_keysym_get_name(sym, name, sizeof(name));
+		xkb_state_key_get_utf8(seat->xkb_state, keycode, utf8, sizeof(utf8));
+		ctx->sink += name[0] + utf8[0];
+	}
+}
+
+static void bench_output_fixed(struct bench_context *ctx,
+		uint64_t iterations) {
+	struct wev_state *state = ctx->state;
+	for (uint64_t i = 0; i < iterations; ++i) {
+		output_fixed(&state->out, (int32_t)(i * 2654435761u));
+		state->out.len = 0;
+	}
+}
+
+static const struct bench benches[] = {
+	{ "event_prefix", bench_event_prefix },
+	{ "print_event motion", bench_print_motion },
+	{ "print_event key", bench_print_key },
+	{ "print_event motion jsonl", bench_json_motion },
+	{ "predicate_run key", bench_predicate_run },
+	{ "print_modifiers", bench_print_modifiers },
+	{ "dnd_actions_str", bench_dnd_actions_str },
+	{ "escape_utf8", bench_escape_utf8 },
+	{ "keycache_get hit", bench_keycache_hit },
+	{ "keycache_get miss", bench_keycache_miss },
+	{ "xkb sym and utf8 lookup", bench_xkb_lookup },
+	{ "output_fixed", bench_output_fixed },
+};
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Finds how many iterations take about BENCH_SAMPLE_NS, which also warms up
+ * the caches, then reports the median time per iteration over the samples
+ * with its median absolute deviation, and the fastest one.
+ */
+static void bench_run(const struct bench *bench, struct bench_context *ctx) {
+	uint64_t iterations = 1;
+	while (true) {
+		uint64_t start = monotonic_ns();
+		bench->run(ctx, iterations);
+		uint64_t elapsed = monotonic_ns() - start;
+		if (elapsed >= BENCH_SAMPLE_NS / 2) {
+			iterations = iterations * BENCH_SAMPLE_NS / (elapsed ? elapsed : 1);
+			break;
+		}
+		iterations *= 2;
+	}
+	if (iterations == 0) {
+		iterations = 1;
+	}
+
+	double samples[BENCH_SAMPLES], deviations[BENCH_SAMPLES];
+	uint64_t allocations = bench_allocations;
+	for (int i = 0; i < BENCH_SAMPLES; ++i) {
+		uint64_t start = monotonic_ns();
+		bench->run(ctx, iterations);
+		samples[i] = (double)(monotonic_ns() - start) / iterations;
+	}
+	allocations = bench_allocations - allocations;
+
+	qsort(samples, BENCH_SAMPLES, sizeof(double), compare_double);
+	double median = samples[BENCH_SAMPLES / 2];
+	for (int i = 0; i < BENCH_SAMPLES; ++i) {
+		deviations[i] = fabs(samples[i] - median);
+	}
+	qsort(deviations, BENCH_SAMPLES, sizeof(double), compare_double);
+	double mad = deviations[BENCH_SAMPLES / 2];
+
+	printf("%-26s %10.2f %7.1f%% %10.2f", bench->name, median,
+			median > 0 ? mad * 100 / median : 0, samples[0]);
+#ifdef BENCH_COUNT_ALLOCATIONS
+	printf(" %10.3f\n",
+			(double)allocations / ((uint64_t)BENCH_SAMPLES * iterations));
+#else
+	printf(" %10s\n", "-");
+#endif
+}
+
+int main(int argc, char *argv[]) {
+	static struct wev_state state;
+	static struct wev_seat_state seat;
+	state.out.fd = -1;
+	// The events below are of no seat, whose state print_event uses too
+	state.seat_states[0] = state.seat = &seat;
+	wl_list_init(&state.opts.filters);
+	wl_list_init(&state.opts.inverse_filters);
+	compile_filters(&state.opts);
+
+	state.xkb_context = xkb_context_new(XKB_CONTEXT_NO_DEFAULT_INCLUDES |
+			XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+	seat.xkb_keymap = xkb_keymap_new_from_string(state.xkb_context,
+			bench_keymap, XKB_KEYMAP_FORMAT_TEXT_V1,
+			XKB_KEYMAP_COMPILE_NO_FLAGS);
+	if (!seat.xkb_keymap) {
+		fprintf(stderr, "Failed to compile the test keymap\n");
+		return 1;
+	}
+	seat.xkb_state = xkb_state_new(seat.xkb_keymap);
+
+	struct bench_context ctx = { .state = &state };
+	ctx.motion = bench_event(WEV_WL_POINTER, WEV_WL_POINTER_MOTION,
+			3, (uint32_t[]){ 1000, 0x1280, 0x2440 });
+	ctx.key = bench_event(WEV_WL_KEYBOARD, WEV_WL_KEYBOARD_KEY,
+			4, (uint32_t[]){ 100, 1000, 30, 1 });
+	struct wev_predicate_error error;
+	enum wev_predicate_result result;
+	struct wev_predicate *where =
+		predicate_parse("key == 30 && state == 1", &error);
+	if (!where || predicate_compile(where, wev_event_fields[WEV_WL_KEYBOARD]
+				[WEV_WL_KEYBOARD_KEY], &result, &ctx.where) < 0 ||
+			result != WEV_PREDICATE_PROGRAM) {
+		fprintf(stderr, "Failed to compile the test predicate\n");
+		return 1;
+	}
+
+	printf("%-26s %10s %8s %10s %10s\n",
+			"benchmark", "ns/op", "mad", "min", "allocs/op");
+	for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+		if (argc > 1 && !strstr(benches[i].name, argv[1])) {
+			continue;
+		}
+		bench_run(&benches[i], &ctx);
+	}
+	return 0;
+}
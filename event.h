@@ -0,0 +1,320 @@
+#ifndef EVENT_H
+#define EVENT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Interfaces wev listens to. These are stored in trace files, so only ever
+ * append to this list.
+ */
+enum wev_interface {
+	WEV_WL_REGISTRY,
+	WEV_WL_SEAT,
+	WEV_WL_POINTER,
+	WEV_WL_KEYBOARD,
+	WEV_WL_TOUCH,
+	WEV_XDG_SURFACE,
+	WEV_XDG_TOPLEVEL,
+	WEV_WL_DATA_OFFER,
+	WEV_WL_DATA_DEVICE,
+	WEV_ZWP_INPUT_TIMESTAMPS_V1,
+	WEV_ZWP_RELATIVE_POINTER_V1,
+	WEV_ZWP_LOCKED_POINTER_V1,
+	WEV_WP_PRESENTATION,
+	WEV_WP_PRESENTATION_FEEDBACK,
+	WEV_ZWP_TABLET_SEAT_V2,
+	WEV_ZWP_TABLET_V2,
+	WEV_ZWP_TABLET_TOOL_V2,
+	WEV_ZWP_TABLET_PAD_V2,
+	WEV_INTERFACE_COUNT,
+};
+
+/* Interfaces traced with --bind are numbered from WEV_INTERFACE_COUNT on */
+#define WEV_INTERFACE_MAX 64
+
+#define WEV_INTERFACE_NAME_MAX 56
+
+/*
+ * The interfaces numbered from WEV_INTERFACE_COUNT on, in order. Their
+ * numbers depend on the --bind options, so this goes with traces and
+ * published events for readers to match them up with their own by name.
+ */
+struct wev_interface_table {
+	uint32_t count;
+	uint32_t reserved;
+	struct wev_interface_name {
+		char name[WEV_INTERFACE_NAME_MAX];
+		uint32_t version;
+		uint32_t reserved;
+	} interfaces[WEV_INTERFACE_MAX - WEV_INTERFACE_COUNT];
+};
+
+/* Whether a table read from a trace or another process is well-formed */
+static inline bool wev_interface_table_valid(
+		const struct wev_interface_table *table) {
+	if (table->count > WEV_INTERFACE_MAX - WEV_INTERFACE_COUNT) {
+		return false;
+	}
+	for (uint32_t i = 0; i < table->count; ++i) {
+		if (!memchr(table->interfaces[i].name, '\0',
+					sizeof(table->interfaces[i].name))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Event opcodes, in protocol order. wayland-scanner only generates request
+ * opcodes for clients.
+ */
+enum {
+	WEV_WL_REGISTRY_GLOBAL = 0,
+	WEV_WL_REGISTRY_GLOBAL_REMOVE = 1,
+};
+
+enum {
+	WEV_WL_SEAT_CAPABILITIES = 0,
+	WEV_WL_SEAT_NAME = 1,
+};
+
+enum {
+	WEV_WL_POINTER_ENTER = 0,
+	WEV_WL_POINTER_LEAVE = 1,
+	WEV_WL_POINTER_MOTION = 2,
+	WEV_WL_POINTER_BUTTON = 3,
+	WEV_WL_POINTER_AXIS = 4,
+	WEV_WL_POINTER_FRAME = 5,
+	WEV_WL_POINTER_AXIS_SOURCE = 6,
+	WEV_WL_POINTER_AXIS_STOP = 7,
+	WEV_WL_POINTER_AXIS_DISCRETE = 8,
+};
+
+enum {
+	WEV_WL_KEYBOARD_KEYMAP = 0,
+	WEV_WL_KEYBOARD_ENTER = 1,
+	WEV_WL_KEYBOARD_LEAVE = 2,
+	WEV_WL_KEYBOARD_KEY = 3,
+	WEV_WL_KEYBOARD_MODIFIERS = 4,
+	WEV_WL_KEYBOARD_REPEAT_INFO = 5,
+};
+
+enum {
+	WEV_WL_TOUCH_DOWN = 0,
+	WEV_WL_TOUCH_UP = 1,
+	WEV_WL_TOUCH_MOTION = 2,
+	WEV_WL_TOUCH_FRAME = 3,
+	WEV_WL_TOUCH_CANCEL = 4,
+	WEV_WL_TOUCH_SHAPE = 5,
+	WEV_WL_TOUCH_ORIENTATION = 6,
+};
+
+enum {
+	WEV_XDG_SURFACE_CONFIGURE = 0,
+};
+
+enum {
+	WEV_XDG_TOPLEVEL_CONFIGURE = 0,
+	WEV_XDG_TOPLEVEL_CLOSE = 1,
+};
+
+enum {
+	WEV_WL_DATA_OFFER_OFFER = 0,
+	WEV_WL_DATA_OFFER_SOURCE_ACTIONS = 1,
+	WEV_WL_DATA_OFFER_ACTION = 2,
+};
+
+enum {
+	WEV_WL_DATA_DEVICE_DATA_OFFER = 0,
+	WEV_WL_DATA_DEVICE_ENTER = 1,
+	WEV_WL_DATA_DEVICE_LEAVE = 2,
+	WEV_WL_DATA_DEVICE_MOTION = 3,
+	WEV_WL_DATA_DEVICE_DROP = 4,
+	WEV_WL_DATA_DEVICE_SELECTION = 5,
+};
+
+/* Recorded with the id of the input device it is for as a fourth argument */
+enum {
+	WEV_ZWP_INPUT_TIMESTAMPS_V1_TIMESTAMP = 0,
+};
+
+enum {
+	WEV_ZWP_RELATIVE_POINTER_V1_RELATIVE_MOTION = 0,
+};
+
+enum {
+	WEV_ZWP_LOCKED_POINTER_V1_LOCKED = 0,
+	WEV_ZWP_LOCKED_POINTER_V1_UNLOCKED = 1,
+};
+
+enum {
+	WEV_WP_PRESENTATION_CLOCK_ID = 0,
+};
+
+/*
+ * presented is recorded with the presentation time in nanoseconds and the
+ * sequence number each split into a high and a low argument, then refresh
+ * and flags, then how long the frame took in nanoseconds from the input event
+ * it was drawn for to its commit (0 if none), and from its commit to being
+ * presented.
+ */
+enum {
+	WEV_WP_PRESENTATION_FEEDBACK_SYNC_OUTPUT = 0,
+	WEV_WP_PRESENTATION_FEEDBACK_PRESENTED = 1,
+	WEV_WP_PRESENTATION_FEEDBACK_DISCARDED = 2,
+};
+
+enum {
+	WEV_ZWP_TABLET_SEAT_V2_TABLET_ADDED = 0,
+	WEV_ZWP_TABLET_SEAT_V2_TOOL_ADDED = 1,
+	WEV_ZWP_TABLET_SEAT_V2_PAD_ADDED = 2,
+};
+
+enum {
+	WEV_ZWP_TABLET_V2_NAME = 0,
+	WEV_ZWP_TABLET_V2_ID = 1,
+	WEV_ZWP_TABLET_V2_PATH = 2,
+	WEV_ZWP_TABLET_V2_DONE = 3,
+	WEV_ZWP_TABLET_V2_REMOVED = 4,
+};
+
+enum {
+	WEV_ZWP_TABLET_TOOL_V2_TYPE = 0,
+	WEV_ZWP_TABLET_TOOL_V2_HARDWARE_SERIAL = 1,
+	WEV_ZWP_TABLET_TOOL_V2_HARDWARE_ID_WACOM = 2,
+	WEV_ZWP_TABLET_TOOL_V2_CAPABILITY = 3,
+	WEV_ZWP_TABLET_TOOL_V2_DONE = 4,
+	WEV_ZWP_TABLET_TOOL_V2_REMOVED = 5,
+	WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_IN = 6,
+	WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_OUT = 7,
+	WEV_ZWP_TABLET_TOOL_V2_DOWN = 8,
+	WEV_ZWP_TABLET_TOOL_V2_UP = 9,
+	WEV_ZWP_TABLET_TOOL_V2_MOTION = 10,
+	WEV_ZWP_TABLET_TOOL_V2_PRESSURE = 11,
+	WEV_ZWP_TABLET_TOOL_V2_DISTANCE = 12,
+	WEV_ZWP_TABLET_TOOL_V2_TILT = 13,
+	WEV_ZWP_TABLET_TOOL_V2_ROTATION = 14,
+	WEV_ZWP_TABLET_TOOL_V2_SLIDER = 15,
+	WEV_ZWP_TABLET_TOOL_V2_WHEEL = 16,
+	WEV_ZWP_TABLET_TOOL_V2_BUTTON = 17,
+	WEV_ZWP_TABLET_TOOL_V2_FRAME = 18,
+};
+
+enum {
+	WEV_ZWP_TABLET_PAD_V2_GROUP = 0,
+	WEV_ZWP_TABLET_PAD_V2_PATH = 1,
+	WEV_ZWP_TABLET_PAD_V2_BUTTONS = 2,
+	WEV_ZWP_TABLET_PAD_V2_DONE = 3,
+	WEV_ZWP_TABLET_PAD_V2_BUTTON = 4,
+	WEV_ZWP_TABLET_PAD_V2_ENTER = 5,
+	WEV_ZWP_TABLET_PAD_V2_LEAVE = 6,
+	WEV_ZWP_TABLET_PAD_V2_REMOVED = 7,
+};
+
+#define WEV_EVENT_MAX_ARGS 8
+
+/* The event did not pass -f/-F, but the formatter needs it to track state */
+#define WEV_EVENT_HIDDEN (1 << 0)
+/* Published without its string and array data, which did not fit */
+#define WEV_EVENT_TRUNCATED (1 << 1)
+
+union wev_arg {
+	int32_t i;
+	uint32_t u;
+};
+
+/* Seats are numbered from 1 as they are bound, 0 is for other objects */
+#define WEV_SEAT_MAX 256
+
+/*
+ * A received event with its raw arguments. Integer, fixed and enum arguments
+ * are stored as-is and objects as their ids. String and array arguments hold
+ * an offset into data, where a uint32_t length precedes the bytes.
+ */
+struct wev_event {
+	uint64_t time; /* CLOCK_MONOTONIC receive time, in nanoseconds */
+	uint32_t size; /* Of the whole record, including data */
+	uint32_t id;
+	uint8_t iface;
+	uint8_t opcode;
+	uint8_t flags;
+	uint8_t seat; /* Of the object, see WEV_SEAT_MAX */
+	union wev_arg args[WEV_EVENT_MAX_ARGS];
+	char data[];
+};
+
+static inline const void *wev_event_array(const struct wev_event *ev,
+		int arg, uint32_t *size) {
+	const char *p = ev->data + ev->args[arg].u;
+	*size = *(const uint32_t *)p;
+	return p + sizeof(uint32_t);
+}
+
+static inline const char *wev_event_string(const struct wev_event *ev,
+		int arg) {
+	uint32_t size;
+	return wev_event_array(ev, arg, &size);
+}
+
+/*
+ * A named argument in a description of an event's arguments, such as
+ * "userial utime kkey ustate": each field is its type followed by its name,
+ * see wev_event_fields in wev.c for the types.
+ */
+struct wev_field {
+	char type;
+	const char *name;
+	size_t len;
+};
+
+/* Steps through the fields of a description */
+static inline bool wev_next_field(const char **fields,
+		struct wev_field *field) {
+	const char *p = *fields;
+	if (!p || !*p) {
+		return false;
+	}
+	field->type = *p++;
+	field->name = p;
+	field->len = strcspn(p, " ");
+	p += field->len;
+	*fields = *p ? p + 1 : p;
+	return true;
+}
+
+/* The number of wev_event.args a field takes up */
+static inline int wev_field_args(char type) {
+	return type == 't' ? 2 : 1;
+}
+
+/*
+ * Whether the string and array arguments of an event read from a trace or
+ * another process lie within its record, given its fields.
+ */
+static inline bool wev_event_valid(const struct wev_event *ev,
+		const char *fields) {
+	size_t data = ev->size - offsetof(struct wev_event, data);
+	struct wev_field field;
+	for (int arg = 0; arg < WEV_EVENT_MAX_ARGS &&
+			wev_next_field(&fields, &field);
+			arg += wev_field_args(field.type)) {
+		if (field.type != 's' && field.type != 'a') {
+			continue;
+		}
+		uint32_t offset = ev->args[arg].u, size;
+		if (offset > data || data - offset < sizeof(size)) {
+			return false;
+		}
+		memcpy(&size, ev->data + offset, sizeof(size));
+		// Followed by a terminator, which strings are read up to
+		if (size >= data - offset - sizeof(size) ||
+				ev->data[offset + sizeof(size) + size] != '\0') {
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
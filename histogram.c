@@ -0,0 +1,50 @@
+#include "histogram.h"
+
+static unsigned int bucket_index(uint32_t value) {
+	if (value < 2 * HISTOGRAM_SUB_BUCKETS) {
+		return value;
+	}
+	unsigned int shift = 31 - __builtin_clz(value) - HISTOGRAM_SUB_BITS;
+	return (shift + 1) * HISTOGRAM_SUB_BUCKETS +
+		(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+/* The largest value which falls into the given bucket */
+static uint32_t bucket_value(unsigned int index) {
+	if (index < 2 * HISTOGRAM_SUB_BUCKETS) {
+		return index;
+	}
+	unsigned int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+	uint64_t top = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+	return ((top + 1) << shift) - 1;
+}
+
+void histogram_add(struct wev_histogram *hist, uint32_t value) {
+	if (hist->count == 0 || value < hist->min) {
+		hist->min = value;
+	}
+	if (value > hist->max) {
+		hist->max = value;
+	}
+	++hist->count;
+	++hist->buckets[bucket_index(value)];
+}
+
+uint32_t histogram_value_at(const struct wev_histogram *hist, double fraction) {
+	if (hist->count == 0) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t)(fraction * hist->count + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		seen += hist->buckets[i];
+		if (seen >= rank) {
+			uint32_t value = bucket_value(i);
+			return value < hist->max ? value : hist->max;
+		}
+	}
+	return hist->max;
+}
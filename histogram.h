@@ -0,0 +1,24 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+#include <stdint.h>
+
+/*
+ * Log-bucketed histogram, in the style of HdrHistogram: values below
+ * 2 * HISTOGRAM_SUB_BUCKETS are counted exactly, and larger ones with a
+ * relative error of at most 1 / HISTOGRAM_SUB_BUCKETS.
+ */
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct wev_histogram {
+	uint64_t count;
+	uint32_t min, max;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_add(struct wev_histogram *hist, uint32_t value);
+/* The value below which the given fraction (0 to 1) of samples fall */
+uint32_t histogram_value_at(const struct wev_histogram *hist, double fraction);
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "keycache.h"
+
+static void escape_utf8(char *buf) {
+	if (buf[0] == '\0' || buf[1] != '\0') {
+		return;
+	}
+	switch (buf[0]) {
+	case '\a':
+		strcpy(buf, "\\a");
+		break;
+	case '\b':
+		strcpy(buf, "\\b");
+		break;
+	case '\e':
+		strcpy(buf, "\\e");
+		break;
+	case '\f':
+		strcpy(buf, "\\f");
+		break;
+	case '\n':
+		strcpy(buf, "\\n");
+		break;
+	case '\r':
+		strcpy(buf, "\\r");
+		break;
+	case '\t':
+		strcpy(buf, "\\t");
+		break;
+	case '\v':
+		strcpy(buf, "\\v");
+		break;
+	}
+}
+
+void keycache_invalidate(struct wev_keycache *cache) {
+	if (++cache->generation == 0) {
+		// Wrapped around, so old entries could look current again
+		memset(cache->entries, 0, sizeof(cache->entries));
+		cache->generation = 1;
+	}
+	cache->used = 0;
+}
+
+static uint32_t keycache_hash(xkb_keycode_t keycode,
+		xkb_mod_mask_t mods, xkb_layout_index_t layout) {
+	uint32_t h = keycode * 0x9E3779B1u;
+	h ^= (mods + (layout << 24)) * 0x85EBCA77u;
+	return h ^ (h >> 15);
+}
+
+static void keycache_fill(struct wev_keycache_entry *entry,
+		struct xkb_state *state) {
+	char name[64];
+	entry->sym = xkb_state_key_get_one_sym(state, entry->keycode);
+	xkb_keysym_get_name(entry->sym, name, sizeof(name));
+	int len = snprintf(entry->sym_text, sizeof(entry->sym_text),
+			"%-12s (%d)", name, entry->sym);
+	if (len >= (int)sizeof(entry->sym_text)) {
+		len = sizeof(entry->sym_text) - 1;
+	}
+	entry->sym_len = len;
+	entry->name_len = strlen(name);
+
+	xkb_state_key_get_utf8(state, entry->keycode,
+			entry->text, sizeof(entry->text));
+	entry->text_len = strlen(entry->text);
+	memcpy(entry->utf8, entry->text, entry->text_len + 1);
+	escape_utf8(entry->utf8);
+	entry->utf8_len = strlen(entry->utf8);
+}
+
+const struct wev_keycache_entry *keycache_get(struct wev_keycache *cache,
+		struct xkb_state *state, xkb_keycode_t keycode,
+		xkb_mod_mask_t mods, xkb_layout_index_t layout) {
+	if (cache->generation == 0) {
+		keycache_invalidate(cache);
+	}
+	if (cache->used >= KEYCACHE_SIZE * 3 / 4) {
+		keycache_invalidate(cache);
+	}
+
+	uint32_t i = keycache_hash(keycode, mods, layout);
+	struct wev_keycache_entry *entry;
+	while (true) {
+		entry = &cache->entries[i++ & (KEYCACHE_SIZE - 1)];
+		if (entry->generation != cache->generation) {
+			break;
+		}
+		if (entry->keycode == keycode && entry->mods == mods &&
+				entry->layout == layout) {
+			return entry;
+		}
+	}
+
+	entry->generation = cache->generation;
+	entry->keycode = keycode;
+	entry->mods = mods;
+	entry->layout = layout;
+	keycache_fill(entry, state);
+	++cache->used;
+	return entry;
+}
@@ -0,0 +1,36 @@
+#ifndef KEYCACHE_H
+#define KEYCACHE_H
+#include <stdint.h>
+#include <xkbcommon/xkbcommon.h>
+
+#define KEYCACHE_SIZE 256 /* Must be a power of two */
+
+/* What wev prints for a key, formatted once per keymap, mods and layout */
+struct wev_keycache_entry {
+	uint32_t generation; /* Empty unless equal to the cache's */
+	xkb_keycode_t keycode;
+	xkb_mod_mask_t mods;
+	xkb_layout_index_t layout;
+	xkb_keysym_t sym;
+	uint16_t sym_len, name_len, utf8_len, text_len;
+	char sym_text[80]; /* Keysym name padded to 12 columns, and value */
+	char utf8[48]; /* Escaped */
+	char text[48]; /* Unescaped, for --format */
+};
+
+/* Open-addressed, with linear probing; emptied when it fills up */
+struct wev_keycache {
+	uint32_t generation;
+	uint32_t used;
+	struct wev_keycache_entry entries[KEYCACHE_SIZE];
+};
+
+/* Forgets all entries, e.g. because the keymap changed */
+void keycache_invalidate(struct wev_keycache *cache);
+
+/* mods and layout must be the effective ones of state */
+const struct wev_keycache_entry *keycache_get(struct wev_keycache *cache,
+		struct xkb_state *state, xkb_keycode_t keycode,
+		xkb_mod_mask_t mods, xkb_layout_index_t layout);
+
+#endif
@@ -0,0 +1,112 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include "keymap.h"
+
+static uint64_t keymap_hash(const char *text, uint32_t size) {
+	uint64_t h = 0xCBF29CE484222325 ^ size;
+	uint32_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, text + i, sizeof(word));
+		h = (h ^ word) * 0x9E3779B97F4A7C15;
+		h ^= h >> 29;
+	}
+	for (; i < size; ++i) {
+		h = (h ^ (uint8_t)text[i]) * 0x100000001B3;
+	}
+	return h;
+}
+
+struct xkb_keymap *keymap_cache_get(struct wev_keymap_cache *cache,
+		struct xkb_context *context, const char *text, uint32_t size) {
+	uint64_t hash = keymap_hash(text, size);
+	int lru = 0;
+	for (int i = 0; i < KEYMAP_CACHE_SIZE; ++i) {
+		if (cache->entries[i].keymap && cache->entries[i].hash == hash &&
+				cache->entries[i].size == size) {
+			cache->entries[i].last_used = ++cache->clock;
+			return cache->entries[i].keymap;
+		}
+		if (cache->entries[i].last_used < cache->entries[lru].last_used) {
+			lru = i;
+		}
+	}
+
+	struct xkb_keymap *keymap = xkb_keymap_new_from_string(context, text,
+			XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	if (!keymap) {
+		return NULL;
+	}
+	xkb_keymap_unref(cache->entries[lru].keymap);
+	cache->entries[lru].hash = hash;
+	cache->entries[lru].size = size;
+	cache->entries[lru].last_used = ++cache->clock;
+	cache->entries[lru].keymap = keymap;
+	return keymap;
+}
+
+/* Copies in the kernel where possible, falling back to the mapping */
+static int keymap_copy(int out, int fd, const char *map, uint32_t size) {
+	off_t offset = 0;
+	bool in_kernel = true;
+	while (in_kernel && offset < size) {
+		ssize_t n = copy_file_range(fd, &offset, out, NULL, size - offset, 0);
+		if (n == 0) {
+			break;
+		} else if (n < 0 && errno != EINTR) {
+			in_kernel = false;
+		}
+	}
+	// Not supported between these files, e.g. memfd to another filesystem
+	in_kernel = true;
+	while (in_kernel && offset < size) {
+		ssize_t n = sendfile(out, fd, &offset, size - offset);
+		if (n == 0) {
+			break;
+		} else if (n < 0 && errno != EINTR) {
+			in_kernel = false;
+		}
+	}
+	while (offset < size) {
+		ssize_t n = write(out, map + offset, size - offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		offset += n;
+	}
+	return 0;
+}
+
+int keymap_dump(const char *path, int fd, const char *map, uint32_t size) {
+	char tmp[PATH_MAX];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (out < 0) {
+		return -1;
+	}
+	int ret = keymap_copy(out, fd, map, size);
+	if (close(out) < 0) {
+		ret = -1;
+	}
+	// Renamed into place, so readers never see a partial keymap
+	if (ret < 0 || rename(tmp, path) < 0) {
+		int err = errno;
+		unlink(tmp);
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
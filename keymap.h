@@ -0,0 +1,29 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+#include <stdint.h>
+#include <xkbcommon/xkbcommon.h>
+
+#define KEYMAP_CACHE_SIZE 4
+
+/*
+ * Compiled keymaps, looked up by a hash of their text, as compositors tend to
+ * send the same few keymaps over and over again.
+ */
+struct wev_keymap_cache {
+	uint64_t clock;
+	struct {
+		uint64_t hash;
+		uint32_t size;
+		uint64_t last_used;
+		struct xkb_keymap *keymap;
+	} entries[KEYMAP_CACHE_SIZE];
+};
+
+/* Returns a keymap owned by the cache, or NULL if it fails to compile */
+struct xkb_keymap *keymap_cache_get(struct wev_keymap_cache *cache,
+		struct xkb_context *context, const char *text, uint32_t size);
+
+/* Atomically replaces path with the first size bytes of fd */
+int keymap_dump(const char *path, int fd, const char *map, uint32_t size);
+
+#endif
@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "output.h"
+
+static void write_all(struct wev_output *out, const char *s, size_t n) {
+	out->written += n;
+	if (out->fd < 0) {
+		return;
+	}
+	while (n > 0) {
+		ssize_t ret = write(out->fd, s, n);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			// Nowhere left to report this; drop the output
+			return;
+		}
+		s += ret;
+		n -= ret;
+	}
+}
+
+void output_flush(struct wev_output *out) {
+	write_all(out, out->buf, out->len);
+	out->len = 0;
+}
+
+void output_write_slow(struct wev_output *out, const char *s, size_t n) {
+	output_flush(out);
+	if (n > sizeof(out->buf)) {
+		write_all(out, s, n);
+		return;
+	}
+	memcpy(out->buf, s, n);
+	out->len = n;
+}
+
+static void output_pad(struct wev_output *out, char c, int n) {
+	for (; n > 0; --n) {
+		output_char(out, c);
+	}
+}
+
+void output_str_pad(struct wev_output *out, const char *s, int width) {
+	size_t len = strlen(s);
+	bool left = width < 0;
+	int pad = (left ? -width : width) - (int)len;
+	if (!left) {
+		output_pad(out, ' ', pad);
+	}
+	output_write(out, s, len);
+	if (left) {
+		output_pad(out, ' ', pad);
+	}
+}
+
+static void output_digits(struct wev_output *out,
+		uint64_t v, int width, bool negative) {
+	char buf[24];
+	char *p = buf + sizeof(buf);
+	do {
+		*--p = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (buf + sizeof(buf) - p < width) {
+		*--p = '0';
+	}
+	if (negative) {
+		*--p = '-';
+	}
+	output_write(out, p, buf + sizeof(buf) - p);
+}
+
+void output_int(struct wev_output *out, int32_t v) {
+	uint32_t abs = v < 0 ? -(uint32_t)v : (uint32_t)v;
+	output_digits(out, abs, 0, v < 0);
+}
+
+void output_uint(struct wev_output *out, uint32_t v) {
+	output_digits(out, v, 0, false);
+}
+
+void output_uint_pad(struct wev_output *out, uint32_t v, int width) {
+	output_digits(out, v, width, false);
+}
+
+void output_hex_pad(struct wev_output *out, uint32_t v, int width) {
+	static const char digits[] = "0123456789ABCDEF";
+	char buf[8];
+	char *p = buf + sizeof(buf);
+	do {
+		*--p = digits[v & 15];
+		v >>= 4;
+	} while (v);
+	output_pad(out, '0', width - (int)(buf + sizeof(buf) - p));
+	output_write(out, p, buf + sizeof(buf) - p);
+}
+
+void output_fixed(struct wev_output *out, int32_t v) {
+	uint32_t abs = v < 0 ? -(uint32_t)v : (uint32_t)v;
+	uint32_t integer = abs >> 8;
+	// abs & 255 over 256 is exactly (abs & 255) * 390625 over 10^8
+	uint32_t frac = (abs & 255) * 390625;
+	uint32_t micro = frac / 100, rest = frac % 100;
+	// Round half to even, like printf does with the exact value
+	if (rest > 50 || (rest == 50 && (micro & 1))) {
+		if (++micro == 1000000) {
+			micro = 0;
+			++integer;
+		}
+	}
+	output_digits(out, integer, 0, v < 0);
+	output_char(out, '.');
+	output_digits(out, micro, 6, false);
+}
+
+void output_uint64(struct wev_output *out, uint64_t v) {
+	output_digits(out, v, 0, false);
+}
+
+void output_fixed_exact(struct wev_output *out, int32_t v) {
+	uint32_t abs = v < 0 ? -(uint32_t)v : (uint32_t)v;
+	output_digits(out, abs >> 8, 0, v < 0);
+	uint32_t frac = (abs & 255) * 390625;
+	if (frac == 0) {
+		return;
+	}
+	int width = 8;
+	while (frac % 10 == 0) {
+		frac /= 10;
+		--width;
+	}
+	output_char(out, '.');
+	output_digits(out, frac, width, false);
+}
+
+void output_json_str(struct wev_output *out, const char *s, size_t n) {
+	static const char digits[] = "0123456789abcdef";
+	output_char(out, '"');
+	size_t start = 0;
+	for (size_t i = 0; i < n; ++i) {
+		unsigned char c = s[i];
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+		output_write(out, s + start, i - start);
+		start = i + 1;
+		switch (c) {
+		case '"':
+			output_lit(out, "\\\"");
+			break;
+		case '\\':
+			output_lit(out, "\\\\");
+			break;
+		case '\n':
+			output_lit(out, "\\n");
+			break;
+		case '\r':
+			output_lit(out, "\\r");
+			break;
+		case '\t':
+			output_lit(out, "\\t");
+			break;
+		default:;
+			char esc[] = { '\\', 'u', '0', '0',
+				digits[c >> 4], digits[c & 15] };
+			output_write(out, esc, sizeof(esc));
+			break;
+		}
+	}
+	output_write(out, s + start, n - start);
+	output_char(out, '"');
+}
+
+void output_csv_str(struct wev_output *out, const char *s, size_t n) {
+	bool quote = false;
+	for (size_t i = 0; i < n && !quote; ++i) {
+		quote = s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r';
+	}
+	if (!quote) {
+		output_write(out, s, n);
+		return;
+	}
+	// Quotes are escaped by doubling them
+	output_char(out, '"');
+	size_t start = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (s[i] == '"') {
+			output_write(out, s + start, i + 1 - start);
+			start = i;
+		}
+	}
+	output_write(out, s + start, n - start);
+	output_char(out, '"');
+}
@@ -0,0 +1,65 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+/*
+ * Text output, buffered until output_flush writes it with a single write(2).
+ * Formatting is done by hand rather than with stdio. With an fd of -1, the
+ * output is only counted.
+ */
+struct wev_output {
+	int fd;
+	uint64_t written;
+	size_t len;
+	char buf[OUTPUT_BUFFER_SIZE];
+};
+
+void output_flush(struct wev_output *out);
+void output_write_slow(struct wev_output *out, const char *s, size_t n);
+
+static inline void output_write(struct wev_output *out,
+		const char *s, size_t n) {
+	if (out->len + n > sizeof(out->buf)) {
+		output_write_slow(out, s, n);
+		return;
+	}
+	memcpy(out->buf + out->len, s, n);
+	out->len += n;
+}
+
+static inline void output_str(struct wev_output *out, const char *s) {
+	output_write(out, s, strlen(s));
+}
+
+/* For string literals, whose length is known at compile time */
+#define output_lit(out, s) output_write((out), "" s, sizeof(s) - 1)
+
+static inline void output_char(struct wev_output *out, char c) {
+	output_write(out, &c, 1);
+}
+
+/* Like %*s: negative widths pad on the right */
+void output_str_pad(struct wev_output *out, const char *s, int width);
+/* Like %d and %u */
+void output_int(struct wev_output *out, int32_t v);
+void output_uint(struct wev_output *out, uint32_t v);
+/* Like %0*u */
+void output_uint_pad(struct wev_output *out, uint32_t v, int width);
+/* Like %0*X */
+void output_hex_pad(struct wev_output *out, uint32_t v, int width);
+/* Like %f of wl_fixed_to_double(v), without going through a double */
+void output_fixed(struct wev_output *out, int32_t v);
+/* Like %u, for 64 bit values */
+void output_uint64(struct wev_output *out, uint64_t v);
+/* wl_fixed_to_double(v) exactly, in as few digits as that takes */
+void output_fixed_exact(struct wev_output *out, int32_t v);
+/* As a JSON string, with quotes */
+void output_json_str(struct wev_output *out, const char *s, size_t n);
+/* As a CSV field, quoted only if needed */
+void output_csv_str(struct wev_output *out, const char *s, size_t n);
+
+#endif
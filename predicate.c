@@ -0,0 +1,500 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "predicate.h"
+
+enum {
+	INSN_INT, /* Signed 32-bit argument */
+	INSN_UINT, /* Unsigned 32-bit argument */
+	INSN_FIXED,
+	INSN_UINT64, /* Split into a high and a low argument */
+	INSN_STRING,
+	INSN_AND,
+	INSN_OR,
+	INSN_NOT,
+};
+
+enum token {
+	TOKEN_END,
+	TOKEN_WORD,
+	TOKEN_STRING,
+	TOKEN_CMP,
+	TOKEN_AND,
+	TOKEN_OR,
+	TOKEN_NOT,
+	TOKEN_OPEN,
+	TOKEN_CLOSE,
+	TOKEN_INVALID,
+};
+
+struct parser {
+	const char *expr;
+	const char *p;
+	/* The current token */
+	enum token token;
+	const char *start;
+	size_t len;
+	enum wev_predicate_cmp cmp;
+	int nodes, depth;
+	struct wev_predicate_error *error;
+};
+
+/* Characters which end a word, besides spaces */
+#define PREDICATE_SPECIAL "()!=<>&|\""
+
+static void next_token(struct parser *parser) {
+	const char *p = parser->p;
+	while (*p == ' ' || *p == '\t' || *p == '\n') {
+		++p;
+	}
+	parser->start = p;
+	static const struct {
+		const char *text;
+		enum token token;
+		enum wev_predicate_cmp cmp;
+	} operators[] = {
+		// Longest first
+		{ .text = "==", .token = TOKEN_CMP, .cmp = WEV_PREDICATE_EQ },
+		{ .text = "!=", .token = TOKEN_CMP, .cmp = WEV_PREDICATE_NE },
+		{ .text = "<=", .token = TOKEN_CMP, .cmp = WEV_PREDICATE_LE },
+		{ .text = ">=", .token = TOKEN_CMP, .cmp = WEV_PREDICATE_GE },
+		{ .text = "&&", .token = TOKEN_AND },
+		{ .text = "||", .token = TOKEN_OR },
+		{ .text = "<", .token = TOKEN_CMP, .cmp = WEV_PREDICATE_LT },
+		{ .text = ">", .token = TOKEN_CMP, .cmp = WEV_PREDICATE_GT },
+		{ .text = "!", .token = TOKEN_NOT },
+		{ .text = "(", .token = TOKEN_OPEN },
+		{ .text = ")", .token = TOKEN_CLOSE },
+	};
+	for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); ++i) {
+		size_t len = strlen(operators[i].text);
+		if (strncmp(p, operators[i].text, len) == 0) {
+			parser->token = operators[i].token;
+			parser->cmp = operators[i].cmp;
+			parser->len = len;
+			parser->p = p + len;
+			return;
+		}
+	}
+
+	if (*p == '\0') {
+		parser->token = TOKEN_END;
+		parser->len = 0;
+	} else if (*p == '"') {
+		// Up to the closing quote, skipping escaped ones
+		const char *end = p + 1;
+		while (*end && *end != '"') {
+			end += end[0] == '\\' && end[1] ? 2 : 1;
+		}
+		if (*end != '"') {
+			parser->token = TOKEN_INVALID;
+			parser->error->message = "Unterminated string";
+			return;
+		}
+		parser->token = TOKEN_STRING;
+		parser->len = end + 1 - p;
+	} else {
+		size_t len = strcspn(p, " \t\n" PREDICATE_SPECIAL);
+		parser->token = len > 0 ? TOKEN_WORD : TOKEN_INVALID;
+		parser->len = len;
+	}
+	parser->p = p + parser->len;
+}
+
+static bool parse_error(struct parser *parser, const char *message) {
+	if (!parser->error->message) {
+		parser->error->message = message;
+	}
+	parser->error->offset = parser->start - parser->expr;
+	return false;
+}
+
+static struct wev_predicate *node_new(struct parser *parser,
+		enum wev_predicate_type type) {
+	if (parser->nodes++ == PREDICATE_MAX_NODES) {
+		parse_error(parser, "Expression is too long");
+		return NULL;
+	}
+	struct wev_predicate *node = calloc(1, sizeof(*node));
+	if (!node) {
+		parse_error(parser, "Out of memory");
+		return NULL;
+	}
+	node->type = type;
+	return node;
+}
+
+/* The text of the current token, without the quotes of a string */
+static char *token_text(struct parser *parser) {
+	if (parser->token != TOKEN_STRING) {
+		return strndup(parser->start, parser->len);
+	}
+	char *text = malloc(parser->len);
+	if (!text) {
+		return NULL;
+	}
+	char *out = text;
+	for (const char *p = parser->start + 1;
+			p < parser->start + parser->len - 1; ++p) {
+		if (*p == '\\') {
+			++p;
+		}
+		*out++ = *p;
+	}
+	*out = '\0';
+	return text;
+}
+
+static struct wev_predicate *parse_or(struct parser *parser);
+
+static struct wev_predicate *parse_comparison(struct parser *parser) {
+	if (parser->token != TOKEN_WORD) {
+		parse_error(parser, "Expected a field name");
+		return NULL;
+	}
+	struct wev_predicate *node = node_new(parser, WEV_PREDICATE_CMP);
+	if (!node) {
+		return NULL;
+	}
+	node->field = token_text(parser);
+	next_token(parser);
+	if (parser->token != TOKEN_CMP) {
+		parse_error(parser, "Expected a comparison");
+		goto error;
+	}
+	node->cmp = parser->cmp;
+	next_token(parser);
+	if (parser->token != TOKEN_WORD && parser->token != TOKEN_STRING) {
+		parse_error(parser, "Expected a value");
+		goto error;
+	}
+	node->quoted = parser->token == TOKEN_STRING;
+	node->value = token_text(parser);
+	if (!node->field || !node->value) {
+		parse_error(parser, "Out of memory");
+		goto error;
+	}
+	next_token(parser);
+	return node;
+
+error:
+	predicate_destroy(node);
+	return NULL;
+}
+
+static struct wev_predicate *parse_unary(struct parser *parser) {
+	if (parser->token == TOKEN_NOT) {
+		struct wev_predicate *node = node_new(parser, WEV_PREDICATE_NOT);
+		if (!node) {
+			return NULL;
+		}
+		next_token(parser);
+		if (!(node->left = parse_unary(parser))) {
+			predicate_destroy(node);
+			return NULL;
+		}
+		return node;
+	}
+	if (parser->token != TOKEN_OPEN) {
+		return parse_comparison(parser);
+	}
+
+	if (++parser->depth > PREDICATE_MAX_NODES) {
+		parse_error(parser, "Expression is too long");
+		return NULL;
+	}
+	next_token(parser);
+	struct wev_predicate *node = parse_or(parser);
+	if (!node) {
+		return NULL;
+	}
+	if (parser->token != TOKEN_CLOSE) {
+		parse_error(parser, "Expected )");
+		predicate_destroy(node);
+		return NULL;
+	}
+	--parser->depth;
+	next_token(parser);
+	return node;
+}
+
+/* Parses operands joined by type, which is AND or OR */
+static struct wev_predicate *parse_binary(struct parser *parser,
+		enum wev_predicate_type type) {
+	struct wev_predicate *left = type == WEV_PREDICATE_AND ?
+		parse_unary(parser) : parse_binary(parser, WEV_PREDICATE_AND);
+	enum token token = type == WEV_PREDICATE_AND ? TOKEN_AND : TOKEN_OR;
+	while (left && parser->token == token) {
+		struct wev_predicate *node = node_new(parser, type);
+		if (!node) {
+			predicate_destroy(left);
+			return NULL;
+		}
+		next_token(parser);
+		node->left = left;
+		node->right = type == WEV_PREDICATE_AND ?
+			parse_unary(parser) : parse_binary(parser, WEV_PREDICATE_AND);
+		if (!node->right) {
+			predicate_destroy(node);
+			return NULL;
+		}
+		left = node;
+	}
+	return left;
+}
+
+static struct wev_predicate *parse_or(struct parser *parser) {
+	return parse_binary(parser, WEV_PREDICATE_OR);
+}
+
+struct wev_predicate *predicate_parse(const char *expr,
+		struct wev_predicate_error *error) {
+	struct parser parser = { .expr = expr, .p = expr, .error = error };
+	error->message = NULL;
+	error->offset = 0;
+	next_token(&parser);
+	struct wev_predicate *pred = parse_or(&parser);
+	if (pred && parser.token != TOKEN_END) {
+		parse_error(&parser, "Expected && or ||");
+		predicate_destroy(pred);
+		return NULL;
+	}
+	return pred;
+}
+
+static int predicate_size(const struct wev_predicate *pred) {
+	if (!pred) {
+		return 0;
+	}
+	return 1 + predicate_size(pred->left) + predicate_size(pred->right);
+}
+
+struct wev_predicate *predicate_and(struct wev_predicate *left,
+		struct wev_predicate *right) {
+	struct wev_predicate *node = NULL;
+	if (predicate_size(left) + predicate_size(right) < PREDICATE_MAX_NODES) {
+		node = calloc(1, sizeof(*node));
+	}
+	if (!node) {
+		predicate_destroy(left);
+		predicate_destroy(right);
+		return NULL;
+	}
+	node->type = WEV_PREDICATE_AND;
+	node->left = left;
+	node->right = right;
+	return node;
+}
+
+void predicate_destroy(struct wev_predicate *pred) {
+	if (!pred) {
+		return;
+	}
+	predicate_destroy(pred->left);
+	predicate_destroy(pred->right);
+	free(pred->field);
+	free(pred->value);
+	free(pred);
+}
+
+const struct wev_predicate *predicate_unresolved(
+		const struct wev_predicate *pred) {
+	if (pred->type == WEV_PREDICATE_CMP) {
+		return pred->resolved ? NULL : pred;
+	}
+	const struct wev_predicate *unresolved = predicate_unresolved(pred->left);
+	if (!unresolved && pred->right) {
+		unresolved = predicate_unresolved(pred->right);
+	}
+	return unresolved;
+}
+
+struct compiler {
+	const char *fields;
+	size_t len;
+	struct wev_predicate_insn insns[PREDICATE_MAX_NODES];
+};
+
+/* Makes the instruction comparing a field with a value, if it can */
+static bool compile_comparison(struct wev_predicate *node,
+		const char *fields, struct wev_predicate_insn *insn) {
+	struct wev_field field;
+	int arg = 0;
+	bool found = false;
+	while (!found && wev_next_field(&fields, &field)) {
+		found = field.len == strlen(node->field) &&
+			strncmp(field.name, node->field, field.len) == 0;
+		if (!found) {
+			arg += wev_field_args(field.type);
+		}
+	}
+	if (!found) {
+		return false;
+	}
+
+	insn->cmp = node->cmp;
+	insn->arg = arg;
+	const char *value = node->value;
+	char *end;
+	errno = 0;
+	switch (field.type) {
+	case 'i':
+	case 'u':
+	case 'o':
+	case 'k':
+		insn->op = field.type == 'i' ? INSN_INT : INSN_UINT;
+		insn->value.i = strtoll(value, &end, 0);
+		break;
+	case 'f':
+		insn->op = INSN_FIXED;
+		insn->value.f = strtod(value, &end);
+		break;
+	case 't':
+		insn->op = INSN_UINT64;
+		insn->value.u = strtoull(value, &end, 0);
+		if (value[strspn(value, " ")] == '-') {
+			return false;
+		}
+		break;
+	case 's':
+		insn->op = INSN_STRING;
+		insn->value.s = value;
+		return node->cmp == WEV_PREDICATE_EQ || node->cmp == WEV_PREDICATE_NE;
+	default:
+		// Arrays have no order
+		return false;
+	}
+	return !node->quoted && end != value && *end == '\0' && errno == 0;
+}
+
+static enum wev_predicate_result compile_node(struct compiler *c,
+		struct wev_predicate *node) {
+	enum wev_predicate_result left, right;
+	switch (node->type) {
+	case WEV_PREDICATE_CMP:
+		if (!compile_comparison(node, c->fields, &c->insns[c->len])) {
+			return WEV_PREDICATE_FALSE;
+		}
+		node->resolved = true;
+		++c->len;
+		return WEV_PREDICATE_PROGRAM;
+	case WEV_PREDICATE_NOT:
+		left = compile_node(c, node->left);
+		if (left != WEV_PREDICATE_PROGRAM) {
+			return left == WEV_PREDICATE_TRUE ?
+				WEV_PREDICATE_FALSE : WEV_PREDICATE_TRUE;
+		}
+		c->insns[c->len++].op = INSN_NOT;
+		return WEV_PREDICATE_PROGRAM;
+	case WEV_PREDICATE_AND:
+	case WEV_PREDICATE_OR:;
+		// Both sides are compiled, so every comparison gets resolved
+		size_t start = c->len;
+		left = compile_node(c, node->left);
+		right = compile_node(c, node->right);
+		enum wev_predicate_result absorbing = node->type == WEV_PREDICATE_AND ?
+			WEV_PREDICATE_FALSE : WEV_PREDICATE_TRUE;
+		if (left == absorbing || right == absorbing) {
+			c->len = start;
+			return absorbing;
+		}
+		if (left != WEV_PREDICATE_PROGRAM) {
+			// Constants leave no code, so this is right's
+			return right;
+		}
+		if (right != WEV_PREDICATE_PROGRAM) {
+			return left;
+		}
+		c->insns[c->len++].op =
+			node->type == WEV_PREDICATE_AND ? INSN_AND : INSN_OR;
+		return WEV_PREDICATE_PROGRAM;
+	}
+	abort();
+}
+
+int predicate_compile(struct wev_predicate *pred, const char *fields,
+		enum wev_predicate_result *result,
+		struct wev_predicate_program **program) {
+	struct compiler c = { .fields = fields };
+	*program = NULL;
+	*result = compile_node(&c, pred);
+	if (*result != WEV_PREDICATE_PROGRAM) {
+		return 0;
+	}
+	size_t size = c.len * sizeof(c.insns[0]);
+	*program = malloc(sizeof(**program) + size);
+	if (!*program) {
+		return -1;
+	}
+	(*program)->len = c.len;
+	memcpy((*program)->insns, c.insns, size);
+	return 0;
+}
+
+/* order is negative, 0 or positive as the field is below, at or above */
+static bool compare(uint8_t cmp, int order) {
+	switch (cmp) {
+	case WEV_PREDICATE_EQ:
+		return order == 0;
+	case WEV_PREDICATE_NE:
+		return order != 0;
+	case WEV_PREDICATE_LT:
+		return order < 0;
+	case WEV_PREDICATE_LE:
+		return order <= 0;
+	case WEV_PREDICATE_GT:
+		return order > 0;
+	default:
+		return order >= 0;
+	}
+}
+
+#define ORDER(a, b) (((a) > (b)) - ((a) < (b)))
+
+bool predicate_run(const struct wev_predicate_program *program,
+		const struct wev_event *ev) {
+	// Bit 0 is the top of the stack, which is never deeper than the program
+	uint64_t stack = 0;
+	for (size_t i = 0; i < program->len; ++i) {
+		const struct wev_predicate_insn *insn = &program->insns[i];
+		union wev_arg arg = ev->args[insn->arg];
+		bool value;
+		switch (insn->op) {
+		case INSN_INT:
+			value = compare(insn->cmp, ORDER((int64_t)arg.i, insn->value.i));
+			break;
+		case INSN_UINT:
+			value = compare(insn->cmp, ORDER((int64_t)arg.u, insn->value.i));
+			break;
+		case INSN_FIXED:
+			value = compare(insn->cmp, ORDER(arg.i / 256.0, insn->value.f));
+			break;
+		case INSN_UINT64:;
+			uint64_t u = (uint64_t)arg.u << 32 | ev->args[insn->arg + 1].u;
+			value = compare(insn->cmp, ORDER(u, insn->value.u));
+			break;
+		case INSN_STRING:;
+			uint32_t size;
+			const char *s = wev_event_array(ev, insn->arg, &size);
+			// NULL strings are recorded without a terminator
+			bool equal = size > 0 && strcmp(s, insn->value.s) == 0;
+			value = equal == (insn->cmp == WEV_PREDICATE_EQ);
+			break;
+		case INSN_AND:
+			value = stack & stack >> 1 & 1;
+			stack >>= 2;
+			break;
+		case INSN_OR:
+			value = (stack | stack >> 1) & 1;
+			stack >>= 2;
+			break;
+		default:
+			value = !(stack & 1);
+			stack >>= 1;
+			break;
+		}
+		stack = stack << 1 | value;
+	}
+	return stack & 1;
+}
@@ -0,0 +1,98 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "event.h"
+
+/* Comparisons and operators an expression may have in total */
+#define PREDICATE_MAX_NODES 64
+
+enum wev_predicate_type {
+	WEV_PREDICATE_AND,
+	WEV_PREDICATE_OR,
+	WEV_PREDICATE_NOT,
+	WEV_PREDICATE_CMP,
+};
+
+enum wev_predicate_cmp {
+	WEV_PREDICATE_EQ,
+	WEV_PREDICATE_NE,
+	WEV_PREDICATE_LT,
+	WEV_PREDICATE_LE,
+	WEV_PREDICATE_GT,
+	WEV_PREDICATE_GE,
+};
+
+/*
+ * A --where expression, such as "key == 30 && state == 1", parsed into a
+ * tree. It is compiled for each event, with the names and types of the
+ * event's arguments, into a program which predicate_run can test a recorded
+ * event with.
+ */
+struct wev_predicate {
+	enum wev_predicate_type type;
+	struct wev_predicate *left, *right; /* right is NULL for NOT */
+	/* For comparisons of a field with a value */
+	enum wev_predicate_cmp cmp;
+	char *field;
+	char *value;
+	bool quoted; /* The value was a string literal */
+	bool resolved; /* Some event has the field, and it takes the value */
+};
+
+/* Where and why an expression failed to parse */
+struct wev_predicate_error {
+	const char *message;
+	size_t offset;
+};
+
+struct wev_predicate *predicate_parse(const char *expr,
+		struct wev_predicate_error *error);
+/*
+ * Both are owned by the result, which is NULL if it would be too long or
+ * cannot be allocated.
+ */
+struct wev_predicate *predicate_and(struct wev_predicate *left,
+		struct wev_predicate *right);
+void predicate_destroy(struct wev_predicate *pred);
+/* The first comparison no event could be compiled with, or NULL */
+const struct wev_predicate *predicate_unresolved(
+		const struct wev_predicate *pred);
+
+struct wev_predicate_insn {
+	uint8_t op;
+	uint8_t cmp;
+	uint8_t arg;
+	union {
+		int64_t i;
+		uint64_t u;
+		double f;
+		const char *s; /* Owned by the predicate */
+	} value;
+};
+
+/* Runs as a stack machine of booleans, in postfix order */
+struct wev_predicate_program {
+	size_t len;
+	struct wev_predicate_insn insns[];
+};
+
+enum wev_predicate_result {
+	WEV_PREDICATE_FALSE,
+	WEV_PREDICATE_TRUE,
+	WEV_PREDICATE_PROGRAM,
+};
+
+/*
+ * Compiles pred for events with the given fields, see wev_field. Comparisons
+ * of fields the event does not have are false, and if that decides the
+ * result, no program is made. Returns -1 if it cannot be allocated.
+ */
+int predicate_compile(struct wev_predicate *pred, const char *fields,
+		enum wev_predicate_result *result,
+		struct wev_predicate_program **program);
+bool predicate_run(const struct wev_predicate_program *program,
+		const struct wev_event *ev);
+
+#endif
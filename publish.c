@@ -0,0 +1,383 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "publish.h"
+#include "shm.h"
+
+#define PUBLISH_SIZE \
+	(PUBLISH_HEADER_SIZE + (size_t)PUBLISH_RECORDS * PUBLISH_RECORD_SIZE)
+
+static int socket_address(struct sockaddr_un *addr, const char *path) {
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+/* Removes the socket of a wev which died without removing it itself */
+static void remove_stale_socket(const struct sockaddr_un *addr) {
+	struct stat st;
+	if (lstat(addr->sun_path, &st) < 0 || !S_ISSOCK(st.st_mode)) {
+		return;
+	}
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		return;
+	}
+	if (connect(sock, (const struct sockaddr *)addr, sizeof(*addr)) < 0 &&
+			errno == ECONNREFUSED) {
+		unlink(addr->sun_path);
+	}
+	close(sock);
+}
+
+int publish_create(struct wev_publish *pub, const char *path,
+		const struct wev_interface_table *interfaces) {
+	*pub = (struct wev_publish){ .fd = -1, .reader_fd = -1, .listen_fd = -1 };
+	struct sockaddr_un addr;
+	if (socket_address(&addr, path) < 0) {
+		return -1;
+	}
+	remove_stale_socket(&addr);
+	pub->fd = allocate_shm_file(PUBLISH_SIZE);
+	if (pub->fd < 0) {
+		goto error;
+	}
+	char *map = mmap(NULL, PUBLISH_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED, pub->fd, 0);
+	if (map == MAP_FAILED) {
+		goto error;
+	}
+	pub->header = (struct wev_publish_header *)map;
+	pub->records = (struct wev_publish_record *)(map + PUBLISH_HEADER_SIZE);
+	memcpy(pub->header->magic, PUBLISH_MAGIC, sizeof(pub->header->magic));
+	pub->header->version = PUBLISH_VERSION;
+	pub->header->record_size = PUBLISH_RECORD_SIZE;
+	pub->header->record_count = PUBLISH_RECORDS;
+	atomic_init(&pub->header->closed, 0);
+	pub->header->interfaces = *interfaces;
+	atomic_init(&pub->header->head, 0);
+
+	// Readers get a read-only fd of the same file, where there is /proc
+	char proc[64];
+	snprintf(proc, sizeof(proc), "/proc/self/fd/%d", pub->fd);
+	pub->reader_fd = open(proc, O_RDONLY | O_CLOEXEC);
+
+	pub->listen_fd = socket(AF_UNIX,
+			SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (pub->listen_fd < 0 ||
+			bind(pub->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		goto error;
+	}
+	pub->path = strdup(path);
+	if (!pub->path || listen(pub->listen_fd, 16) < 0) {
+		goto error;
+	}
+	return 0;
+
+error:;
+	int err = errno;
+	publish_close(pub);
+	errno = err;
+	return -1;
+}
+
+void publish_append(struct wev_publish *pub, const struct wev_event *ev) {
+	const size_t data_size = sizeof(pub->records->data);
+	const char *data = (const char *)ev;
+	size_t size = ev->size;
+	struct wev_event header;
+	if (size > PUBLISH_MAX_RECORDS * data_size) {
+		header = *ev;
+		header.size = sizeof(header);
+		header.flags |= WEV_EVENT_TRUNCATED;
+		data = (const char *)&header;
+		size = sizeof(header);
+		++pub->truncated;
+	}
+
+	for (size_t offset = 0; offset < size; offset += data_size) {
+		uint64_t n = pub->head++;
+		struct wev_publish_record *record =
+			&pub->records[n & (PUBLISH_RECORDS - 1)];
+		size_t len = size - offset < data_size ? size - offset : data_size;
+		atomic_store_explicit(&record->seq, 2 * n + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		record->event = offset == 0 ? pub->events : PUBLISH_CONTINUED;
+		memcpy(record->data, data + offset, len);
+		atomic_store_explicit(&record->seq, 2 * n + 2, memory_order_release);
+	}
+	++pub->events;
+	atomic_store_explicit(&pub->header->head, pub->head, memory_order_release);
+}
+
+void publish_accept(struct wev_publish *pub) {
+	// Readers never write, so their connections are only ready once closed
+	for (size_t i = 0; i < pub->readers_len; ) {
+		struct pollfd pfd = { .fd = pub->readers[i], .events = POLLIN };
+		if (poll(&pfd, 1, 0) > 0) {
+			close(pub->readers[i]);
+			pub->readers[i] = pub->readers[--pub->readers_len];
+		} else {
+			++i;
+		}
+	}
+
+	int fd = pub->reader_fd >= 0 ? pub->reader_fd : pub->fd;
+	int conn;
+	while ((conn = accept(pub->listen_fd, NULL, NULL)) >= 0) {
+		char byte = 0;
+		struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+		union {
+			char buf[CMSG_SPACE(sizeof(int))];
+			struct cmsghdr align;
+		} control;
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control.buf,
+			.msg_controllen = sizeof(control.buf),
+		};
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+		// A reader which is gone or not reading just goes without
+		if (sendmsg(conn, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+			close(conn);
+			continue;
+		}
+		if (pub->readers_len == pub->readers_cap) {
+			size_t cap = pub->readers_cap ? pub->readers_cap * 2 : 8;
+			int *readers = realloc(pub->readers, cap * sizeof(*readers));
+			if (!readers) {
+				close(conn);
+				continue;
+			}
+			pub->readers = readers;
+			pub->readers_cap = cap;
+		}
+		pub->readers[pub->readers_len++] = conn;
+	}
+}
+
+void publish_close(struct wev_publish *pub) {
+	if (pub->header) {
+		atomic_store_explicit(&pub->header->closed, 1, memory_order_release);
+		munmap(pub->header, PUBLISH_SIZE);
+	}
+	for (size_t i = 0; i < pub->readers_len; ++i) {
+		close(pub->readers[i]);
+	}
+	free(pub->readers);
+	if (pub->path) {
+		unlink(pub->path);
+		free(pub->path);
+	}
+	if (pub->listen_fd >= 0) {
+		close(pub->listen_fd);
+	}
+	if (pub->reader_fd >= 0) {
+		close(pub->reader_fd);
+	}
+	if (pub->fd >= 0) {
+		close(pub->fd);
+	}
+	*pub = (struct wev_publish){ .fd = -1, .reader_fd = -1, .listen_fd = -1 };
+}
+
+static int receive_fd(int sock) {
+	char byte;
+	struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf),
+	};
+	ssize_t n;
+	do {
+		n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	} while (n < 0 && errno == EINTR);
+	struct cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+			cmsg->cmsg_type != SCM_RIGHTS) {
+		errno = n < 0 ? errno : EPROTO;
+		return -1;
+	}
+	int fd;
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+	return fd;
+}
+
+int subscription_open(struct wev_subscription *sub, const char *path) {
+	*sub = (struct wev_subscription){ .sock = -1 };
+	struct sockaddr_un addr;
+	if (socket_address(&addr, path) < 0) {
+		return -1;
+	}
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		return -1;
+	}
+	int fd = -1;
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			(fd = receive_fd(sock)) < 0) {
+		int err = errno;
+		close(sock);
+		errno = err;
+		return -1;
+	}
+	sub->sock = sock;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < PUBLISH_HEADER_SIZE) {
+		goto invalid;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		int err = errno;
+		subscription_close(sub);
+		errno = err;
+		return -1;
+	}
+	sub->header = map;
+	sub->size = st.st_size;
+	const struct wev_publish_header *header = sub->header;
+	uint32_t count = header->record_count;
+	if (memcmp(header->magic, PUBLISH_MAGIC, sizeof(header->magic)) != 0 ||
+			header->version != PUBLISH_VERSION ||
+			header->record_size != PUBLISH_RECORD_SIZE ||
+			count == 0 || (count & (count - 1)) != 0 ||
+			!wev_interface_table_valid(&header->interfaces) ||
+			sub->size < PUBLISH_HEADER_SIZE +
+				(size_t)count * PUBLISH_RECORD_SIZE) {
+		subscription_close(sub);
+		errno = EINVAL;
+		return -1;
+	}
+	sub->records = (const struct wev_publish_record *)
+		((const char *)map + PUBLISH_HEADER_SIZE);
+	sub->ev_size = sizeof(sub->records->data);
+	sub->ev = malloc(sub->ev_size);
+	if (!sub->ev) {
+		subscription_close(sub);
+		return -1;
+	}
+	// Only events published from now on
+	sub->next = atomic_load_explicit(&sub->header->head, memory_order_acquire);
+	return 0;
+
+invalid:
+	close(fd);
+	subscription_close(sub);
+	errno = EINVAL;
+	return -1;
+}
+
+/* Copies from record n, unless it was overwritten before or while it was */
+static bool read_record(const struct wev_subscription *sub, uint64_t n,
+		void *data, size_t len, uint64_t *event) {
+	const struct wev_publish_record *record =
+		&sub->records[n & (sub->header->record_count - 1)];
+	uint64_t seq = 2 * n + 2;
+	if (atomic_load_explicit(&record->seq, memory_order_acquire) != seq) {
+		return false;
+	}
+	*event = record->event;
+	memcpy(data, record->data, len);
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&record->seq, memory_order_relaxed) == seq;
+}
+
+const struct wev_event *subscription_next(struct wev_subscription *sub,
+		uint64_t *missed) {
+	const size_t data_size = sizeof(sub->records->data);
+	uint32_t count = sub->header->record_count;
+	while (true) {
+		uint64_t head = atomic_load_explicit(&sub->header->head,
+				memory_order_acquire);
+		if (sub->next == head) {
+			return NULL;
+		}
+		if (head - sub->next > count) {
+			sub->next = head - count;
+		}
+
+		// The rest of an event which was overwritten is skipped
+		uint64_t event, cont;
+		if (!read_record(sub, sub->next++, sub->ev, data_size, &event) ||
+				event == PUBLISH_CONTINUED) {
+			continue;
+		}
+		size_t size = sub->ev->size;
+		if (size < sizeof(*sub->ev) || size > PUBLISH_MAX_RECORDS * data_size) {
+			continue;
+		}
+		if (size > sub->ev_size) {
+			struct wev_event *ev = realloc(sub->ev, size);
+			if (!ev) {
+				continue;
+			}
+			sub->ev = ev;
+			sub->ev_size = size;
+		}
+		bool complete = true;
+		for (size_t offset = data_size; complete && offset < size;
+				offset += data_size) {
+			size_t len = size - offset < data_size ? size - offset : data_size;
+			complete = read_record(sub, sub->next++,
+					(char *)sub->ev + offset, len, &cont) &&
+				cont == PUBLISH_CONTINUED;
+		}
+		if (!complete) {
+			continue;
+		}
+
+		if (sub->started) {
+			*missed += event - sub->event;
+		}
+		sub->started = true;
+		sub->event = event + 1;
+		return sub->ev;
+	}
+}
+
+bool subscription_closed(struct wev_subscription *sub) {
+	if (atomic_load_explicit(&sub->header->closed, memory_order_acquire)) {
+		return true;
+	}
+	// The publisher never writes, so this is only ready once it hung up
+	struct pollfd pfd = { .fd = sub->sock, .events = POLLIN };
+	return poll(&pfd, 1, 0) > 0;
+}
+
+void subscription_close(struct wev_subscription *sub) {
+	if (sub->header) {
+		munmap((void *)sub->header, sub->size);
+	}
+	if (sub->sock >= 0) {
+		close(sub->sock);
+	}
+	free(sub->ev);
+	*sub = (struct wev_subscription){ .sock = -1 };
+}
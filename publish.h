@@ -0,0 +1,97 @@
+#ifndef PUBLISH_H
+#define PUBLISH_H
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "event.h"
+
+#define PUBLISH_MAGIC "WEVRING"
+#define PUBLISH_VERSION 2
+#define PUBLISH_RECORD_SIZE 256
+#define PUBLISH_RECORDS 32768 /* Must be a power of two */
+/* Larger events, in practice only keymaps, are published without their data */
+#define PUBLISH_MAX_RECORDS (PUBLISH_RECORDS / 16)
+/* The event of a record which continues the previous one */
+#define PUBLISH_CONTINUED UINT64_MAX
+
+/*
+ * Record n is at n % record_count. Its sequence number is 2n + 1 while it is
+ * being written, and 2n + 2 once it is complete, so readers can tell when
+ * the record they read was overwritten. Events which do not fit in one record
+ * go on in the next ones.
+ */
+struct wev_publish_record {
+	_Atomic uint64_t seq;
+	uint64_t event; /* The number of the event it starts */
+	char data[PUBLISH_RECORD_SIZE - 2 * sizeof(uint64_t)];
+};
+
+/* The start of the shared memory of wev --publish, followed by the records */
+struct wev_publish_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t record_count;
+	_Atomic uint32_t closed; /* Set once wev stops publishing */
+	struct wev_interface_table interfaces;
+	alignas(64) _Atomic uint64_t head; /* Records published so far */
+};
+
+#define PUBLISH_HEADER_SIZE \
+	((sizeof(struct wev_publish_header) + 63) & ~(size_t)63)
+
+/*
+ * A ring of fixed-size records in shared memory, with a single writer which
+ * never waits for its readers. The memory is handed to each process which
+ * connects to a Unix socket, which maps it and keeps its own position. Their
+ * connections are kept open, so that they hang up if wev dies.
+ */
+struct wev_publish {
+	int fd;
+	int reader_fd; /* Read-only, for the readers */
+	int listen_fd;
+	int *readers;
+	size_t readers_len, readers_cap;
+	char *path;
+	struct wev_publish_header *header;
+	struct wev_publish_record *records;
+	uint64_t head;
+	uint64_t events;
+	uint64_t truncated;
+};
+
+int publish_create(struct wev_publish *pub, const char *path,
+		const struct wev_interface_table *interfaces);
+void publish_append(struct wev_publish *pub, const struct wev_event *ev);
+/* Hands the memory to the processes waiting on the socket */
+void publish_accept(struct wev_publish *pub);
+void publish_close(struct wev_publish *pub);
+
+/* A reader of the ring of another wev process */
+struct wev_subscription {
+	int sock; /* Hung up once the publisher is gone */
+	const struct wev_publish_header *header;
+	const struct wev_publish_record *records;
+	size_t size;
+	uint64_t next;
+	uint64_t event; /* The number of the next event, once one was read */
+	bool started;
+	struct wev_event *ev;
+	size_t ev_size;
+};
+
+int subscription_open(struct wev_subscription *sub, const char *path);
+/*
+ * Returns a copy of the next event, valid until the next call, or NULL if
+ * there is none yet. Events which were overwritten before they could be read
+ * are added to missed.
+ */
+const struct wev_event *subscription_next(struct wev_subscription *sub,
+		uint64_t *missed);
+/* Whether the publisher has exited, or died */
+bool subscription_closed(struct wev_subscription *sub);
+void subscription_close(struct wev_subscription *sub);
+
+#endif
@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+/*
+ * Each record is preceded by its size, rounded up to 8 bytes. A size of zero
+ * means the rest of the buffer is unused, and the next record is at the start.
+ */
+typedef uint64_t ring_header;
+
+int ring_init(struct wev_ring *ring, size_t cap) {
+	memset(ring, 0, sizeof(*ring));
+	cap = (cap + 7) & ~(size_t)7;
+	ring->buf = malloc(cap);
+	if (!ring->buf) {
+		return -1;
+	}
+	ring->cap = cap;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	return 0;
+}
+
+void ring_finish(struct wev_ring *ring) {
+	free(ring->buf);
+	ring->buf = NULL;
+}
+
+bool ring_push(struct wev_ring *ring, const struct wev_event *ev) {
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	size_t offset = head % ring->cap;
+	size_t need = sizeof(ring_header) + ev->size;
+	size_t skip = 0;
+	if (ring->cap - offset < need) {
+		skip = ring->cap - offset;
+	}
+	if (head - tail + skip + need > ring->cap) {
+		++ring->dropped;
+		return false;
+	}
+
+	if (skip) {
+		*(ring_header *)(ring->buf + offset) = 0;
+		offset = 0;
+	}
+	*(ring_header *)(ring->buf + offset) = ev->size;
+	memcpy(ring->buf + offset + sizeof(ring_header), ev, ev->size);
+
+	head += skip + need;
+	if (head - tail > ring->high_water) {
+		ring->high_water = head - tail;
+	}
+	++ring->pushed;
+	atomic_store_explicit(&ring->head, head, memory_order_release);
+	return true;
+}
+
+const struct wev_event *ring_peek(struct wev_ring *ring) {
+	uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (tail == head) {
+		return NULL;
+	}
+	size_t offset = tail % ring->cap;
+	if (*(ring_header *)(ring->buf + offset) == 0) {
+		// Skipped by the producer; it already wrote the next record
+		tail += ring->cap - offset;
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+		offset = 0;
+	}
+	return (const struct wev_event *)(ring->buf + offset + sizeof(ring_header));
+}
+
+void ring_pop(struct wev_ring *ring) {
+	uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t offset = tail % ring->cap;
+	ring_header size = *(ring_header *)(ring->buf + offset);
+	atomic_store_explicit(&ring->tail,
+			tail + sizeof(ring_header) + size, memory_order_release);
+}
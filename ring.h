@@ -0,0 +1,37 @@
+#ifndef RING_H
+#define RING_H
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "event.h"
+
+/*
+ * A lock-free ring of struct wev_event records, with one thread pushing and
+ * another one popping. Records are stored whole, never split at the end of
+ * the buffer. A full ring drops new records rather than waiting.
+ */
+struct wev_ring {
+	char *buf;
+	size_t cap;
+
+	/* Byte positions, only ever increasing; the offset is pos % cap */
+	alignas(64) _Atomic uint64_t head; /* Written by the producer */
+	alignas(64) _Atomic uint64_t tail; /* Written by the consumer */
+
+	/* Producer statistics */
+	alignas(64) size_t high_water;
+	uint64_t pushed;
+	uint64_t dropped;
+};
+
+int ring_init(struct wev_ring *ring, size_t cap);
+void ring_finish(struct wev_ring *ring);
+
+bool ring_push(struct wev_ring *ring, const struct wev_event *ev);
+/* Returns the oldest record, valid until ring_pop, or NULL if empty */
+const struct wev_event *ring_peek(struct wev_ring *ring);
+void ring_pop(struct wev_ring *ring);
+
+#endif
@@ -5,6 +5,7 @@
 #include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
+#include "shm.h"
 
 static void randname(char *buf) {
 	struct timespec ts;
@@ -51,3 +52,132 @@ int allocate_shm_file(size_t size) {
 
 	return fd;
 }
+
+static void shm_buffer_release(void *data, struct wl_buffer *wl_buffer) {
+	struct wev_shm_buffer *buffer = data;
+	buffer->busy = false;
+	if (buffer->stale) {
+		wl_buffer_destroy(buffer->buffer);
+		buffer->buffer = NULL;
+		buffer->stale = false;
+	}
+}
+
+static const struct wl_buffer_listener shm_buffer_listener = {
+	.release = shm_buffer_release,
+};
+
+void shm_pool_init(struct wev_shm_pool *pool, struct wl_shm *shm) {
+	memset(pool, 0, sizeof(*pool));
+	pool->shm = shm;
+	pool->fd = -1;
+	for (int i = 0; i < SHM_POOL_BUFFERS; ++i) {
+		pool->buffers[i].pool = pool;
+	}
+}
+
+static bool shm_pool_grow(struct wev_shm_pool *pool, size_t size) {
+	if (size <= pool->size) {
+		return true;
+	}
+	if (pool->fd < 0) {
+		pool->fd = allocate_shm_file(size);
+		if (pool->fd < 0) {
+			return false;
+		}
+	} else {
+		int ret;
+		do {
+			ret = ftruncate(pool->fd, size);
+		} while (ret < 0 && errno == EINTR);
+		if (ret < 0) {
+			return false;
+		}
+	}
+
+	char *data = mmap(NULL, size,
+			PROT_READ | PROT_WRITE, MAP_SHARED, pool->fd, 0);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	if (pool->data) {
+		munmap(pool->data, pool->size);
+	}
+	for (int i = 0; i < SHM_POOL_BUFFERS; ++i) {
+		if (pool->buffers[i].data) {
+			pool->buffers[i].data = (uint32_t *)(data +
+					((char *)pool->buffers[i].data - pool->data));
+		}
+	}
+	pool->data = data;
+	pool->size = size;
+
+	if (pool->pool) {
+		wl_shm_pool_resize(pool->pool, size);
+	} else {
+		pool->pool = wl_shm_create_pool(pool->shm, pool->fd, size);
+	}
+	return true;
+}
+
+struct wev_shm_buffer *shm_pool_get_buffer(struct wev_shm_pool *pool,
+		int32_t width, int32_t height, bool *fresh) {
+	if (width != pool->width || height != pool->height) {
+		pool->base = 0;
+		for (int i = 0; i < SHM_POOL_BUFFERS; ++i) {
+			struct wev_shm_buffer *b = &pool->buffers[i];
+			if (b->busy) {
+				b->stale = true;
+				size_t end = (size_t)((char *)b->data - pool->data) +
+					(size_t)b->width * 4 * b->height;
+				if (end > pool->base) {
+					pool->base = end;
+				}
+			} else if (b->buffer) {
+				wl_buffer_destroy(b->buffer);
+				b->buffer = NULL;
+			}
+		}
+		pool->width = width;
+		pool->height = height;
+	}
+
+	struct wev_shm_buffer *buffer = NULL;
+	for (int i = 0; i < SHM_POOL_BUFFERS; ++i) {
+		struct wev_shm_buffer *b = &pool->buffers[i];
+		if (b->busy) {
+			continue;
+		}
+		if (b->buffer) {
+			*fresh = false;
+			b->busy = true;
+			return b;
+		}
+		if (!buffer) {
+			buffer = b;
+		}
+	}
+	if (!buffer) {
+		return NULL;
+	}
+
+	/*
+	 * Each buffer gets a slot sized for the current dimensions, after any
+	 * stale buffers the compositor still held when they changed.
+	 */
+	size_t stride = (size_t)width * 4;
+	size_t slot = stride * height;
+	if (!shm_pool_grow(pool, pool->base + slot * SHM_POOL_BUFFERS)) {
+		return NULL;
+	}
+	size_t offset = pool->base + slot * (buffer - pool->buffers);
+	buffer->buffer = wl_shm_pool_create_buffer(pool->pool, offset,
+			width, height, stride, WL_SHM_FORMAT_XRGB8888);
+	wl_buffer_add_listener(buffer->buffer, &shm_buffer_listener, buffer);
+	buffer->data = (uint32_t *)(pool->data + offset);
+	buffer->width = width;
+	buffer->height = height;
+	buffer->busy = true;
+	*fresh = true;
+	return buffer;
+}
@@ -1,7 +1,49 @@
 #ifndef SHM_H
 #define SHM_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-client-core.h>
+#include <wayland-client-protocol.h>
+
+#define SHM_POOL_BUFFERS 3
 
 int create_shm_file(void);
 int allocate_shm_file(size_t size);
 
+struct wev_shm_pool;
+
+struct wev_shm_buffer {
+	struct wev_shm_pool *pool;
+	struct wl_buffer *buffer;
+	uint32_t *data;
+	int32_t width, height;
+	bool busy; /* Attached, and not yet released by the compositor */
+	bool stale; /* Of an old size, destroyed once released */
+};
+
+/*
+ * One shm file, mapped once and only ever grown, holding a few XRGB8888
+ * buffers which are reused once the compositor releases them.
+ */
+struct wev_shm_pool {
+	struct wl_shm *shm;
+	struct wl_shm_pool *pool;
+	int fd;
+	char *data;
+	size_t size;
+	int32_t width, height; /* Of the buffers being handed out */
+	size_t base; /* Where those start, past stale buffers still in use */
+	struct wev_shm_buffer buffers[SHM_POOL_BUFFERS];
+};
+
+void shm_pool_init(struct wev_shm_pool *pool, struct wl_shm *shm);
+/*
+ * Returns a buffer of the given size which is not in use by the compositor.
+ * fresh is set if its contents are undefined, rather than what was last
+ * drawn into a buffer of that size.
+ */
+struct wev_shm_buffer *shm_pool_get_buffer(struct wev_shm_pool *pool,
+		int32_t width, int32_t height, bool *fresh);
+
 #endif
@@ -0,0 +1,166 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define TRACE_MAGIC "WEVTRACE"
+#define TRACE_VERSION 3
+#define TRACE_BYTE_ORDER 0x01020304
+#define TRACE_CHUNK (4 << 20)
+
+struct trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	struct wev_interface_table interfaces;
+};
+
+/*
+ * Keeps the old mapping if this fails. The new space is allocated rather than
+ * left sparse, so a full disk fails here instead of raising SIGBUS on write.
+ */
+static bool trace_grow(struct wev_trace *trace, size_t need) {
+	size_t cap = trace->cap;
+	while (cap < need) {
+		cap += TRACE_CHUNK;
+	}
+	int ret;
+	do {
+		ret = posix_fallocate(trace->fd, trace->cap, cap - trace->cap);
+	} while (ret == EINTR);
+	if (ret != 0) {
+		errno = ret;
+		return false;
+	}
+	char *map = mmap(NULL, cap, PROT_READ | PROT_WRITE,
+			MAP_SHARED, trace->fd, 0);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	if (trace->map) {
+		munmap(trace->map, trace->cap);
+	}
+	trace->map = map;
+	trace->cap = cap;
+	return true;
+}
+
+int trace_create(struct wev_trace *trace, const char *path,
+		const struct wev_interface_table *interfaces) {
+	*trace = (struct wev_trace){ 0 };
+	trace->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (trace->fd < 0) {
+		return -1;
+	}
+	if (!trace_grow(trace, TRACE_CHUNK)) {
+		close(trace->fd);
+		trace->fd = -1;
+		return -1;
+	}
+	struct trace_header header = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.byte_order = TRACE_BYTE_ORDER,
+		.interfaces = *interfaces,
+	};
+	memcpy(trace->map, &header, sizeof(header));
+	trace->len = sizeof(header);
+	return 0;
+}
+
+bool trace_append(struct wev_trace *trace, const struct wev_event *ev) {
+	if (!trace->map) {
+		errno = EBADF;
+		return false;
+	}
+	if (trace->len + ev->size > trace->cap &&
+			!trace_grow(trace, trace->len + ev->size)) {
+		return false;
+	}
+	memcpy(trace->map + trace->len, ev, ev->size);
+	trace->len += ev->size;
+	return true;
+}
+
+void trace_close(struct wev_trace *trace) {
+	if (trace->map) {
+		munmap(trace->map, trace->cap);
+	}
+	if (trace->fd >= 0) {
+		// Drop the unused tail of the last chunk
+		if (ftruncate(trace->fd, trace->len) < 0) {
+			fprintf(stderr, "Failed to truncate trace: %s\n",
+					strerror(errno));
+		}
+		close(trace->fd);
+	}
+	*trace = (struct wev_trace){ .fd = -1 };
+}
+
+int trace_open(struct wev_trace *trace, const char *path) {
+	*trace = (struct wev_trace){ 0 };
+	trace->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (trace->fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if (fstat(trace->fd, &st) < 0 ||
+			(size_t)st.st_size < sizeof(struct trace_header)) {
+		goto invalid;
+	}
+	trace->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, trace->fd, 0);
+	if (trace->map == MAP_FAILED) {
+		trace->map = NULL;
+		goto invalid;
+	}
+	trace->cap = st.st_size;
+	const struct trace_header *header = (const void *)trace->map;
+	if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+			header->version != TRACE_VERSION ||
+			header->byte_order != TRACE_BYTE_ORDER ||
+			!wev_interface_table_valid(&header->interfaces)) {
+		goto invalid;
+	}
+	trace->interfaces = &header->interfaces;
+	trace->len = trace->cap;
+	// Read-only traces are never truncated on close
+	close(trace->fd);
+	trace->fd = -1;
+	return 0;
+
+invalid:
+	close(trace->fd);
+	if (trace->map) {
+		munmap(trace->map, trace->cap);
+	}
+	*trace = (struct wev_trace){ .fd = -1 };
+	errno = EINVAL;
+	return -1;
+}
+
+/*
+ * Returns the record at *offset and advances it, or NULL at the end of the
+ * trace. A trace that was not closed cleanly ends in zeroes. The arguments of
+ * records need checking against their event's fields, see wev_event_valid.
+ */
+const struct wev_event *trace_next(struct wev_trace *trace, size_t *offset) {
+	if (*offset == 0) {
+		*offset = sizeof(struct trace_header);
+	}
+	if (*offset + sizeof(struct wev_event) > trace->len) {
+		return NULL;
+	}
+	const struct wev_event *ev = (const void *)(trace->map + *offset);
+	if (ev->size < sizeof(struct wev_event) || ev->size % 8 != 0 ||
+			ev->size > trace->len - *offset ||
+			ev->iface >= WEV_INTERFACE_MAX || ev->opcode >= 32) {
+		return NULL;
+	}
+	*offset += ev->size;
+	return ev;
+}
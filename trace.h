@@ -0,0 +1,28 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "event.h"
+
+/*
+ * An mmap-backed, append-only file of struct wev_event records, written by
+ * wev -w and rendered by wev --decode.
+ */
+struct wev_trace {
+	int fd;
+	char *map;
+	size_t len;
+	size_t cap;
+	/* Of the wev which wrote it, once opened */
+	const struct wev_interface_table *interfaces;
+};
+
+int trace_create(struct wev_trace *trace, const char *path,
+		const struct wev_interface_table *interfaces);
+bool trace_append(struct wev_trace *trace, const struct wev_event *ev);
+void trace_close(struct wev_trace *trace);
+
+int trace_open(struct wev_trace *trace, const char *path);
+const struct wev_event *trace_next(struct wev_trace *trace, size_t *offset);
+
+#endif
@@ -1,19 +1,44 @@
 #define _POSIX_C_SOURCE 200809L
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <linux/input-event-codes.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 #include <wayland-client-core.h>
 #include <wayland-client-protocol.h>
 #include <xkbcommon/xkbcommon.h>
+#include "event.h"
+#include "histogram.h"
+#include "input-timestamps-unstable-v1-protocol.h"
+#include "keycache.h"
+#include "keymap.h"
+#include "output.h"
+#include "pointer-constraints-unstable-v1-protocol.h"
+#include "predicate.h"
+#include "presentation-time-protocol.h"
+#include "publish.h"
+#include "relative-pointer-unstable-v1-protocol.h"
+#include "ring.h"
 #include "shm.h"
+#include "tablet-unstable-v2-protocol.h"
+#include "trace.h"
 #include "xdg-shell-protocol.h"
 
 struct wev_filter {
@@ -22,11 +47,434 @@ struct wev_filter {
 	struct wl_list link;
 };
 
+/* A global to trace with --bind, up to version */
+struct wev_bind {
+	struct wev_generic *generic;
+	uint32_t version;
+	bool present; /* Advertised by the compositor */
+	struct wl_list link;
+};
+
+static const struct wl_interface *wev_interfaces[WEV_INTERFACE_MAX] = {
+	[WEV_WL_REGISTRY] = &wl_registry_interface,
+	[WEV_WL_SEAT] = &wl_seat_interface,
+	[WEV_WL_POINTER] = &wl_pointer_interface,
+	[WEV_WL_KEYBOARD] = &wl_keyboard_interface,
+	[WEV_WL_TOUCH] = &wl_touch_interface,
+	[WEV_XDG_SURFACE] = &xdg_surface_interface,
+	[WEV_XDG_TOPLEVEL] = &xdg_toplevel_interface,
+	[WEV_WL_DATA_OFFER] = &wl_data_offer_interface,
+	[WEV_WL_DATA_DEVICE] = &wl_data_device_interface,
+	[WEV_ZWP_INPUT_TIMESTAMPS_V1] = &zwp_input_timestamps_v1_interface,
+	[WEV_ZWP_RELATIVE_POINTER_V1] = &zwp_relative_pointer_v1_interface,
+	[WEV_ZWP_LOCKED_POINTER_V1] = &zwp_locked_pointer_v1_interface,
+	[WEV_WP_PRESENTATION] = &wp_presentation_interface,
+	[WEV_WP_PRESENTATION_FEEDBACK] = &wp_presentation_feedback_interface,
+	[WEV_ZWP_TABLET_SEAT_V2] = &zwp_tablet_seat_v2_interface,
+	[WEV_ZWP_TABLET_V2] = &zwp_tablet_v2_interface,
+	[WEV_ZWP_TABLET_TOOL_V2] = &zwp_tablet_tool_v2_interface,
+	[WEV_ZWP_TABLET_PAD_V2] = &zwp_tablet_pad_v2_interface,
+};
+/* Grows as generic_register adds interfaces */
+static size_t wev_interface_count = WEV_INTERFACE_COUNT;
+
+/* Events which update formatter state, and are formatted even if filtered */
+static const uint32_t wev_stateful_events[WEV_INTERFACE_MAX] = {
+	[WEV_WL_SEAT] = 1u << WEV_WL_SEAT_NAME,
+	[WEV_WL_KEYBOARD] = 1u << WEV_WL_KEYBOARD_KEYMAP |
+		1u << WEV_WL_KEYBOARD_MODIFIERS,
+	[WEV_ZWP_INPUT_TIMESTAMPS_V1] = 1u << WEV_ZWP_INPUT_TIMESTAMPS_V1_TIMESTAMP,
+	[WEV_ZWP_TABLET_TOOL_V2] = 1u << WEV_ZWP_TABLET_TOOL_V2_TYPE |
+		1u << WEV_ZWP_TABLET_TOOL_V2_REMOVED,
+};
+
+/*
+ * Names of the arguments event_emit records for each event, for --format.
+ * Each name is prefixed with its type: i, u and f as usual, o for object ids,
+ * s for strings, a for arrays of uint32_t, k for key codes, which also get
+ * their keysym and text, and t for 64-bit values split into a high and a low
+ * argument. Arguments without a name are left out. Those of interfaces traced
+ * with --bind are filled in by generic_register.
+ */
+static const char *wev_event_fields[WEV_INTERFACE_MAX][32] = {
+	[WEV_WL_REGISTRY] = {
+		[WEV_WL_REGISTRY_GLOBAL] = "uname sglobal_interface uversion",
+		[WEV_WL_REGISTRY_GLOBAL_REMOVE] = "uname",
+	},
+	[WEV_WL_SEAT] = {
+		[WEV_WL_SEAT_CAPABILITIES] = "ucapabilities",
+		[WEV_WL_SEAT_NAME] = "sname",
+	},
+	[WEV_WL_POINTER] = {
+		[WEV_WL_POINTER_ENTER] = "userial osurface fsurface_x fsurface_y",
+		[WEV_WL_POINTER_LEAVE] = "userial osurface",
+		[WEV_WL_POINTER_MOTION] = "utime fsurface_x fsurface_y",
+		[WEV_WL_POINTER_BUTTON] = "userial utime ubutton ustate",
+		[WEV_WL_POINTER_AXIS] = "utime uaxis fvalue",
+		[WEV_WL_POINTER_FRAME] = "",
+		[WEV_WL_POINTER_AXIS_SOURCE] = "uaxis_source",
+		[WEV_WL_POINTER_AXIS_STOP] = "utime uaxis",
+		[WEV_WL_POINTER_AXIS_DISCRETE] = "uaxis idiscrete",
+	},
+	[WEV_WL_KEYBOARD] = {
+		[WEV_WL_KEYBOARD_KEYMAP] = "uformat usize",
+		[WEV_WL_KEYBOARD_ENTER] = "userial osurface akeys",
+		[WEV_WL_KEYBOARD_LEAVE] = "userial osurface",
+		[WEV_WL_KEYBOARD_KEY] = "userial utime kkey ustate",
+		[WEV_WL_KEYBOARD_MODIFIERS] =
+			"userial umods_depressed umods_latched umods_locked ugroup",
+		[WEV_WL_KEYBOARD_REPEAT_INFO] = "irate idelay",
+	},
+	[WEV_WL_TOUCH] = {
+		[WEV_WL_TOUCH_DOWN] = "userial utime osurface iid fx fy",
+		[WEV_WL_TOUCH_UP] = "userial utime iid",
+		[WEV_WL_TOUCH_MOTION] = "utime iid fx fy",
+		[WEV_WL_TOUCH_FRAME] = "",
+		[WEV_WL_TOUCH_CANCEL] = "",
+		[WEV_WL_TOUCH_SHAPE] = "iid fmajor fminor",
+		[WEV_WL_TOUCH_ORIENTATION] = "iid forientation",
+	},
+	[WEV_XDG_SURFACE] = {
+		[WEV_XDG_SURFACE_CONFIGURE] = "userial",
+	},
+	[WEV_XDG_TOPLEVEL] = {
+		[WEV_XDG_TOPLEVEL_CONFIGURE] = "iwidth iheight astates",
+		[WEV_XDG_TOPLEVEL_CLOSE] = "",
+	},
+	[WEV_WL_DATA_OFFER] = {
+		[WEV_WL_DATA_OFFER_OFFER] = "smime_type",
+		[WEV_WL_DATA_OFFER_SOURCE_ACTIONS] = "usource_actions",
+		[WEV_WL_DATA_OFFER_ACTION] = "udnd_action",
+	},
+	[WEV_WL_DATA_DEVICE] = {
+		[WEV_WL_DATA_DEVICE_DATA_OFFER] = "ooffer",
+		[WEV_WL_DATA_DEVICE_ENTER] = "userial osurface fx fy ooffer",
+		[WEV_WL_DATA_DEVICE_LEAVE] = "",
+		[WEV_WL_DATA_DEVICE_MOTION] = "utime fx fy",
+		[WEV_WL_DATA_DEVICE_DROP] = "",
+		[WEV_WL_DATA_DEVICE_SELECTION] = "ooffer",
+	},
+	[WEV_ZWP_RELATIVE_POINTER_V1] = {
+		[WEV_ZWP_RELATIVE_POINTER_V1_RELATIVE_MOTION] =
+			"tutime fdx fdy fdx_unaccel fdy_unaccel",
+	},
+	[WEV_ZWP_LOCKED_POINTER_V1] = {
+		[WEV_ZWP_LOCKED_POINTER_V1_LOCKED] = "",
+		[WEV_ZWP_LOCKED_POINTER_V1_UNLOCKED] = "",
+	},
+	[WEV_WP_PRESENTATION] = {
+		[WEV_WP_PRESENTATION_CLOCK_ID] = "uclk_id",
+	},
+	[WEV_WP_PRESENTATION_FEEDBACK] = {
+		[WEV_WP_PRESENTATION_FEEDBACK_SYNC_OUTPUT] = "ooutput",
+		[WEV_WP_PRESENTATION_FEEDBACK_PRESENTED] = "tpresented_ns "
+			"urefresh tseq uflags uinput_to_commit_ns ucommit_to_presented_ns",
+		[WEV_WP_PRESENTATION_FEEDBACK_DISCARDED] = "",
+	},
+	[WEV_ZWP_TABLET_SEAT_V2] = {
+		[WEV_ZWP_TABLET_SEAT_V2_TABLET_ADDED] = "oid",
+		[WEV_ZWP_TABLET_SEAT_V2_TOOL_ADDED] = "oid",
+		[WEV_ZWP_TABLET_SEAT_V2_PAD_ADDED] = "oid",
+	},
+	[WEV_ZWP_TABLET_V2] = {
+		[WEV_ZWP_TABLET_V2_NAME] = "sname",
+		[WEV_ZWP_TABLET_V2_ID] = "uvid upid",
+		[WEV_ZWP_TABLET_V2_PATH] = "spath",
+		[WEV_ZWP_TABLET_V2_DONE] = "",
+		[WEV_ZWP_TABLET_V2_REMOVED] = "",
+	},
+	[WEV_ZWP_TABLET_TOOL_V2] = {
+		[WEV_ZWP_TABLET_TOOL_V2_TYPE] = "utool_type",
+		[WEV_ZWP_TABLET_TOOL_V2_HARDWARE_SERIAL] = "thardware_serial",
+		[WEV_ZWP_TABLET_TOOL_V2_HARDWARE_ID_WACOM] = "thardware_id",
+		[WEV_ZWP_TABLET_TOOL_V2_CAPABILITY] = "ucapability",
+		[WEV_ZWP_TABLET_TOOL_V2_DONE] = "",
+		[WEV_ZWP_TABLET_TOOL_V2_REMOVED] = "",
+		[WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_IN] = "userial otablet osurface",
+		[WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_OUT] = "",
+		[WEV_ZWP_TABLET_TOOL_V2_DOWN] = "userial",
+		[WEV_ZWP_TABLET_TOOL_V2_UP] = "",
+		[WEV_ZWP_TABLET_TOOL_V2_MOTION] = "fx fy",
+		[WEV_ZWP_TABLET_TOOL_V2_PRESSURE] = "upressure",
+		[WEV_ZWP_TABLET_TOOL_V2_DISTANCE] = "udistance",
+		[WEV_ZWP_TABLET_TOOL_V2_TILT] = "ftilt_x ftilt_y",
+		[WEV_ZWP_TABLET_TOOL_V2_ROTATION] = "fdegrees",
+		[WEV_ZWP_TABLET_TOOL_V2_SLIDER] = "iposition",
+		[WEV_ZWP_TABLET_TOOL_V2_WHEEL] = "fdegrees iclicks",
+		[WEV_ZWP_TABLET_TOOL_V2_BUTTON] = "userial ubutton ustate",
+		[WEV_ZWP_TABLET_TOOL_V2_FRAME] = "utime",
+	},
+	[WEV_ZWP_TABLET_PAD_V2] = {
+		[WEV_ZWP_TABLET_PAD_V2_GROUP] = "opad_group",
+		[WEV_ZWP_TABLET_PAD_V2_PATH] = "spath",
+		[WEV_ZWP_TABLET_PAD_V2_BUTTONS] = "ubuttons",
+		[WEV_ZWP_TABLET_PAD_V2_DONE] = "",
+		[WEV_ZWP_TABLET_PAD_V2_BUTTON] = "utime ubutton ustate",
+		[WEV_ZWP_TABLET_PAD_V2_ENTER] = "userial otablet osurface",
+		[WEV_ZWP_TABLET_PAD_V2_LEAVE] = "userial osurface",
+		[WEV_ZWP_TABLET_PAD_V2_REMOVED] = "",
+	},
+};
+
+#define WEV_CSV_COLUMNS 128
+
+enum wev_format {
+	WEV_FORMAT_TEXT,
+	WEV_FORMAT_JSONL,
+	WEV_FORMAT_CSV,
+};
+
+#define WEV_FLIGHT_CHORD_KEYS 8
+
 struct wev_options {
 	bool print_globals;
 	char *dump_map;
+	char *record;
+	char *decode;
+	char *publish;
+	char *subscribe;
+	char *flight; /* Where --flight dumps go */
+	uint64_t flight_window; /* In nanoseconds, or 0 if flight_events is set */
+	size_t flight_events;
+	uint32_t flight_chord[WEV_FLIGHT_CHORD_KEYS];
+	size_t flight_chord_len;
+	bool threaded;
+	bool latency;
+	uint64_t stats_interval; /* In nanoseconds */
+	uint64_t pointer_rate_interval; /* In nanoseconds */
+	char *stats_file;
+	bool frames;
+	bool touch_contacts;
+	bool lock_pointer;
+	bool present;
+	enum wev_format format;
 	struct wl_list filters;
 	struct wl_list inverse_filters;
+	/* Bit n is set if event opcode n passes -f/-F, see compile_filters */
+	uint32_t event_mask[WEV_INTERFACE_MAX];
+	/* Bit n is set if event opcode n is formatted even if filtered */
+	uint32_t stateful_mask[WEV_INTERFACE_MAX];
+	struct wev_predicate *where;
+	/* For the events --where depends on the arguments of, see compile_where */
+	struct wev_predicate_program *where_programs[WEV_INTERFACE_MAX][32];
+	struct wl_list binds; /* struct wev_bind, from --bind */
+};
+
+#define WEV_POINTER_FRAME_BUTTONS 4
+#define WEV_TOUCH_POINTS 10
+
+/* With --frames, the pointer events seen since the last frame event */
+struct wev_pointer_frame {
+	uint32_t events;
+	bool enter, leave, motion, has_time, has_source;
+	uint32_t surface, time, source;
+	uint64_t time_ns;
+	wl_fixed_t x, y, dx, dy;
+	uint32_t button_count;
+	struct {
+		uint32_t button, state;
+	} buttons[WEV_POINTER_FRAME_BUTTONS];
+	/* Bit n for axis n */
+	uint32_t axes, discrete_axes, stopped_axes;
+	wl_fixed_t axis_value[2];
+	int32_t axis_discrete[2];
+};
+
+struct wev_touch_point {
+	int32_t id;
+	bool down; /* Between down and up events */
+	uint32_t changes; /* Bit n for touch event opcode n in this frame */
+	wl_fixed_t x, y, dx, dy;
+	wl_fixed_t major, minor, orientation;
+};
+
+/* With --frames, the touch events seen since the last frame event */
+struct wev_touch_frame {
+	uint32_t events;
+	bool has_time;
+	uint32_t time;
+	uint64_t time_ns;
+	struct wev_touch_point points[WEV_TOUCH_POINTS];
+};
+
+/* With --touch-contacts, a touch point from its down event to its up event */
+struct wev_touch_contact {
+	int32_t id;
+	bool down;
+	uint64_t down_ns, last_ns;
+	wl_fixed_t x, y;
+	uint32_t motions;
+	double path; /* Distance moved, in surface coordinates */
+};
+
+/* With --present, a committed frame waiting for its presentation feedback */
+struct wev_present_frame {
+	struct wev_state *state;
+	uint64_t input_ns; /* Of the input event it was drawn for, or 0 */
+	uint64_t commit_ns;
+	uint64_t commit_clock_ns; /* In the presentation clock */
+};
+
+#define WEV_TABLET_TOOLS 8
+
+/*
+ * What the formatter keeps track of for each tablet tool, by object id, and
+ * with --frames the tool events seen since the last frame event.
+ */
+struct wev_tool_state {
+	uint32_t id; /* 0 if unused */
+	uint32_t type;
+	uint32_t events;
+	uint32_t changes; /* Bit n for tool event opcode n in this frame */
+	uint32_t tablet, surface;
+	wl_fixed_t x, y, tilt_x, tilt_y, rotation, wheel;
+	uint32_t pressure, distance;
+	int32_t slider, wheel_clicks;
+	uint32_t button, button_state; /* The last button event of the frame */
+};
+
+/* The last zwp_input_timestamps_v1 timestamp, until the event it is for */
+struct wev_input_time {
+	uint32_t device;
+	uint64_t ns;
+};
+
+/*
+ * With --pointer-rate, the intervals between the frames a pointer moved in,
+ * which are its reports, since the last summary
+ */
+struct wev_pointer_rate {
+	uint64_t last_ns; /* Of the last report, or 0 */
+	uint64_t frame_ns; /* Of the motion in the current frame, or 0 */
+	bool frame_precise; /* frame_ns is not from a millisecond timestamp */
+	/* Of the current frame, either of which makes it a report */
+	uint32_t frame_motions, frame_relative_motions;
+	double typical_ns; /* A moving average, which gaps are measured by */
+
+	uint64_t reports, coalesced, gaps;
+	bool imprecise; /* Some intervals were in whole milliseconds */
+	/* Welford's running mean and sum of squared differences */
+	uint64_t intervals;
+	double mean_ns, m2;
+	struct wev_histogram hist; /* In microseconds */
+};
+
+/* Keys past these are not checked by --flight */
+#define WEV_FLIGHT_KEYS 768
+
+/* A bound wl_seat, and the objects wev made for it */
+struct wev_seat {
+	struct wev_state *state;
+	uint8_t index; /* Recorded as wev_event.seat */
+	uint32_t global;
+	char *name;
+	struct wl_seat *wl_seat;
+	struct wl_pointer *pointer;
+	struct wl_keyboard *keyboard;
+	struct wl_touch *touch;
+	struct zwp_input_timestamps_v1 *pointer_timestamps;
+	struct zwp_input_timestamps_v1 *keyboard_timestamps;
+	struct zwp_input_timestamps_v1 *touch_timestamps;
+	struct zwp_relative_pointer_v1 *relative_pointer;
+	struct zwp_locked_pointer_v1 *locked_pointer; /* With --lock-pointer */
+	struct wl_data_device *data_device;
+	struct wl_data_offer *selection;
+	struct wl_data_offer *dnd;
+	struct zwp_tablet_seat_v2 *tablet_seat;
+	struct wl_list tablet_devices; /* struct wev_tablet_device */
+	/* With --stats, events counted so far, and as of the last report */
+	uint64_t stats_total, stats_reported;
+	struct wev_pointer_rate *pointer_rate; /* With --pointer-rate */
+	/* With --flight, the keys held and touch points down, by protocol id */
+	uint64_t keys_down[WEV_FLIGHT_KEYS / 64];
+	int32_t touches_down[WEV_TOUCH_POINTS];
+	size_t touches_down_len;
+	struct wl_list link;
+};
+
+/* A tablet, tool or pad of a seat */
+struct wev_tablet_device {
+	struct wev_seat *seat;
+	enum wev_interface iface;
+	struct wl_proxy *proxy; /* NULL once a tool is removed */
+	uint32_t id;
+	uint32_t tool_type;
+	/* With --stats, tool frames counted so far, and as of the last report */
+	uint64_t frames, frames_reported;
+	struct wl_list groups; /* Of a pad, struct wev_generic_object */
+	struct wl_list link;
+};
+
+/* What the formatter keeps track of for each seat, see print_event */
+struct wev_seat_state {
+	char *name; /* From wl_seat.name */
+	struct xkb_state *xkb_state;
+	struct xkb_keymap *xkb_keymap;
+	/* Effective modifiers and layout, and what keys map to with them */
+	xkb_mod_mask_t xkb_mods;
+	xkb_layout_index_t xkb_layout;
+	struct wev_keycache keycache;
+
+	wl_fixed_t pointer_x, pointer_y;
+	struct wev_pointer_frame pointer_frame;
+	struct wev_touch_frame touch_frame;
+	struct wev_touch_contact contacts[WEV_TOUCH_POINTS];
+	uint64_t touch_ns; /* Of the last touch event, for the frame after it */
+	struct wev_tool_state tools[WEV_TABLET_TOOLS];
+};
+
+/* The most arguments a message can have, as in libwayland */
+#define WEV_GENERIC_ARGS 20
+
+/*
+ * How generic_dispatch records and print_generic prints an event, worked out
+ * once from its wl_message. The types are those of its signature, without
+ * the version and nullable markers.
+ */
+struct wev_generic_message {
+	const struct wl_message *message;
+	char types[WEV_GENERIC_ARGS + 1];
+	int args;
+	uint8_t children[WEV_GENERIC_ARGS]; /* Interface of new_id arguments */
+	char fields[WEV_EVENT_MAX_ARGS * 8]; /* For wev_event_fields */
+};
+
+/* An interface whose events are recorded without a listener of its own */
+struct wev_generic {
+	struct wev_state *state;
+	const struct wl_interface *interface;
+	uint8_t iface; /* In wev_interfaces */
+	struct wev_generic_message *events;
+	/* Bit n if request n makes a new object for a wl_seat, see seat_bind */
+	uint32_t seat_requests;
+	uint8_t seat_children[32];
+	/* Bit n if event n ends the object, see wev_generic_lifetimes */
+	uint32_t destructors;
+	/* Bit n if the object event n makes replaces the one it made before */
+	uint32_t replacing;
+	int destroy_request; /* -1 if it has none */
+};
+
+/*
+ * An object generic_dispatch records the events of, and the objects made by
+ * its events or for each seat, which are destroyed along with it.
+ */
+struct wev_generic_object {
+	struct wl_proxy *proxy;
+	const struct wev_generic *generic;
+	uint8_t seat;
+	/* Of the event of its parent which made it, or UINT32_MAX */
+	uint32_t opcode;
+	struct wl_list children; /* struct wev_generic_object */
+	struct wl_list link;
+};
+
+/* A global bound with --bind */
+struct wev_bound {
+	struct wev_bind *bind;
+	uint32_t global;
+	struct wev_generic_object *object;
+	struct wl_list link;
 };
 
 struct wev_state {
@@ -36,818 +484,5026 @@ struct wev_state {
 	struct wl_display *display;
 	struct wl_registry *registry;
 	struct wl_compositor *compositor;
-	struct wl_seat *seat;
+	struct wl_list seats; /* struct wev_seat */
+	uint32_t seat_count; /* Bound so far, to number them */
+	struct wev_seat *seats_by_index[WEV_SEAT_MAX]; /* By wev_seat.index */
 	struct wl_shm *shm;
 	struct xdg_wm_base *wm_base;
 	struct wl_data_device_manager *data_device_manager;
+	/* Optional */
+	struct zwp_input_timestamps_manager_v1 *input_timestamps;
+	struct zwp_relative_pointer_manager_v1 *relative_pointer_manager;
+	struct zwp_pointer_constraints_v1 *pointer_constraints;
+	struct wp_presentation *presentation;
+	struct zwp_tablet_manager_v2 *tablet_manager;
+	/* Pad groups and their rings and strips go to generic_dispatch */
+	uint8_t pad_group_iface;
+	/* With --bind, the globals bound for generic_dispatch */
+	struct wl_list bound; /* struct wev_bound */
+	struct wev_generic *generic[WEV_INTERFACE_MAX];
+	/* Ours for each interface of a trace or publisher, see replay_event */
+	uint8_t replay_ifaces[WEV_INTERFACE_MAX];
+	uint64_t replay_malformed;
 
 	struct wl_surface *surface;
 	struct xdg_surface *xdg_surface;
 	struct xdg_toplevel *xdg_toplevel;
 
 	int32_t width, height;
+	struct wev_shm_pool shm_pool;
+	/* Latest xdg_surface.configure, acked and drawn once per batch */
+	bool configure_pending;
+	uint32_t configure_serial;
+	/* With --present, input events are drawn once the last frame is shown */
+	bool redraw_pending;
+	uint64_t redraw_input_ns; /* Of the first input event since then */
+	struct wev_input_time redraw_input_time;
+	struct wl_callback *frame_callback;
+	uint32_t frame_count;
+	clockid_t presentation_clock;
 
-	struct xkb_state *xkb_state;
 	struct xkb_context *xkb_context;
-	struct xkb_keymap *xkb_keymap;
+	struct wev_keymap_cache keymap_cache;
 
-	struct wl_data_offer *selection;
-	struct wl_data_offer *dnd;
-};
+	/* Scratch space for the event being recorded, see event_emit */
+	struct wev_event *event;
+	size_t event_cap;
+	struct wev_trace trace;
+	struct wev_publish publish; /* With --publish */
 
-#define SPACER "                      "
+	struct wev_output out;
+	/* With --format=csv, the part of a field in each column, see csv_init */
+	int csv_columns;
+	struct wev_csv_column {
+		const char *name; /* In wev_event_fields */
+		size_t len;
+		const char *suffix;
+	} csv_names[WEV_CSV_COLUMNS];
+	bool csv_time_ns; /* Followed by a column for precise input times */
+	uint8_t csv_cells[WEV_INTERFACE_MAX][32][WEV_CSV_COLUMNS];
 
-static int proxy_log(struct wev_state *state,
-		struct wl_proxy *proxy, const char *event, const char *fmt, ...) {
-	const char *class = wl_proxy_get_class(proxy);
+	/* Main loop: display, signals and periodic timers, see dispatch_events */
+	int epoll_fd;
+	int signal_fd;
+	int timer_fd;
+	int rate_timer_fd; /* With --pointer-rate, for the summaries */
+	bool display_blocked; /* Waiting for the socket to take our requests */
+	bool latency_report_pending;
 
-	if (!wl_list_empty(&state->opts.filters)) {
-		bool found = false;
-		struct wev_filter *filter;
-		wl_list_for_each(filter, &state->opts.filters, link) {
-			if (strcmp(filter->interface, class) == 0 &&
-					(!filter->event || strcmp(filter->event, event) == 0)) {
-				found = true;
-			}
-		}
-		if (!found) {
-			return 0;
-		}
-	}
-	if (!wl_list_empty(&state->opts.inverse_filters)) {
-		bool found = false;
-		struct wev_filter *filter;
-		wl_list_for_each(filter, &state->opts.inverse_filters, link) {
-			if (strcmp(filter->interface, class) == 0 &&
-					(!filter->event || strcmp(filter->event, event) == 0)) {
-				found = true;
-			}
-		}
-		if (found) {
-			return 0;
-		}
-	}
+	/* With --threaded, events are formatted on another thread */
+	struct wev_ring ring;
+	int ring_fd;
+	uint64_t ring_signaled;
+	atomic_bool formatter_done;
+	pthread_t formatter;
 
-	int n = 0;
-	n += printf("[%02u:%16s] %s%s",
-			wl_proxy_get_id(proxy),
-			class, event, strcmp(fmt, "\n") != 0 ? ": " : "");
-	va_list ap;
-	va_start(ap, fmt);
-	n += vprintf(fmt, ap);
-	va_end(ap);
-	return n;
-}
+	/* With --flight, the latest events, and why they are due to be dumped */
+	struct wev_ring flight;
+	size_t flight_count;
+	bool flight_pending;
+	char flight_reason[64];
 
-static void escape_utf8(char *buf) {
-	if (strcmp(buf, "\a") == 0) {
-		strcpy(buf, "\\a");
-	} else if (strcmp(buf, "\b") == 0) {
-		strcpy(buf, "\\b");
-	} else if (strcmp(buf, "\e") == 0) {
-		strcpy(buf, "\\e");
-	} else if (strcmp(buf, "\f") == 0) {
-		strcpy(buf, "\\f");
-	} else if (strcmp(buf, "\n") == 0) {
-		strcpy(buf, "\\n");
-	} else if (strcmp(buf, "\r") == 0) {
-		strcpy(buf, "\\r");
-	} else if (strcmp(buf, "\t") == 0) {
-		strcpy(buf, "\\t");
-	} else if (strcmp(buf, "\v") == 0) {
-		strcpy(buf, "\\v");
-	}
-}
+	/* With --latency, receive time minus event time in us, per event */
+	struct wev_histogram *latency[WEV_INTERFACE_MAX][32];
+	uint64_t latency_skewed;
+	struct wev_input_time latency_input_time;
 
-static void wl_pointer_enter(void *data, struct wl_pointer *wl_pointer,
-		uint32_t serial, struct wl_surface *surface,
-		wl_fixed_t surface_x, wl_fixed_t surface_y) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_pointer, "enter",
-			"serial: %d; surface: %d, x, y: %f, %f\n",
-			serial, wl_proxy_get_id((struct wl_proxy *)surface),
-			wl_fixed_to_double(surface_x),
-			wl_fixed_to_double(surface_y));
-}
+	/* With --touch-contacts, totals for the report at exit */
+	uint64_t touch_contacts, touch_anomalies, touch_leaked;
 
-static void wl_pointer_leave(void *data, struct wl_pointer *wl_pointer,
-		uint32_t serial, struct wl_surface *surface) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_pointer, "leave", "surface: %d\n",
-			wl_proxy_get_id((struct wl_proxy *)surface));
-}
+	/* With --pointer-rate, the pending timestamp and the last summary time */
+	struct wev_input_time rate_input_time;
+	uint64_t rate_report_time;
 
-static void wl_pointer_motion(void *data, struct wl_pointer *wl_pointer,
-		uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_pointer, "motion",
-			"time: %d; x, y: %f, %f\n", time,
-			wl_fixed_to_double(surface_x),
-			wl_fixed_to_double(surface_y));
-}
+	/* With --stats, events counted so far, and as of the last report */
+	uint64_t stats_total[WEV_INTERFACE_MAX][32];
+	uint64_t stats_reported[WEV_INTERFACE_MAX][32];
+	uint64_t stats_report_time; /* Next one is due when timer_fd fires */
 
-static const char *pointer_button_str(uint32_t button) {
-	switch (button) {
-	case BTN_LEFT:
-		return "left";
-	case BTN_RIGHT:
-		return "right";
-	case BTN_MIDDLE:
-		return "middle";
-	case BTN_SIDE:
-		return "side";
-	case BTN_EXTRA:
-		return "extra";
-	case BTN_FORWARD:
-		return "forward";
-	case BTN_BACK:
-		return "back";
-	case BTN_TASK:
-		return "task";
-	default:
-		return "unknown";
-	}
+	/* Precise time of the event being formatted in nanoseconds, or 0 */
+	uint64_t event_ns;
+	struct wev_input_time input_time;
+
+	/* Formatter state per seat, by wev_event.seat, and the event's one */
+	struct wev_seat_state *seat_states[WEV_SEAT_MAX];
+	struct wev_seat_state *seat;
+};
+
+#define WEV_RING_SIZE (4 << 20)
+#define WEV_FLIGHT_SIZE (16 << 20)
+
+#define SPACER "                      "
+
+static uint64_t monotonic_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-static const char *pointer_state_str(uint32_t state) {
-	switch (state) {
-	case WL_POINTER_BUTTON_STATE_RELEASED:
-		return "released";
-	case WL_POINTER_BUTTON_STATE_PRESSED:
-		return "pressed";
-	default:
-		return "unknown state";
-	}
+static void event_name(char *buf, size_t size, size_t iface, int opcode) {
+	snprintf(buf, size, "%s:%s", wev_interfaces[iface]->name,
+			wev_interfaces[iface]->events[opcode].name);
 }
 
-static void wl_pointer_button(void *data, struct wl_pointer *wl_pointer,
-		uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
-	struct wev_state *wev_state = data;
-	proxy_log(wev_state, (struct wl_proxy *)wl_pointer, "button",
-			"serial: %d; time: %d; button: %d (%s), state: %d (%s)\n",
-			serial, time,
-			button, pointer_button_str(button),
-			state, pointer_state_str(state));
+static bool event_visible(struct wev_state *state,
+		const struct wev_event *ev) {
+	return !(ev->flags & WEV_EVENT_HIDDEN) &&
+		(state->opts.event_mask[ev->iface] & (1u << ev->opcode));
 }
 
-static const char *pointer_axis_str(uint32_t axis) {
-	switch (axis) {
-	case WL_POINTER_AXIS_VERTICAL_SCROLL:
-		return "vertical";
-	case WL_POINTER_AXIS_HORIZONTAL_SCROLL:
-		return "horizontal";
-	default:
-		return "unknown";
+static void event_prefix(struct wev_state *state, const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const struct wev_seat_state *seat = state->seat_states[ev->seat];
+	output_char(out, '[');
+	if (seat && seat->name) {
+		output_str(out, seat->name);
+		output_char(out, '/');
 	}
+	output_uint_pad(out, ev->id, 2);
+	output_char(out, ':');
+	output_str_pad(out, wev_interfaces[ev->iface]->name, 16);
+	output_lit(out, "] ");
+	output_str(out, wev_interfaces[ev->iface]->events[ev->opcode].name);
 }
 
-static void wl_pointer_axis(void *data, struct wl_pointer *wl_pointer,
-		uint32_t time, uint32_t axis, wl_fixed_t value) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_pointer, "axis",
-			"time: %d; axis: %d (%s), value: %f\n",
-			time, axis, pointer_axis_str(axis), wl_fixed_to_double(value));
+/*
+ * Writes the "[seat/id:interface] event" prefix of an event line, leaving the
+ * rest of it to the caller. Returns false if the event is filtered out.
+ */
+static bool event_log(struct wev_state *state, const struct wev_event *ev) {
+	if (!event_visible(state, ev)) {
+		return false;
+	}
+	event_prefix(state, ev);
+	return true;
 }
 
-static void wl_pointer_frame(void *data, struct wl_pointer *wl_pointer) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_pointer, "frame", "\n");
-}
+static void print_event(struct wev_state *state, const struct wev_event *ev);
 
-static const char *pointer_axis_source_str(uint32_t axis_source) {
-	switch (axis_source) {
-	case WL_POINTER_AXIS_SOURCE_WHEEL:
-		return "wheel";
-	case WL_POINTER_AXIS_SOURCE_FINGER:
-		return "finger";
-	case WL_POINTER_AXIS_SOURCE_CONTINUOUS:
-		return "continuous";
-	case WL_POINTER_AXIS_SOURCE_WHEEL_TILT:
-		return "wheel tilt";
-	default:
-		return "unknown";
+/* Writes an event time, and the precise one if the compositor sent it */
+static void print_time(struct wev_state *state, uint32_t time, uint64_t ns) {
+	struct wev_output *out = &state->out;
+	output_int(out, time);
+	if (ns != 0) {
+		output_lit(out, " (");
+		output_uint64(out, ns / 1000000000);
+		output_char(out, '.');
+		output_uint_pad(out, ns % 1000000000, 9);
+		output_lit(out, " s)");
 	}
 }
 
-static void wl_pointer_axis_source(void *data, struct wl_pointer *wl_pointer,
-		uint32_t axis_source) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_pointer, "axis_source",
-			"%d (%s)\n", axis_source, pointer_axis_source_str(axis_source));
+/* Returns the argument holding the event's own timestamp, or -1 */
+static int event_time_arg(const struct wev_event *ev) {
+	switch (ev->iface) {
+	case WEV_WL_POINTER:
+		switch (ev->opcode) {
+		case WEV_WL_POINTER_MOTION:
+		case WEV_WL_POINTER_AXIS:
+		case WEV_WL_POINTER_AXIS_STOP:
+			return 0;
+		case WEV_WL_POINTER_BUTTON:
+			return 1;
+		}
+		break;
+	case WEV_WL_KEYBOARD:
+		if (ev->opcode == WEV_WL_KEYBOARD_KEY) {
+			return 1;
+		}
+		break;
+	case WEV_WL_TOUCH:
+		switch (ev->opcode) {
+		case WEV_WL_TOUCH_MOTION:
+			return 0;
+		case WEV_WL_TOUCH_DOWN:
+		case WEV_WL_TOUCH_UP:
+			return 1;
+		}
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2:
+		// The other tool events take the time of their frame
+		if (ev->opcode == WEV_ZWP_TABLET_TOOL_V2_FRAME) {
+			return 0;
+		}
+		break;
+	case WEV_ZWP_TABLET_PAD_V2:
+		if (ev->opcode == WEV_ZWP_TABLET_PAD_V2_BUTTON) {
+			return 0;
+		}
+		break;
+	}
+	return -1;
 }
 
-static void wl_pointer_axis_stop(void *data, struct wl_pointer *wl_pointer,
-		uint32_t time, uint32_t axis) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_pointer, "axis_stop",
-			"time: %d; axis: %d (%s)\n",
-			time, axis, pointer_axis_str(axis));
+/*
+ * Returns the time of an input event in nanoseconds, if the compositor sent it
+ * with zwp_input_timestamps_v1, or 0. Timestamps come right before the event
+ * they are for, so they are held on to until it is passed in.
+ */
+static uint64_t input_time(struct wev_input_time *time,
+		const struct wev_event *ev) {
+	if (ev->iface == WEV_ZWP_RELATIVE_POINTER_V1) {
+		// Carries its own, in microseconds
+		return ((uint64_t)ev->args[0].u << 32 | ev->args[1].u) * 1000;
+	}
+	if (ev->iface == WEV_ZWP_INPUT_TIMESTAMPS_V1) {
+		uint64_t sec = (uint64_t)ev->args[0].u << 32 | ev->args[1].u;
+		time->device = ev->args[3].u;
+		time->ns = sec * 1000000000 + ev->args[2].u;
+		return 0;
+	}
+	if (time->ns == 0 || time->device != ev->id || event_time_arg(ev) < 0) {
+		return 0;
+	}
+	uint64_t ns = time->ns;
+	time->ns = 0;
+	return ns;
 }
 
-static void wl_pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer,
-		uint32_t axis, int32_t discrete) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_pointer, "axis_stop",
-			"axis: %d (%s), discrete: %d\n",
-			axis, pointer_axis_str(axis), discrete);
-}
+static void latency_record(struct wev_state *state,
+		const struct wev_event *ev) {
+	uint64_t ns = input_time(&state->latency_input_time, ev);
+	int arg = event_time_arg(ev);
+	bool presented = ev->iface == WEV_WP_PRESENTATION_FEEDBACK &&
+		ev->opcode == WEV_WP_PRESENTATION_FEEDBACK_PRESENTED;
+	if ((ns == 0 && arg < 0 && !presented) || !event_visible(state, ev)) {
+		return;
+	}
 
-static const struct wl_pointer_listener wl_pointer_listener = {
-	.enter = wl_pointer_enter,
-	.leave = wl_pointer_leave,
-	.motion = wl_pointer_motion,
-	.button = wl_pointer_button,
-	.axis = wl_pointer_axis,
-	.frame = wl_pointer_frame,
-	.axis_source = wl_pointer_axis_source,
-	.axis_stop = wl_pointer_axis_stop,
-	.axis_discrete = wl_pointer_axis_discrete,
-};
+	uint64_t delta_us;
+	if (presented) {
+		// From the input event the frame was drawn for to the screen
+		if (ev->args[6].u == 0) {
+			return;
+		}
+		delta_us = ((uint64_t)ev->args[6].u + ev->args[7].u) / 1000;
+	} else if (ns != 0) {
+		if (ns > ev->time) {
+			++state->latency_skewed;
+			return;
+		}
+		delta_us = (ev->time - ns) / 1000;
+	} else {
+		/*
+		 * Event times are in milliseconds from an unspecified base, which
+		 * is CLOCK_MONOTONIC in practice. Comparing in milliseconds keeps
+		 * the math right across the 32-bit wraparound.
+		 */
+		uint32_t delta_ms = (uint32_t)(ev->time / 1000000) - ev->args[arg].u;
+		if (delta_ms > INT32_MAX) {
+			++state->latency_skewed;
+			return;
+		}
+		delta_us = (uint64_t)delta_ms * 1000 + ev->time / 1000 % 1000;
+	}
 
-static const char *keymap_format_str(uint32_t format) {
-	switch (format) {
-	case WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP:
-		return "none";
-	case WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1:
-		return "xkb v1";
-	default:
-		return "unknown";
+	struct wev_histogram **hist = &state->latency[ev->iface][ev->opcode];
+	if (!*hist && !(*hist = calloc(1, sizeof(**hist)))) {
+		return;
 	}
+	histogram_add(*hist, delta_us < UINT32_MAX ? delta_us : UINT32_MAX);
 }
 
-static void wl_keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard,
-		uint32_t format, int32_t fd, uint32_t size) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_keyboard, "keymap",
-			"format: %d (%s), size: %d\n",
-			format, keymap_format_str(format), size);
-	char *map_shm = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-	if (map_shm == MAP_FAILED) {
-		close(fd);
-		fprintf(stderr, "Unable to mmap keymap: %s", strerror(errno));
+/*
+ * With --present, schedules a frame for an input event, which remembers when
+ * the first input event since the last frame happened.
+ */
+static void present_input(struct wev_state *state,
+		const struct wev_event *ev) {
+	uint64_t ns = input_time(&state->redraw_input_time, ev);
+	int arg = event_time_arg(ev);
+	if ((ns == 0 && arg < 0) || !event_visible(state, ev) ||
+			state->redraw_pending) {
 		return;
 	}
-	if (state->opts.dump_map) {
-		FILE *f = fopen(state->opts.dump_map, "w");
-		fwrite(map_shm, 1, size, f);
-		fclose(f);
-	}
-	if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
-		munmap(map_shm, size);
-		close(fd);
-		return;
+	if (ns == 0) {
+		// The start of the millisecond it happened in, see latency_record
+		uint64_t ms = ev->time / 1000000;
+		uint32_t delta_ms = (uint32_t)ms - ev->args[arg].u;
+		ns = delta_ms > INT32_MAX ? ev->time : (ms - delta_ms) * 1000000;
 	}
+	state->redraw_pending = true;
+	state->redraw_input_ns = ns;
+}
 
-	struct xkb_keymap *keymap = xkb_keymap_new_from_string(
-			state->xkb_context, map_shm, XKB_KEYMAP_FORMAT_TEXT_V1,
-			XKB_KEYMAP_COMPILE_NO_FLAGS);
-	munmap(map_shm, size);
-	close(fd);
+static void latency_report(struct wev_state *state) {
+	static const struct {
+		const char *name;
+		double fraction;
+	} columns[] = {
+		{ "p50", 0.5 },
+		{ "p90", 0.9 },
+		{ "p99", 0.99 },
+		{ "p99.9", 0.999 },
+	};
 
-	struct xkb_state *xkb_state = xkb_state_new(keymap);
-	xkb_keymap_unref(state->xkb_keymap);
-	xkb_state_unref(state->xkb_state);
-	state->xkb_keymap = keymap;
-	state->xkb_state = xkb_state;
-}
+	fprintf(stderr, "%-28s %8s", "latency (ms)", "count");
+	for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); ++i) {
+		fprintf(stderr, " %9s", columns[i].name);
+	}
+	fprintf(stderr, " %9s\n", "max");
 
-static void wl_keyboard_enter(void *data, struct wl_keyboard *wl_keyboard,
-		uint32_t serial, struct wl_surface *surface, struct wl_array *keys) {
-	struct wev_state *state = data;
-	int n = proxy_log(state, (struct wl_proxy *)wl_keyboard, "enter",
-			"serial: %d; surface: %d\n", serial,
-			wl_proxy_get_id((struct wl_proxy *)surface));
-	if (n != 0) {
-		uint32_t *key;
-		wl_array_for_each(key, keys) {
-			char buf[128];
-			xkb_keysym_t sym = xkb_state_key_get_one_sym(
-					state->xkb_state, *key + 8);
-			xkb_keysym_get_name(sym, buf, sizeof(buf));
-			printf(SPACER "sym: %-12s (%d), ", buf, sym);
-			xkb_state_key_get_utf8(
-					state->xkb_state, *key + 8, buf, sizeof(buf));
-			escape_utf8(buf);
-			printf("utf8: '%s'\n", buf);
+	for (size_t i = 0; i < wev_interface_count; ++i) {
+		for (int op = 0; op < 32; ++op) {
+			const struct wev_histogram *hist = state->latency[i][op];
+			if (!hist) {
+				continue;
+			}
+			char name[64];
+			event_name(name, sizeof(name), i, op);
+			fprintf(stderr, "%-28s %8" PRIu64, name, hist->count);
+			for (size_t c = 0; c < sizeof(columns) / sizeof(columns[0]); ++c) {
+				fprintf(stderr, " %9.3f",
+						histogram_value_at(hist, columns[c].fraction) / 1000.0);
+			}
+			fprintf(stderr, " %9.3f\n", hist->max / 1000.0);
 		}
 	}
+	if (state->latency_skewed) {
+		fprintf(stderr, "%" PRIu64 " events were timestamped "
+				"after they were received\n", state->latency_skewed);
+	}
 }
 
-static void wl_keyboard_leave(void *data, struct wl_keyboard *wl_keyboard,
-		uint32_t serial, struct wl_surface *surface) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_keyboard, "leave",
-			"serial: %d; surface: %d\n", serial,
-			wl_proxy_get_id((struct wl_proxy *)surface));
+static void touch_contacts_report(struct wev_state *state) {
+	fprintf(stderr, "Touch contacts: %" PRIu64 "; events which contradicted "
+			"the ones before: %" PRIu64 "; contacts left down by cancel: "
+			"%" PRIu64 "\n", state->touch_contacts,
+			state->touch_anomalies, state->touch_leaked);
 }
 
-static const char *key_state_str(uint32_t state) {
-	switch (state) {
-	case WL_KEYBOARD_KEY_STATE_RELEASED:
-		return "released";
-	case WL_KEYBOARD_KEY_STATE_PRESSED:
-		return "pressed";
+static const char *tablet_tool_type_str(uint32_t type) {
+	switch (type) {
+	case ZWP_TABLET_TOOL_V2_TYPE_PEN:
+		return "pen";
+	case ZWP_TABLET_TOOL_V2_TYPE_ERASER:
+		return "eraser";
+	case ZWP_TABLET_TOOL_V2_TYPE_BRUSH:
+		return "brush";
+	case ZWP_TABLET_TOOL_V2_TYPE_PENCIL:
+		return "pencil";
+	case ZWP_TABLET_TOOL_V2_TYPE_AIRBRUSH:
+		return "airbrush";
+	case ZWP_TABLET_TOOL_V2_TYPE_FINGER:
+		return "finger";
+	case ZWP_TABLET_TOOL_V2_TYPE_MOUSE:
+		return "mouse";
+	case ZWP_TABLET_TOOL_V2_TYPE_LENS:
+		return "lens";
 	default:
 		return "unknown";
 	}
 }
 
-static void wl_keyboard_key(void *data, struct wl_keyboard *wl_keyboard,
-		uint32_t serial, uint32_t time, uint32_t key, uint32_t state) {
-	struct wev_state *wev_state = data;
-	int n = proxy_log(wev_state, (struct wl_proxy *)wl_keyboard, "key",
-			"serial: %d; time: %d; key: %d; state: %d (%s)\n",
-			serial, time, key + 8, state, key_state_str(state));
-
-	char buf[128];
-	xkb_keysym_t sym = xkb_state_key_get_one_sym(wev_state->xkb_state, key + 8);
-	uint32_t keycode = state == WL_KEYBOARD_KEY_STATE_PRESSED ? key + 8 : 0;
-
-	if (n != 0) {
-		xkb_keysym_get_name(sym, buf, sizeof(buf));
-		printf(SPACER "sym: %-12s (%d), ", buf, sym);
-
-		xkb_state_key_get_utf8(wev_state->xkb_state, keycode, buf, sizeof(buf));
-		escape_utf8(buf);
-		printf("utf8: '%s'\n", buf);
+/* Label values escape backslashes, quotes and newlines */
+static void metrics_seat_label(FILE *f, const struct wev_seat *seat) {
+	if (!seat->name) {
+		fprintf(f, "#%d", seat->index);
+		return;
+	}
+	for (const char *c = seat->name; *c; ++c) {
+		if (*c == '\n') {
+			fputs("\\n", f);
+			continue;
+		}
+		if (*c == '\\' || *c == '"') {
+			fputc('\\', f);
+		}
+		fputc(*c, f);
 	}
 }
 
-static void print_modifiers(struct wev_state *state, uint32_t mods) {
-	if (mods != 0) {
-		printf(": ");
+static void stats_write_metrics(struct wev_state *state) {
+	char tmp[PATH_MAX];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", state->opts.stats_file)
+			>= (int)sizeof(tmp)) {
+		fprintf(stderr, "Stats file path too long\n");
+		return;
 	}
-	for (int i = 0; i < 32; ++i) {
+	FILE *f = fopen(tmp, "w");
+	if (!f) {
+		fprintf(stderr, "Failed to open %s: %s\n", tmp, strerror(errno));
+		return;
+	}
+
+	fprintf(f, "# TYPE wev_events counter\n"
+			"# HELP wev_events Wayland events received.\n");
+	for (size_t i = 0; i < wev_interface_count; ++i) {
+		for (int op = 0; op < 32; ++op) {
+			if (state->stats_total[i][op] == 0) {
+				continue;
+			}
+			fprintf(f, "wev_events_total{interface=\"%s\",event=\"%s\"} "
+					"%" PRIu64 "\n", wev_interfaces[i]->name,
+					wev_interfaces[i]->events[op].name,
+					state->stats_total[i][op]);
+		}
+	}
+	fprintf(f, "# TYPE wev_seat_events counter\n"
+			"# HELP wev_seat_events Wayland events received per seat.\n");
+	struct wev_seat *seat;
+	wl_list_for_each(seat, &state->seats, link) {
+		fprintf(f, "wev_seat_events_total{seat=\"");
+		metrics_seat_label(f, seat);
+		fprintf(f, "\"} %" PRIu64 "\n", seat->stats_total);
+	}
+	fprintf(f, "# TYPE wev_tablet_tool_frames counter\n"
+			"# HELP wev_tablet_tool_frames Tablet tool frames received.\n");
+	wl_list_for_each(seat, &state->seats, link) {
+		struct wev_tablet_device *device;
+		wl_list_for_each(device, &seat->tablet_devices, link) {
+			if (device->iface != WEV_ZWP_TABLET_TOOL_V2) {
+				continue;
+			}
+			fprintf(f, "wev_tablet_tool_frames_total{seat=\"");
+			metrics_seat_label(f, seat);
+			fprintf(f, "\",tool=\"%s\",id=\"%" PRIu32 "\"} %" PRIu64 "\n",
+					tablet_tool_type_str(device->tool_type), device->id,
+					device->frames);
+		}
+	}
+	fprintf(f, "# TYPE wev_output_avoided_bytes counter\n"
+			"# HELP wev_output_avoided_bytes Text not printed in stats mode.\n"
+			"wev_output_avoided_bytes_total %" PRIu64 "\n"
+			"# EOF\n", state->out.written);
+
+	// Renamed into place, so scrapers never see a partial file
+	if (fclose(f) != 0 || rename(tmp, state->opts.stats_file) < 0) {
+		fprintf(stderr, "Failed to write %s: %s\n",
+				state->opts.stats_file, strerror(errno));
+		unlink(tmp);
+	}
+}
+
+static void stats_report(struct wev_state *state, uint64_t now) {
+	double elapsed = (now - state->stats_report_time) / 1e9;
+	uint64_t total = 0, delta = 0;
+	output_flush(&state->out);
+
+	printf("%-28s %10s %12s\n", "interface:event", "events/s", "total");
+	for (size_t i = 0; i < wev_interface_count; ++i) {
+		for (int op = 0; op < 32; ++op) {
+			uint64_t count = state->stats_total[i][op];
+			if (count == 0) {
+				continue;
+			}
+			uint64_t new = count - state->stats_reported[i][op];
+			char name[64];
+			event_name(name, sizeof(name), i, op);
+			printf("%-28s %10.1f %12" PRIu64 "\n", name, new / elapsed, count);
+			state->stats_reported[i][op] = count;
+			total += count;
+			delta += new;
+		}
+	}
+	printf("%-28s %10.1f %12" PRIu64 "\n", "all", delta / elapsed, total);
+	struct wev_seat *seat;
+	wl_list_for_each(seat, &state->seats, link) {
+		char name[64];
+		if (seat->name) {
+			snprintf(name, sizeof(name), "seat %s", seat->name);
+		} else {
+			snprintf(name, sizeof(name), "seat #%d", seat->index);
+		}
+		printf("%-28s %10.1f %12" PRIu64 "\n", name,
+				(seat->stats_total - seat->stats_reported) / elapsed,
+				seat->stats_total);
+		seat->stats_reported = seat->stats_total;
+		// Frames per second is the rate the tool is sampled at
+		struct wev_tablet_device *device;
+		wl_list_for_each(device, &seat->tablet_devices, link) {
+			if (device->iface != WEV_ZWP_TABLET_TOOL_V2) {
+				continue;
+			}
+			snprintf(name, sizeof(name), "  %s %" PRIu32 " frames",
+					tablet_tool_type_str(device->tool_type), device->id);
+			printf("%-28s %10.1f %12" PRIu64 "\n", name,
+					(device->frames - device->frames_reported) / elapsed,
+					device->frames);
+			device->frames_reported = device->frames;
+		}
+	}
+	printf("output avoided: %" PRIu64 " bytes\n\n", state->out.written);
+	fflush(stdout);
+
+	if (state->opts.stats_file) {
+		stats_write_metrics(state);
+	}
+	state->stats_report_time = now;
+}
+
+/* Intervals longer than this are the pointer coming to rest, not a gap */
+#define WEV_RATE_IDLE_NS 100000000
+/* Gaps are intervals this many times longer than the usual ones */
+#define WEV_RATE_GAP 3
+
+static void pointer_rate_report(struct wev_pointer_rate *rate, uint64_t ns,
+		bool precise) {
+	// Equal millisecond timestamps are reports less than 1 ms apart
+	if (rate->last_ns && ns >= rate->last_ns &&
+			ns - rate->last_ns < WEV_RATE_IDLE_NS) {
+		double interval = ns - rate->last_ns;
+		// Millisecond timestamps can be up to 1 ms late
+		double gap = WEV_RATE_GAP * rate->typical_ns + (precise ? 0 : 1e6);
+		if (rate->typical_ns && interval > gap) {
+			++rate->gaps;
+		}
+		rate->typical_ns += (interval - rate->typical_ns) /
+			(rate->typical_ns ? 64 : 1);
+		double delta = interval - rate->mean_ns;
+		rate->mean_ns += delta / ++rate->intervals;
+		rate->m2 += delta * (interval - rate->mean_ns);
+		histogram_add(&rate->hist, interval / 1000);
+		rate->imprecise |= !precise;
+	}
+	rate->last_ns = ns;
+	++rate->reports;
+}
+
+/*
+ * Times the frames of the pointer of seat which have motion in them, by the
+ * most precise timestamp any of their events has.
+ */
+static void pointer_rate_record(struct wev_state *state, struct wev_seat *seat,
+		const struct wev_event *ev) {
+	uint64_t ns = input_time(&state->rate_input_time, ev);
+	bool motion = ev->iface == WEV_WL_POINTER &&
+		ev->opcode == WEV_WL_POINTER_MOTION;
+	bool relative = ev->iface == WEV_ZWP_RELATIVE_POINTER_V1;
+	bool frame = ev->iface == WEV_WL_POINTER &&
+		ev->opcode == WEV_WL_POINTER_FRAME;
+	if (!motion && !relative && !frame) {
+		return;
+	}
+	struct wev_pointer_rate *rate = seat->pointer_rate;
+	if (!rate && !(rate = seat->pointer_rate = calloc(1, sizeof(*rate)))) {
+		return;
+	}
+
+	if (frame) {
+		// With a locked pointer, frames only have relative motion
+		if (rate->frame_motions > 0 || rate->frame_relative_motions > 0) {
+			pointer_rate_report(rate, rate->frame_ns, rate->frame_precise);
+			rate->coalesced += rate->frame_motions > 1 ||
+				rate->frame_relative_motions > 1;
+		}
+		rate->frame_ns = 0;
+		rate->frame_precise = false;
+		rate->frame_motions = 0;
+		rate->frame_relative_motions = 0;
+		return;
+	}
+	rate->frame_motions += motion;
+	rate->frame_relative_motions += relative;
+	if (ns != 0 && !rate->frame_precise) {
+		rate->frame_ns = ns;
+		rate->frame_precise = true;
+	} else if (motion && rate->frame_ns == 0) {
+		rate->frame_ns = (uint64_t)ev->args[0].u * 1000000;
+	}
+}
+
+/* Prints a line for each pointer which moved since the last summary */
+static void pointer_rate_summary(struct wev_state *state, uint64_t now) {
+	double elapsed = (now - state->rate_report_time) / 1e9;
+	struct wev_seat *seat;
+	wl_list_for_each(seat, &state->seats, link) {
+		struct wev_pointer_rate *rate = seat->pointer_rate;
+		if (!rate || rate->reports == 0) {
+			continue;
+		}
+		char name[64];
+		if (seat->name) {
+			snprintf(name, sizeof(name), "pointer %s", seat->name);
+		} else {
+			snprintf(name, sizeof(name), "pointer #%d", seat->index);
+		}
+		printf("%s: %" PRIu64 " reports (%.1f/s)", name, rate->reports,
+				rate->reports / elapsed);
+		if (rate->intervals > 0) {
+			double stddev = rate->intervals > 1 ?
+				sqrt(rate->m2 / (rate->intervals - 1)) : 0;
+			printf(", %.1f Hz, interval %.3f ms, stddev %.3f ms, "
+					"p99 %.3f ms, max %.3f ms", 1e9 / rate->mean_ns,
+					rate->mean_ns / 1e6, stddev / 1e6,
+					histogram_value_at(&rate->hist, 0.99) / 1e3,
+					rate->hist.max / 1e3);
+		}
+		printf(", %" PRIu64 " coalesced, %" PRIu64 " gaps%s\n",
+				rate->coalesced, rate->gaps,
+				rate->imprecise ? " (ms timestamps)" : "");
+
+		// The last report, the usual interval and the frame carry over
+		rate->reports = rate->coalesced = rate->gaps = 0;
+		rate->imprecise = false;
+		rate->intervals = 0;
+		rate->mean_ns = rate->m2 = 0;
+		memset(&rate->hist, 0, sizeof(rate->hist));
+	}
+	fflush(stdout);
+	state->rate_report_time = now;
+}
+
+static struct wev_event *event_reserve(struct wev_state *state, size_t size) {
+	if (size > state->event_cap) {
+		size_t cap = state->event_cap * 2;
+		while (cap < size) {
+			cap *= 2;
+		}
+		struct wev_event *ev = realloc(state->event, cap);
+		if (!ev) {
+			return NULL;
+		}
+		state->event = ev;
+		state->event_cap = cap;
+	}
+	return state->event;
+}
+
+/* Has the events recorded so far dumped once this batch is dispatched */
+static void flight_trigger(struct wev_state *state, const char *fmt, ...) {
+	if (state->flight_pending) {
+		return;
+	}
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(state->flight_reason, sizeof(state->flight_reason), fmt, ap);
+	va_end(ap);
+	state->flight_pending = true;
+}
+
+static bool flight_key_down(struct wev_seat *seat, uint32_t key) {
+	return key < WEV_FLIGHT_KEYS && (seat->keys_down[key / 64] >> key % 64) & 1;
+}
+
+static void flight_check_key(struct wev_state *state, struct wev_seat *seat,
+		uint32_t key, uint32_t key_state) {
+	if (key >= WEV_FLIGHT_KEYS) {
+		return;
+	}
+	uint64_t bit = UINT64_C(1) << key % 64;
+	bool down = flight_key_down(seat, key);
+	// Key codes as wev shows them
+	switch (key_state) {
+	case WL_KEYBOARD_KEY_STATE_RELEASED:
+		if (!down) {
+			flight_trigger(state, "key %" PRIu32 " released without a press",
+					key + 8);
+		}
+		seat->keys_down[key / 64] &= ~bit;
+		return;
+	case WL_KEYBOARD_KEY_STATE_PRESSED:
+		if (down) {
+			flight_trigger(state, "key %" PRIu32 " pressed twice", key + 8);
+		}
+		seat->keys_down[key / 64] |= bit;
+		break;
+	default:
+		// Repeats of a held key
+		return;
+	}
+
+	const struct wev_options *opts = &state->opts;
+	size_t held = 0;
+	while (held < opts->flight_chord_len &&
+			flight_key_down(seat, opts->flight_chord[held])) {
+		++held;
+	}
+	if (held > 0 && held == opts->flight_chord_len) {
+		flight_trigger(state, "key chord");
+	}
+}
+
+static ssize_t flight_touch_find(struct wev_seat *seat, int32_t id) {
+	for (size_t i = 0; i < seat->touches_down_len; ++i) {
+		if (seat->touches_down[i] == id) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Looks for key and touch events which contradict the ones before */
+static void flight_check(struct wev_state *state, struct wev_seat *seat,
+		const struct wev_event *ev) {
+	const union wev_arg *arg = ev->args;
+	ssize_t touch;
+	switch (ev->iface) {
+	case WEV_WL_KEYBOARD:
+		switch (ev->opcode) {
+		case WEV_WL_KEYBOARD_ENTER:;
+			uint32_t size;
+			const uint32_t *keys = wev_event_array(ev, 2, &size);
+			memset(seat->keys_down, 0, sizeof(seat->keys_down));
+			for (size_t i = 0; i < size / sizeof(*keys); ++i) {
+				flight_check_key(state, seat, keys[i],
+						WL_KEYBOARD_KEY_STATE_PRESSED);
+			}
+			break;
+		case WEV_WL_KEYBOARD_LEAVE:
+			memset(seat->keys_down, 0, sizeof(seat->keys_down));
+			break;
+		case WEV_WL_KEYBOARD_KEY:
+			flight_check_key(state, seat, arg[2].u, arg[3].u);
+			break;
+		}
+		break;
+	case WEV_WL_TOUCH:
+		switch (ev->opcode) {
+		case WEV_WL_TOUCH_DOWN:
+			if (flight_touch_find(seat, arg[3].i) >= 0) {
+				flight_trigger(state, "touch %" PRIi32 " down twice",
+						arg[3].i);
+			} else if (seat->touches_down_len < WEV_TOUCH_POINTS) {
+				seat->touches_down[seat->touches_down_len++] = arg[3].i;
+			}
+			break;
+		case WEV_WL_TOUCH_UP:
+			touch = flight_touch_find(seat, arg[2].i);
+			if (touch < 0) {
+				flight_trigger(state, "touch %" PRIi32 " up without a down",
+						arg[2].i);
+			} else {
+				seat->touches_down[touch] =
+					seat->touches_down[--seat->touches_down_len];
+			}
+			break;
+		case WEV_WL_TOUCH_MOTION:
+			if (flight_touch_find(seat, arg[1].i) < 0) {
+				flight_trigger(state, "touch %" PRIi32 " moved without a down",
+						arg[1].i);
+			}
+			break;
+		case WEV_WL_TOUCH_CANCEL:
+			seat->touches_down_len = 0;
+			break;
+		}
+		break;
+	}
+}
+
+/*
+ * Drops the oldest event in the --flight window. It is formatted hidden, so
+ * the formatter still has the state it carries, such as a keymap.
+ */
+static void flight_evict(struct wev_state *state,
+		const struct wev_event *oldest) {
+	// ring_peek hands out records read-only, but this ring is ours alone
+	struct wev_event *ev = (struct wev_event *)oldest;
+	if (!(ev->flags & WEV_EVENT_HIDDEN)) {
+		--state->flight_count;
+	}
+	ev->flags |= WEV_EVENT_HIDDEN;
+	print_event(state, ev);
+	ring_pop(&state->flight);
+}
+
+/*
+ * Keeps the event in the --flight window, dropping the oldest ones which
+ * fell out of it, or do not leave room for it. Only events which pass the
+ * filters count towards the number of events it holds.
+ */
+static void flight_record(struct wev_state *state, struct wev_seat *seat,
+		const struct wev_event *ev) {
+	struct wev_ring *ring = &state->flight;
+	bool full = !(ev->flags & WEV_EVENT_HIDDEN) && state->opts.flight_events &&
+		state->flight_count == state->opts.flight_events;
+	const struct wev_event *oldest;
+	while ((oldest = ring_peek(ring)) && (full ||
+			(state->opts.flight_window &&
+			ev->time - oldest->time > state->opts.flight_window))) {
+		flight_evict(state, oldest);
+		full = full && state->flight_count == state->opts.flight_events;
+	}
+	while (!ring_push(ring, ev)) {
+		if (!(oldest = ring_peek(ring))) {
+			return;
+		}
+		flight_evict(state, oldest);
+	}
+	state->flight_count += !(ev->flags & WEV_EVENT_HIDDEN);
+	if (seat) {
+		flight_check(state, seat, ev);
+	}
+}
+
+/*
+ * Records an event of an object of seat, or of no seat if NULL, then writes
+ * it to the trace or prints it. The types are those of a wl_message
+ * signature: i, u, f for integers, o for objects (may be NULL), n for new
+ * objects, s for strings (may be NULL), a for arrays and h for fds.
+ */
+static void event_record(struct wev_state *state, struct wev_seat *seat,
+		struct wl_proxy *proxy, uint8_t iface, uint32_t opcode,
+		const char *types, const union wl_argument *args) {
+	uint8_t flags = 0;
+	if (!(state->opts.event_mask[iface] & (1u << opcode))) {
+		if (!(state->opts.stateful_mask[iface] & (1u << opcode))) {
+			return;
+		}
+		flags |= WEV_EVENT_HIDDEN;
+	}
+
+	struct wev_event *ev = state->event;
+	memset(ev, 0, sizeof(*ev));
+	size_t size = sizeof(*ev);
+
+	for (int i = 0; types[i] && i < WEV_EVENT_MAX_ARGS; ++i) {
+		const void *data;
+		uint32_t len;
+		switch (types[i]) {
+		case 'i':
+		case 'f':
+			ev->args[i].i = args[i].i;
+			continue;
+		case 'u':
+			ev->args[i].u = args[i].u;
+			continue;
+		case 'h':
+			ev->args[i].i = args[i].h;
+			continue;
+		case 'o':
+		case 'n':;
+			struct wl_proxy *object = (struct wl_proxy *)args[i].o;
+			ev->args[i].u = object ? wl_proxy_get_id(object) : 0;
+			continue;
+		case 's':
+			// NULL is told apart from "" by having no terminator
+			data = args[i].s;
+			len = data ? strlen(data) + 1 : 0;
+			break;
+		case 'a':
+			data = args[i].a->data;
+			len = args[i].a->size;
+			break;
+		default:
+			abort();
+		}
+
+		// Length prefixed, and always NUL terminated for the formatter
+		size_t offset = size - offsetof(struct wev_event, data);
+		ev = event_reserve(state,
+				(size + sizeof(uint32_t) + len + 1 + 7) & ~(size_t)7);
+		if (!ev) {
+			fprintf(stderr, "Failed to allocate event record\n");
+			return;
+		}
+		memcpy(ev->data + offset, &len, sizeof(len));
+		if (len > 0) {
+			memcpy(ev->data + offset + sizeof(len), data, len);
+		}
+		ev->data[offset + sizeof(len) + len] = '\0';
+		ev->args[i].u = offset;
+		size += sizeof(len) + len + 1;
+	}
+
+	// Before any formatting, so rejected events cost next to nothing
+	const struct wev_predicate_program *where =
+		state->opts.where_programs[iface][opcode];
+	if (where && !(flags & WEV_EVENT_HIDDEN) && !predicate_run(where, ev)) {
+		if (!(state->opts.stateful_mask[iface] & (1u << opcode))) {
+			return;
+		}
+		flags |= WEV_EVENT_HIDDEN;
+	}
+
+	ev->time = monotonic_ns();
+	ev->size = (size + 7) & ~(size_t)7;
+	// Padding goes into traces and to other processes too
+	memset((char *)ev + size, 0, ev->size - size);
+	ev->id = wl_proxy_get_id(proxy);
+	ev->iface = iface;
+	ev->opcode = opcode;
+	ev->flags = flags;
+	ev->seat = seat ? seat->index : 0;
+
+	if (state->opts.latency) {
+		latency_record(state, ev);
+	}
+	if (state->opts.present) {
+		present_input(state, ev);
+	}
+	if (state->opts.pointer_rate_interval && seat) {
+		pointer_rate_record(state, seat, ev);
+	}
+	if (state->opts.stats_interval && !(flags & WEV_EVENT_HIDDEN)) {
+		++state->stats_total[iface][opcode];
+		if (seat) {
+			++seat->stats_total;
+		}
+	}
+	if (state->opts.publish && !(flags & WEV_EVENT_HIDDEN)) {
+		publish_append(&state->publish, ev);
+	}
+	if (state->opts.record) {
+		if (!trace_append(&state->trace, ev)) {
+			fprintf(stderr, "Failed to write trace: %s\n", strerror(errno));
+			state->closed = true;
+		}
+	} else if (state->opts.flight) {
+		flight_record(state, seat, ev);
+	} else if (state->opts.pointer_rate_interval) {
+		// Only summarized
+	} else if (state->opts.threaded) {
+		ring_push(&state->ring, ev);
+	} else {
+		print_event(state, ev);
+	}
+}
+
+/* Like event_record, for the arguments a listener was called with */
+static void event_vemit(struct wev_state *state, struct wev_seat *seat,
+		struct wl_proxy *proxy, enum wev_interface iface, uint32_t opcode,
+		const char *signature, va_list ap) {
+	union wl_argument args[WEV_EVENT_MAX_ARGS];
+	for (int i = 0; signature[i] && i < WEV_EVENT_MAX_ARGS; ++i) {
+		switch (signature[i]) {
+		case 'i':
+		case 'f':
+			args[i].i = va_arg(ap, int32_t);
+			break;
+		case 'u':
+			args[i].u = va_arg(ap, uint32_t);
+			break;
+		case 'o':
+			args[i].o = va_arg(ap, struct wl_object *);
+			break;
+		case 's':
+			args[i].s = va_arg(ap, const char *);
+			break;
+		case 'a':
+			args[i].a = va_arg(ap, struct wl_array *);
+			break;
+		default:
+			abort();
+		}
+	}
+	event_record(state, seat, proxy, iface, opcode, signature, args);
+}
+
+static void event_emit(struct wev_state *state, struct wl_proxy *proxy,
+		enum wev_interface iface, uint32_t opcode,
+		const char *signature, ...) {
+	va_list ap;
+	va_start(ap, signature);
+	event_vemit(state, NULL, proxy, iface, opcode, signature, ap);
+	va_end(ap);
+}
+
+static void seat_emit(struct wev_seat *seat, struct wl_proxy *proxy,
+		enum wev_interface iface, uint32_t opcode,
+		const char *signature, ...) {
+	va_list ap;
+	va_start(ap, signature);
+	event_vemit(seat->state, seat, proxy, iface, opcode, signature, ap);
+	va_end(ap);
+}
+
+static const char *pointer_button_str(uint32_t button) {
+	switch (button) {
+	case BTN_LEFT:
+		return "left";
+	case BTN_RIGHT:
+		return "right";
+	case BTN_MIDDLE:
+		return "middle";
+	case BTN_SIDE:
+		return "side";
+	case BTN_EXTRA:
+		return "extra";
+	case BTN_FORWARD:
+		return "forward";
+	case BTN_BACK:
+		return "back";
+	case BTN_TASK:
+		return "task";
+	default:
+		return "unknown";
+	}
+}
+
+static const char *pointer_state_str(uint32_t state) {
+	switch (state) {
+	case WL_POINTER_BUTTON_STATE_RELEASED:
+		return "released";
+	case WL_POINTER_BUTTON_STATE_PRESSED:
+		return "pressed";
+	default:
+		return "unknown state";
+	}
+}
+
+static const char *pointer_axis_str(uint32_t axis) {
+	switch (axis) {
+	case WL_POINTER_AXIS_VERTICAL_SCROLL:
+		return "vertical";
+	case WL_POINTER_AXIS_HORIZONTAL_SCROLL:
+		return "horizontal";
+	default:
+		return "unknown";
+	}
+}
+
+static const char *pointer_axis_source_str(uint32_t axis_source) {
+	switch (axis_source) {
+	case WL_POINTER_AXIS_SOURCE_WHEEL:
+		return "wheel";
+	case WL_POINTER_AXIS_SOURCE_FINGER:
+		return "finger";
+	case WL_POINTER_AXIS_SOURCE_CONTINUOUS:
+		return "continuous";
+	case WL_POINTER_AXIS_SOURCE_WHEEL_TILT:
+		return "wheel tilt";
+	default:
+		return "unknown";
+	}
+}
+
+static void print_pointer_frame(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	struct wev_pointer_frame *frame = &state->seat->pointer_frame;
+	event_prefix(state, ev);
+	output_lit(out, ": ");
+	output_uint(out, frame->events);
+	output_str(out, frame->events == 1 ? " event" : " events");
+	if (frame->has_time) {
+		output_lit(out, "; time: ");
+		print_time(state, frame->time, frame->time_ns);
+	}
+	if (frame->enter) {
+		output_lit(out, "; enter: surface: ");
+		output_int(out, frame->surface);
+	}
+	if (frame->enter || frame->motion) {
+		output_lit(out, "; x, y: ");
+		output_fixed(out, frame->x);
+		output_lit(out, ", ");
+		output_fixed(out, frame->y);
+	}
+	if (frame->motion) {
+		output_lit(out, "; dx, dy: ");
+		output_fixed(out, frame->dx);
+		output_lit(out, ", ");
+		output_fixed(out, frame->dy);
+	}
+	for (uint32_t i = 0; i < frame->button_count; ++i) {
+		output_lit(out, "; button: ");
+		output_int(out, frame->buttons[i].button);
+		output_lit(out, " (");
+		output_str(out, pointer_button_str(frame->buttons[i].button));
+		output_lit(out, ") ");
+		output_str(out, pointer_state_str(frame->buttons[i].state));
+	}
+	if (frame->has_source) {
+		output_lit(out, "; source: ");
+		output_str(out, pointer_axis_source_str(frame->source));
+	}
+	for (uint32_t axis = 0; axis < 2; ++axis) {
+		uint32_t bit = 1u << axis;
+		if (!((frame->axes | frame->discrete_axes) & bit)) {
+			continue;
+		}
+		output_lit(out, "; ");
+		output_str(out, pointer_axis_str(axis));
+		output_lit(out, ": ");
+		output_fixed(out, frame->axis_value[axis]);
+		if (frame->discrete_axes & bit) {
+			output_lit(out, ", discrete: ");
+			output_int(out, frame->axis_discrete[axis]);
+		}
+	}
+	for (uint32_t axis = 0; axis < 2; ++axis) {
+		if (frame->stopped_axes & (1u << axis)) {
+			output_lit(out, "; stop: ");
+			output_str(out, pointer_axis_str(axis));
+		}
+	}
+	if (frame->leave) {
+		output_lit(out, "; leave");
+	}
+	output_char(out, '\n');
+}
+
+/* Folds a pointer event into the current frame, for --frames */
+static void pointer_frame_add(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_seat_state *seat = state->seat;
+	struct wev_pointer_frame *frame = &seat->pointer_frame;
+	const union wev_arg *arg = ev->args;
+	if (ev->opcode == WEV_WL_POINTER_FRAME) {
+		if (frame->events > 0 || event_visible(state, ev)) {
+			print_pointer_frame(state, ev);
+		}
+		memset(frame, 0, sizeof(*frame));
+		return;
+	}
+	if (!event_visible(state, ev)) {
+		if (ev->opcode == WEV_WL_POINTER_ENTER) {
+			seat->pointer_x = arg[2].i;
+			seat->pointer_y = arg[3].i;
+		}
+		return;
+	}
+
+	++frame->events;
+	int time_arg = event_time_arg(ev);
+	if (time_arg >= 0) {
+		frame->has_time = true;
+		frame->time = arg[time_arg].u;
+		frame->time_ns = state->event_ns;
+	}
+	uint32_t axis;
+	switch (ev->opcode) {
+	case WEV_WL_POINTER_ENTER:
+		frame->enter = true;
+		frame->surface = arg[1].u;
+		frame->x = seat->pointer_x = arg[2].i;
+		frame->y = seat->pointer_y = arg[3].i;
+		break;
+	case WEV_WL_POINTER_LEAVE:
+		frame->leave = true;
+		break;
+	case WEV_WL_POINTER_MOTION:
+		frame->motion = true;
+		frame->dx += arg[1].i - seat->pointer_x;
+		frame->dy += arg[2].i - seat->pointer_y;
+		frame->x = seat->pointer_x = arg[1].i;
+		frame->y = seat->pointer_y = arg[2].i;
+		break;
+	case WEV_WL_POINTER_BUTTON:
+		if (frame->button_count < WEV_POINTER_FRAME_BUTTONS) {
+			frame->buttons[frame->button_count].button = arg[2].u;
+			frame->buttons[frame->button_count].state = arg[3].u;
+			++frame->button_count;
+		}
+		break;
+	case WEV_WL_POINTER_AXIS:
+		if ((axis = arg[1].u) < 2) {
+			frame->axes |= 1u << axis;
+			frame->axis_value[axis] += arg[2].i;
+		}
+		break;
+	case WEV_WL_POINTER_AXIS_SOURCE:
+		frame->has_source = true;
+		frame->source = arg[0].u;
+		break;
+	case WEV_WL_POINTER_AXIS_STOP:
+		if ((axis = arg[1].u) < 2) {
+			frame->stopped_axes |= 1u << axis;
+		}
+		break;
+	case WEV_WL_POINTER_AXIS_DISCRETE:
+		if ((axis = arg[0].u) < 2) {
+			frame->discrete_axes |= 1u << axis;
+			frame->axis_discrete[axis] += arg[1].i;
+		}
+		break;
+	}
+}
+
+static void print_wl_pointer(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const union wev_arg *arg = ev->args;
+	if (state->opts.frames) {
+		pointer_frame_add(state, ev);
+		return;
+	}
+	switch (ev->opcode) {
+	case WEV_WL_POINTER_ENTER:
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; surface: ");
+			output_int(out, arg[1].i);
+			output_lit(out, ", x, y: ");
+			output_fixed(out, arg[2].i);
+			output_lit(out, ", ");
+			output_fixed(out, arg[3].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_POINTER_LEAVE:
+		if (event_log(state, ev)) {
+			output_lit(out, ": surface: ");
+			output_int(out, arg[1].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_POINTER_MOTION:
+		if (event_log(state, ev)) {
+			output_lit(out, ": time: ");
+			print_time(state, arg[0].u, state->event_ns);
+			output_lit(out, "; x, y: ");
+			output_fixed(out, arg[1].i);
+			output_lit(out, ", ");
+			output_fixed(out, arg[2].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_POINTER_BUTTON:
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; time: ");
+			print_time(state, arg[1].u, state->event_ns);
+			output_lit(out, "; button: ");
+			output_int(out, arg[2].i);
+			output_lit(out, " (");
+			output_str(out, pointer_button_str(arg[2].u));
+			output_lit(out, "), state: ");
+			output_int(out, arg[3].i);
+			output_lit(out, " (");
+			output_str(out, pointer_state_str(arg[3].u));
+			output_lit(out, ")\n");
+		}
+		break;
+	case WEV_WL_POINTER_AXIS:
+		if (event_log(state, ev)) {
+			output_lit(out, ": time: ");
+			print_time(state, arg[0].u, state->event_ns);
+			output_lit(out, "; axis: ");
+			output_int(out, arg[1].i);
+			output_lit(out, " (");
+			output_str(out, pointer_axis_str(arg[1].u));
+			output_lit(out, "), value: ");
+			output_fixed(out, arg[2].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_POINTER_FRAME:
+		if (event_log(state, ev)) {
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_POINTER_AXIS_SOURCE:
+		if (event_log(state, ev)) {
+			output_lit(out, ": ");
+			output_int(out, arg[0].i);
+			output_lit(out, " (");
+			output_str(out, pointer_axis_source_str(arg[0].u));
+			output_lit(out, ")\n");
+		}
+		break;
+	case WEV_WL_POINTER_AXIS_STOP:
+		if (event_log(state, ev)) {
+			output_lit(out, ": time: ");
+			print_time(state, arg[0].u, state->event_ns);
+			output_lit(out, "; axis: ");
+			output_int(out, arg[1].i);
+			output_lit(out, " (");
+			output_str(out, pointer_axis_str(arg[1].u));
+			output_lit(out, ")\n");
+		}
+		break;
+	case WEV_WL_POINTER_AXIS_DISCRETE:
+		if (event_log(state, ev)) {
+			output_lit(out, ": axis: ");
+			output_int(out, arg[0].i);
+			output_lit(out, " (");
+			output_str(out, pointer_axis_str(arg[0].u));
+			output_lit(out, "), discrete: ");
+			output_int(out, arg[1].i);
+			output_char(out, '\n');
+		}
+		break;
+	}
+}
+
+static void wl_pointer_enter(void *data, struct wl_pointer *wl_pointer,
+		uint32_t serial, struct wl_surface *surface,
+		wl_fixed_t surface_x, wl_fixed_t surface_y) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_pointer,
+			WEV_WL_POINTER, WEV_WL_POINTER_ENTER, "uoff",
+			serial, surface, surface_x, surface_y);
+}
+
+static void wl_pointer_leave(void *data, struct wl_pointer *wl_pointer,
+		uint32_t serial, struct wl_surface *surface) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_pointer,
+			WEV_WL_POINTER, WEV_WL_POINTER_LEAVE, "uo",
+			serial, surface);
+}
+
+static void wl_pointer_motion(void *data, struct wl_pointer *wl_pointer,
+		uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_pointer,
+			WEV_WL_POINTER, WEV_WL_POINTER_MOTION, "uff",
+			time, surface_x, surface_y);
+}
+
+static void wl_pointer_button(void *data, struct wl_pointer *wl_pointer,
+		uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_pointer,
+			WEV_WL_POINTER, WEV_WL_POINTER_BUTTON, "uuuu",
+			serial, time, button, state);
+}
+
+static void wl_pointer_axis(void *data, struct wl_pointer *wl_pointer,
+		uint32_t time, uint32_t axis, wl_fixed_t value) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_pointer,
+			WEV_WL_POINTER, WEV_WL_POINTER_AXIS, "uuf",
+			time, axis, value);
+}
+
+static void wl_pointer_frame(void *data, struct wl_pointer *wl_pointer) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_pointer,
+			WEV_WL_POINTER, WEV_WL_POINTER_FRAME, "");
+}
+
+static void wl_pointer_axis_source(void *data, struct wl_pointer *wl_pointer,
+		uint32_t axis_source) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_pointer,
+			WEV_WL_POINTER, WEV_WL_POINTER_AXIS_SOURCE, "u",
+			axis_source);
+}
+
+static void wl_pointer_axis_stop(void *data, struct wl_pointer *wl_pointer,
+		uint32_t time, uint32_t axis) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_pointer,
+			WEV_WL_POINTER, WEV_WL_POINTER_AXIS_STOP, "uu",
+			time, axis);
+}
+
+static void wl_pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer,
+		uint32_t axis, int32_t discrete) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_pointer,
+			WEV_WL_POINTER, WEV_WL_POINTER_AXIS_DISCRETE, "ui",
+			axis, discrete);
+}
+
+static const struct wl_pointer_listener wl_pointer_listener = {
+	.enter = wl_pointer_enter,
+	.leave = wl_pointer_leave,
+	.motion = wl_pointer_motion,
+	.button = wl_pointer_button,
+	.axis = wl_pointer_axis,
+	.frame = wl_pointer_frame,
+	.axis_source = wl_pointer_axis_source,
+	.axis_stop = wl_pointer_axis_stop,
+	.axis_discrete = wl_pointer_axis_discrete,
+};
+
+static void print_zwp_relative_pointer_v1(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const union wev_arg *arg = ev->args;
+	if (event_log(state, ev)) {
+		output_lit(out, ": utime: ");
+		output_uint64(out, (uint64_t)arg[0].u << 32 | arg[1].u);
+		output_lit(out, " us; dx, dy: ");
+		output_fixed(out, arg[2].i);
+		output_lit(out, ", ");
+		output_fixed(out, arg[3].i);
+		output_lit(out, "; unaccelerated: ");
+		output_fixed(out, arg[4].i);
+		output_lit(out, ", ");
+		output_fixed(out, arg[5].i);
+		output_char(out, '\n');
+	}
+}
+
+static void relative_pointer_motion(void *data,
+		struct zwp_relative_pointer_v1 *relative_pointer,
+		uint32_t utime_hi, uint32_t utime_lo, wl_fixed_t dx, wl_fixed_t dy,
+		wl_fixed_t dx_unaccel, wl_fixed_t dy_unaccel) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)relative_pointer,
+			WEV_ZWP_RELATIVE_POINTER_V1,
+			WEV_ZWP_RELATIVE_POINTER_V1_RELATIVE_MOTION, "uuffff",
+			utime_hi, utime_lo, dx, dy, dx_unaccel, dy_unaccel);
+}
+
+static const struct zwp_relative_pointer_v1_listener relative_pointer_listener = {
+	.relative_motion = relative_pointer_motion,
+};
+
+static void print_zwp_locked_pointer_v1(struct wev_state *state,
+		const struct wev_event *ev) {
+	if (event_log(state, ev)) {
+		output_char(&state->out, '\n');
+	}
+}
+
+static void locked_pointer_locked(void *data,
+		struct zwp_locked_pointer_v1 *locked_pointer) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)locked_pointer,
+			WEV_ZWP_LOCKED_POINTER_V1, WEV_ZWP_LOCKED_POINTER_V1_LOCKED, "");
+}
+
+static void locked_pointer_unlocked(void *data,
+		struct zwp_locked_pointer_v1 *locked_pointer) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)locked_pointer,
+			WEV_ZWP_LOCKED_POINTER_V1, WEV_ZWP_LOCKED_POINTER_V1_UNLOCKED, "");
+}
+
+static const struct zwp_locked_pointer_v1_listener locked_pointer_listener = {
+	.locked = locked_pointer_locked,
+	.unlocked = locked_pointer_unlocked,
+};
+
+static const char *keymap_format_str(uint32_t format) {
+	switch (format) {
+	case WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP:
+		return "none";
+	case WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1:
+		return "xkb v1";
+	default:
+		return "unknown";
+	}
+}
+
+static const char *key_state_str(uint32_t state) {
+	switch (state) {
+	case WL_KEYBOARD_KEY_STATE_RELEASED:
+		return "released";
+	case WL_KEYBOARD_KEY_STATE_PRESSED:
+		return "pressed";
+	default:
+		return "unknown";
+	}
+}
+
+static void print_modifiers(struct wev_state *state,
+		const char *name, uint32_t mods) {
+	struct wev_output *out = &state->out;
+	struct wev_seat_state *seat = state->seat;
+	output_lit(out, SPACER);
+	output_str(out, name);
+	output_lit(out, ": ");
+	output_hex_pad(out, mods, 8);
+	if (mods != 0) {
+		output_lit(out, ": ");
+	}
+	for (int i = 0; seat->xkb_keymap && i < 32; ++i) {
 		if ((mods >> i) & 1) {
-			printf("%s ", xkb_keymap_mod_get_name(state->xkb_keymap, i));
+			output_str(out, xkb_keymap_mod_get_name(seat->xkb_keymap, i));
+			output_char(out, ' ');
+		}
+	}
+	output_char(out, '\n');
+}
+
+static void print_keymap(struct wev_state *state, const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	uint32_t format = ev->args[0].u;
+	if (event_log(state, ev)) {
+		output_lit(out, ": format: ");
+		output_int(out, format);
+		output_lit(out, " (");
+		output_str(out, keymap_format_str(format));
+		output_lit(out, "), size: ");
+		output_int(out, ev->args[1].i);
+		output_char(out, '\n');
+	}
+}
+
+/* Tracks the keymap and modifiers which keys are translated with */
+static void keyboard_update(struct wev_state *state,
+		const struct wev_event *ev) {
+	const union wev_arg *arg = ev->args;
+	struct wev_seat_state *seat = state->seat;
+	if (ev->opcode == WEV_WL_KEYBOARD_MODIFIERS) {
+		if (!seat->xkb_state) {
+			return;
+		}
+		xkb_state_update_mask(seat->xkb_state,
+			arg[1].u, arg[2].u, arg[3].u, 0, 0, arg[4].u);
+		// Keys are cached per modifiers and layout, so no need to flush
+		seat->xkb_mods = xkb_state_serialize_mods(seat->xkb_state,
+				XKB_STATE_MODS_EFFECTIVE);
+		seat->xkb_layout = xkb_state_serialize_layout(seat->xkb_state,
+				XKB_STATE_LAYOUT_EFFECTIVE);
+		return;
+	}
+	if (ev->opcode != WEV_WL_KEYBOARD_KEYMAP) {
+		return;
+	}
+
+	uint32_t format = arg[0].u;
+	uint32_t size;
+	const char *map = wev_event_array(ev, 2, &size);
+	if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1 || size == 0) {
+		return;
+	}
+
+	struct xkb_keymap *keymap = keymap_cache_get(&state->keymap_cache,
+			state->xkb_context, map, size);
+	if (!keymap) {
+		fprintf(stderr, "Failed to compile keymap\n");
+		return;
+	}
+	seat->xkb_mods = 0;
+	seat->xkb_layout = 0;
+	if (keymap == seat->xkb_keymap) {
+		// Resent unchanged, as compositors do on focus changes
+		xkb_state_update_mask(seat->xkb_state, 0, 0, 0, 0, 0, 0);
+		return;
+	}
+
+	struct xkb_state *xkb_state = xkb_state_new(keymap);
+	xkb_keymap_unref(seat->xkb_keymap);
+	xkb_state_unref(seat->xkb_state);
+	seat->xkb_keymap = xkb_keymap_ref(keymap);
+	seat->xkb_state = xkb_state;
+	keycache_invalidate(&seat->keycache);
+}
+
+static void print_key_sym(struct wev_state *state,
+		xkb_keycode_t keycode, bool pressed) {
+	struct wev_output *out = &state->out;
+	struct wev_seat_state *seat = state->seat;
+	if (!seat->xkb_state) {
+		// Subscribed after the keymap was sent
+		return;
+	}
+	const struct wev_keycache_entry *key = keycache_get(&seat->keycache,
+			seat->xkb_state, keycode, seat->xkb_mods, seat->xkb_layout);
+	output_lit(out, SPACER "sym: ");
+	output_write(out, key->sym_text, key->sym_len);
+	output_lit(out, ", utf8: '");
+	if (pressed) {
+		output_write(out, key->utf8, key->utf8_len);
+	}
+	output_lit(out, "'\n");
+}
+
+static void print_wl_keyboard(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const union wev_arg *arg = ev->args;
+	switch (ev->opcode) {
+	case WEV_WL_KEYBOARD_KEYMAP:
+		print_keymap(state, ev);
+		keyboard_update(state, ev);
+		break;
+	case WEV_WL_KEYBOARD_ENTER:
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; surface: ");
+			output_int(out, arg[1].i);
+			output_char(out, '\n');
+			uint32_t size;
+			const uint32_t *keys = wev_event_array(ev, 2, &size);
+			for (size_t i = 0; i < size / sizeof(*keys); ++i) {
+				print_key_sym(state, keys[i] + 8, true);
+			}
+		}
+		break;
+	case WEV_WL_KEYBOARD_LEAVE:
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; surface: ");
+			output_int(out, arg[1].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_KEYBOARD_KEY:;
+		uint32_t key = arg[2].u, key_state = arg[3].u;
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; time: ");
+			print_time(state, arg[1].u, state->event_ns);
+			output_lit(out, "; key: ");
+			output_int(out, key + 8);
+			output_lit(out, "; state: ");
+			output_int(out, key_state);
+			output_lit(out, " (");
+			output_str(out, key_state_str(key_state));
+			output_lit(out, ")\n");
+			print_key_sym(state, key + 8,
+					key_state == WL_KEYBOARD_KEY_STATE_PRESSED);
+		}
+		break;
+	case WEV_WL_KEYBOARD_MODIFIERS:;
+		uint32_t depressed = arg[1].u, latched = arg[2].u, locked = arg[3].u;
+		uint32_t group = arg[4].u;
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; group: ");
+			output_int(out, group);
+			output_char(out, '\n');
+			print_modifiers(state, "depressed", depressed);
+			print_modifiers(state, "latched", latched);
+			print_modifiers(state, "locked", locked);
+		}
+		keyboard_update(state, ev);
+		break;
+	case WEV_WL_KEYBOARD_REPEAT_INFO:
+		if (event_log(state, ev)) {
+			output_lit(out, ": rate: ");
+			output_int(out, arg[0].i);
+			output_lit(out, " keys/sec; delay: ");
+			output_int(out, arg[1].i);
+			output_lit(out, " ms\n");
+		}
+		break;
+	}
+}
+
+static void wl_keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard,
+		uint32_t format, int32_t fd, uint32_t size) {
+	struct wev_seat *seat = data;
+	struct wev_state *state = seat->state;
+	struct wl_array keymap = { 0 };
+	char *map_shm = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map_shm == MAP_FAILED) {
+		fprintf(stderr, "Unable to mmap keymap: %s", strerror(errno));
+	} else {
+		if (state->opts.dump_map &&
+				keymap_dump(state->opts.dump_map, fd, map_shm, size) < 0) {
+			fprintf(stderr, "Failed to write keymap to %s: %s\n",
+					state->opts.dump_map, strerror(errno));
+		}
+		if (format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
+			keymap.data = map_shm;
+			keymap.size = size;
+		}
+	}
+
+	// The keymap text is recorded too, so traces can be decoded elsewhere
+	seat_emit(seat, (struct wl_proxy *)wl_keyboard,
+			WEV_WL_KEYBOARD, WEV_WL_KEYBOARD_KEYMAP, "uua",
+			format, size, &keymap);
+
+	if (map_shm != MAP_FAILED) {
+		munmap(map_shm, size);
+	}
+	close(fd);
+}
+
+static void wl_keyboard_enter(void *data, struct wl_keyboard *wl_keyboard,
+		uint32_t serial, struct wl_surface *surface, struct wl_array *keys) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_keyboard,
+			WEV_WL_KEYBOARD, WEV_WL_KEYBOARD_ENTER, "uoa",
+			serial, surface, keys);
+}
+
+static void wl_keyboard_leave(void *data, struct wl_keyboard *wl_keyboard,
+		uint32_t serial, struct wl_surface *surface) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_keyboard,
+			WEV_WL_KEYBOARD, WEV_WL_KEYBOARD_LEAVE, "uo",
+			serial, surface);
+}
+
+static void wl_keyboard_key(void *data, struct wl_keyboard *wl_keyboard,
+		uint32_t serial, uint32_t time, uint32_t key, uint32_t state) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_keyboard,
+			WEV_WL_KEYBOARD, WEV_WL_KEYBOARD_KEY, "uuuu",
+			serial, time, key, state);
+	if (seat->locked_pointer && key == KEY_ESC &&
+			state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+		zwp_locked_pointer_v1_destroy(seat->locked_pointer);
+		seat->locked_pointer = NULL;
+	}
+}
+
+static void wl_keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard,
+		uint32_t serial, uint32_t mods_depressed, uint32_t mods_latched,
+		uint32_t mods_locked, uint32_t group) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_keyboard,
+			WEV_WL_KEYBOARD, WEV_WL_KEYBOARD_MODIFIERS, "uuuuu",
+			serial, mods_depressed, mods_latched, mods_locked, group);
+}
+
+static void wl_keyboard_repeat_info(void *data, struct wl_keyboard *wl_keyboard,
+		int32_t rate, int32_t delay) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_keyboard,
+			WEV_WL_KEYBOARD, WEV_WL_KEYBOARD_REPEAT_INFO, "ii",
+			rate, delay);
+}
+
+static const struct wl_keyboard_listener wl_keyboard_listener = {
+	.keymap = wl_keyboard_keymap,
+	.enter = wl_keyboard_enter,
+	.leave = wl_keyboard_leave,
+	.key = wl_keyboard_key,
+	.modifiers = wl_keyboard_modifiers,
+	.repeat_info = wl_keyboard_repeat_info,
+};
+
+static void print_touch_frame(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	struct wev_touch_frame *frame = &state->seat->touch_frame;
+	event_prefix(state, ev);
+	output_lit(out, ": ");
+	output_uint(out, frame->events);
+	output_str(out, frame->events == 1 ? " event" : " events");
+	if (frame->has_time) {
+		output_lit(out, "; time: ");
+		print_time(state, frame->time, frame->time_ns);
+	}
+	for (size_t i = 0; i < WEV_TOUCH_POINTS; ++i) {
+		const struct wev_touch_point *point = &frame->points[i];
+		uint32_t changes = point->changes;
+		if (!changes) {
+			continue;
+		}
+		output_lit(out, "; id ");
+		output_int(out, point->id);
+		output_char(out, ':');
+		if (changes & (1u << WEV_WL_TOUCH_DOWN)) {
+			output_lit(out, " down");
+		}
+		if (changes & (1u << WEV_WL_TOUCH_MOTION)) {
+			output_lit(out, " motion");
+		}
+		if (changes & (1u << WEV_WL_TOUCH_UP)) {
+			output_lit(out, " up");
+		}
+		if (changes & (1u << WEV_WL_TOUCH_DOWN | 1u << WEV_WL_TOUCH_MOTION)) {
+			output_lit(out, " x, y: ");
+			output_fixed(out, point->x);
+			output_lit(out, ", ");
+			output_fixed(out, point->y);
+		}
+		if (changes & (1u << WEV_WL_TOUCH_MOTION)) {
+			output_lit(out, " dx, dy: ");
+			output_fixed(out, point->dx);
+			output_lit(out, ", ");
+			output_fixed(out, point->dy);
+		}
+		if (changes & (1u << WEV_WL_TOUCH_SHAPE)) {
+			output_lit(out, " major, minor: ");
+			output_fixed(out, point->major);
+			output_lit(out, ", ");
+			output_fixed(out, point->minor);
+		}
+		if (changes & (1u << WEV_WL_TOUCH_ORIENTATION)) {
+			output_lit(out, " orientation: ");
+			output_fixed(out, point->orientation);
+		}
+	}
+	output_char(out, '\n');
+}
+
+static struct wev_touch_point *touch_frame_point(
+		struct wev_touch_frame *frame, int32_t id) {
+	struct wev_touch_point *unused = NULL;
+	for (size_t i = 0; i < WEV_TOUCH_POINTS; ++i) {
+		struct wev_touch_point *point = &frame->points[i];
+		if (point->down || point->changes) {
+			if (point->id == id) {
+				return point;
+			}
+		} else if (!unused) {
+			unused = point;
+		}
+	}
+	if (unused) {
+		memset(unused, 0, sizeof(*unused));
+		unused->id = id;
+	}
+	return unused;
+}
+
+/* Folds a touch event into the current frame, for --frames */
+static void touch_frame_add(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_touch_frame *frame = &state->seat->touch_frame;
+	const union wev_arg *arg = ev->args;
+	if (ev->opcode == WEV_WL_TOUCH_FRAME) {
+		if (frame->events > 0 || event_visible(state, ev)) {
+			print_touch_frame(state, ev);
+		}
+		frame->events = 0;
+		frame->has_time = false;
+		for (size_t i = 0; i < WEV_TOUCH_POINTS; ++i) {
+			frame->points[i].changes = 0;
+			frame->points[i].dx = frame->points[i].dy = 0;
+		}
+		return;
+	}
+	if (ev->opcode == WEV_WL_TOUCH_CANCEL) {
+		memset(frame, 0, sizeof(*frame));
+		if (event_log(state, ev)) {
+			output_char(&state->out, '\n');
+		}
+		return;
+	}
+	bool visible = event_visible(state, ev);
+	if (!visible && ev->opcode != WEV_WL_TOUCH_DOWN &&
+			ev->opcode != WEV_WL_TOUCH_UP) {
+		return;
+	}
+
+	int time_arg = event_time_arg(ev);
+	if (visible && time_arg >= 0) {
+		frame->has_time = true;
+		frame->time = arg[time_arg].u;
+		frame->time_ns = state->event_ns;
+	}
+	struct wev_touch_point *point;
+	switch (ev->opcode) {
+	case WEV_WL_TOUCH_DOWN:
+		if ((point = touch_frame_point(frame, arg[3].i))) {
+			point->down = true;
+			point->x = arg[4].i;
+			point->y = arg[5].i;
+		}
+		break;
+	case WEV_WL_TOUCH_UP:
+		if ((point = touch_frame_point(frame, arg[2].i))) {
+			point->down = false;
+		}
+		break;
+	case WEV_WL_TOUCH_MOTION:
+		if ((point = touch_frame_point(frame, arg[1].i))) {
+			point->dx += arg[2].i - point->x;
+			point->dy += arg[3].i - point->y;
+			point->x = arg[2].i;
+			point->y = arg[3].i;
+		}
+		break;
+	case WEV_WL_TOUCH_SHAPE:
+		if ((point = touch_frame_point(frame, arg[0].i))) {
+			point->major = arg[1].i;
+			point->minor = arg[2].i;
+		}
+		break;
+	case WEV_WL_TOUCH_ORIENTATION:
+		if ((point = touch_frame_point(frame, arg[0].i))) {
+			point->orientation = arg[1].i;
+		}
+		break;
+	default:
+		return;
+	}
+	if (visible) {
+		++frame->events;
+		if (point) {
+			point->changes |= 1u << ev->opcode;
+		}
+	}
+}
+
+static void print_duration(struct wev_output *out, uint64_t ns) {
+	output_uint64(out, ns / 1000000);
+	output_char(out, '.');
+	output_uint_pad(out, ns / 1000 % 1000, 3);
+	output_lit(out, " ms");
+}
+
+/* Like %.1f */
+static void print_tenths(struct wev_output *out, double v) {
+	uint64_t tenths = v * 10 + 0.5;
+	output_uint64(out, tenths / 10);
+	output_char(out, '.');
+	output_char(out, '0' + tenths % 10);
+}
+
+static void print_hz(struct wev_output *out, double hz) {
+	print_tenths(out, hz);
+	output_lit(out, " Hz");
+}
+
+static struct wev_touch_contact *touch_contact_find(
+		struct wev_seat_state *seat, int32_t id) {
+	for (size_t i = 0; i < WEV_TOUCH_POINTS; ++i) {
+		if (seat->contacts[i].down && seat->contacts[i].id == id) {
+			return &seat->contacts[i];
+		}
+	}
+	return NULL;
+}
+
+/* Writes how long a contact was down, and how often it moved meanwhile */
+static void print_touch_contact(struct wev_state *state,
+		const struct wev_touch_contact *contact) {
+	struct wev_output *out = &state->out;
+	uint64_t lifetime = contact->last_ns - contact->down_ns;
+	output_lit(out, "id: ");
+	output_int(out, contact->id);
+	output_lit(out, "; lifetime: ");
+	print_duration(out, lifetime);
+	output_lit(out, "; motions: ");
+	output_uint(out, contact->motions);
+	if (lifetime > 0) {
+		output_lit(out, " (");
+		print_hz(out, contact->motions * 1e9 / lifetime);
+		output_char(out, ')');
+	}
+	output_lit(out, "; path: ");
+	print_tenths(out, contact->path);
+	output_char(out, '\n');
+}
+
+/*
+ * Tracks each touch point from down to up, for --touch-contacts. Motion
+ * events are only counted, and frames summarized; returns false for the
+ * events which are printed as usual.
+ */
+static bool touch_contacts_add(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	struct wev_seat_state *seat = state->seat;
+	const union wev_arg *arg = ev->args;
+	int time_arg = event_time_arg(ev);
+	if (time_arg >= 0) {
+		seat->touch_ns = state->event_ns ? state->event_ns :
+			(uint64_t)arg[time_arg].u * 1000000;
+	}
+	uint64_t ns = seat->touch_ns;
+	struct wev_touch_contact *contact;
+	switch (ev->opcode) {
+	case WEV_WL_TOUCH_DOWN:
+		contact = touch_contact_find(seat, arg[3].i);
+		bool again = contact != NULL;
+		for (size_t i = 0; !contact && i < WEV_TOUCH_POINTS; ++i) {
+			if (!seat->contacts[i].down) {
+				contact = &seat->contacts[i];
+			}
+		}
+		if (contact) {
+			*contact = (struct wev_touch_contact){
+				.id = arg[3].i,
+				.down = true,
+				.down_ns = ns,
+				.last_ns = ns,
+				.x = arg[4].i,
+				.y = arg[5].i,
+			};
+			++state->touch_contacts;
+		}
+		state->touch_anomalies += again || !contact;
+		if (event_log(state, ev)) {
+			output_lit(out, ": id: ");
+			output_int(out, arg[3].i);
+			output_lit(out, "; x, y: ");
+			output_fixed(out, arg[4].i);
+			output_lit(out, ", ");
+			output_fixed(out, arg[5].i);
+			if (again) {
+				output_lit(out, "; already down");
+			} else if (!contact) {
+				output_lit(out, "; no free slot");
+			}
+			output_char(out, '\n');
+		}
+		return true;
+	case WEV_WL_TOUCH_MOTION:
+		if ((contact = touch_contact_find(seat, arg[1].i))) {
+			contact->path += hypot(wl_fixed_to_double(arg[2].i - contact->x),
+					wl_fixed_to_double(arg[3].i - contact->y));
+			contact->x = arg[2].i;
+			contact->y = arg[3].i;
+			contact->last_ns = ns;
+			++contact->motions;
+		} else {
+			++state->touch_anomalies;
+			if (event_log(state, ev)) {
+				output_lit(out, ": id: ");
+				output_int(out, arg[1].i);
+				output_lit(out, "; not down\n");
+			}
+		}
+		return true;
+	case WEV_WL_TOUCH_UP:
+		contact = touch_contact_find(seat, arg[2].i);
+		if (contact) {
+			contact->down = false;
+			contact->last_ns = ns;
+		} else {
+			++state->touch_anomalies;
+		}
+		if (event_log(state, ev)) {
+			output_lit(out, ": ");
+			if (contact) {
+				print_touch_contact(state, contact);
+			} else {
+				output_lit(out, "id: ");
+				output_int(out, arg[2].i);
+				output_lit(out, "; not down\n");
+			}
+		}
+		return true;
+	case WEV_WL_TOUCH_FRAME:
+		if (event_log(state, ev)) {
+			uint32_t count = 0;
+			double min_hz = INFINITY, max_hz = 0;
+			for (size_t i = 0; i < WEV_TOUCH_POINTS; ++i) {
+				contact = &seat->contacts[i];
+				if (!contact->down) {
+					continue;
+				}
+				++count;
+				if (ns > contact->down_ns) {
+					double hz = contact->motions * 1e9 / (ns - contact->down_ns);
+					min_hz = hz < min_hz ? hz : min_hz;
+					max_hz = hz > max_hz ? hz : max_hz;
+				}
+			}
+			output_lit(out, ": contacts: ");
+			output_uint(out, count);
+			if (min_hz <= max_hz) {
+				output_lit(out, "; updates: ");
+				print_hz(out, min_hz);
+				output_lit(out, " to ");
+				print_hz(out, max_hz);
+			}
+			output_char(out, '\n');
+		}
+		return true;
+	case WEV_WL_TOUCH_CANCEL:;
+		bool log = event_log(state, ev);
+		if (log) {
+			output_char(out, '\n');
+		}
+		for (size_t i = 0; i < WEV_TOUCH_POINTS; ++i) {
+			contact = &seat->contacts[i];
+			if (!contact->down) {
+				continue;
+			}
+			// Never to go up, as the compositor took them over
+			++state->touch_leaked;
+			contact->down = false;
+			contact->last_ns = ns;
+			if (log) {
+				output_lit(out, SPACER "leaked: ");
+				print_touch_contact(state, contact);
+			}
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void print_wl_touch(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const union wev_arg *arg = ev->args;
+	if (state->opts.touch_contacts) {
+		if (touch_contacts_add(state, ev)) {
+			return;
+		}
+	} else if (state->opts.frames) {
+		touch_frame_add(state, ev);
+		return;
+	}
+	switch (ev->opcode) {
+	case WEV_WL_TOUCH_DOWN:
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; time: ");
+			print_time(state, arg[1].u, state->event_ns);
+			output_lit(out, "; surface: ");
+			output_int(out, arg[2].i);
+			output_lit(out, "; id: ");
+			output_int(out, arg[3].i);
+			output_lit(out, "; x, y: ");
+			output_fixed(out, arg[4].i);
+			output_lit(out, ", ");
+			output_fixed(out, arg[5].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_TOUCH_UP:
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; time: ");
+			print_time(state, arg[1].u, state->event_ns);
+			output_lit(out, "; id: ");
+			output_int(out, arg[2].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_TOUCH_MOTION:
+		if (event_log(state, ev)) {
+			output_lit(out, ": time: ");
+			print_time(state, arg[0].u, state->event_ns);
+			output_lit(out, "; id: ");
+			output_int(out, arg[1].i);
+			output_lit(out, "; x, y: ");
+			output_fixed(out, arg[2].i);
+			output_lit(out, ", ");
+			output_fixed(out, arg[3].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_TOUCH_FRAME:
+		if (event_log(state, ev)) {
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_TOUCH_CANCEL:
+		if (event_log(state, ev)) {
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_TOUCH_SHAPE:
+		if (event_log(state, ev)) {
+			output_lit(out, ": id: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; major, minor: ");
+			output_fixed(out, arg[1].i);
+			output_lit(out, ", ");
+			output_fixed(out, arg[2].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_TOUCH_ORIENTATION:
+		if (event_log(state, ev)) {
+			output_lit(out, ": id: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; orientation: ");
+			output_fixed(out, arg[1].i);
+			output_char(out, '\n');
+		}
+		break;
+	}
+}
+
+void wl_touch_down(void *data, struct wl_touch *wl_touch,
+		uint32_t serial, uint32_t time, struct wl_surface *surface, int32_t id,
+		wl_fixed_t x, wl_fixed_t y) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_touch,
+			WEV_WL_TOUCH, WEV_WL_TOUCH_DOWN, "uuoiff",
+			serial, time, surface, id, x, y);
+}
+
+void wl_touch_up(void *data, struct wl_touch *wl_touch,
+		uint32_t serial, uint32_t time, int32_t id) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_touch,
+			WEV_WL_TOUCH, WEV_WL_TOUCH_UP, "uui",
+			serial, time, id);
+}
+
+void wl_touch_motion(void *data, struct wl_touch *wl_touch,
+		uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_touch,
+			WEV_WL_TOUCH, WEV_WL_TOUCH_MOTION, "uiff",
+			time, id, x, y);
+}
+
+void wl_touch_frame(void *data, struct wl_touch *wl_touch) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_touch,
+			WEV_WL_TOUCH, WEV_WL_TOUCH_FRAME, "");
+}
+
+void wl_touch_cancel(void *data, struct wl_touch *wl_touch) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_touch,
+			WEV_WL_TOUCH, WEV_WL_TOUCH_CANCEL, "");
+}
+
+void wl_touch_shape(void *data, struct wl_touch *wl_touch,
+		int32_t id, wl_fixed_t major, wl_fixed_t minor) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_touch,
+			WEV_WL_TOUCH, WEV_WL_TOUCH_SHAPE, "iff",
+			id, major, minor);
+}
+
+void wl_touch_orientation(void *data, struct wl_touch *wl_touch,
+		int32_t id, wl_fixed_t orientation) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_touch,
+			WEV_WL_TOUCH, WEV_WL_TOUCH_ORIENTATION, "if",
+			id, orientation);
+}
+
+static const struct wl_touch_listener wl_touch_listener = {
+	.down = wl_touch_down,
+	.up = wl_touch_up,
+	.motion = wl_touch_motion,
+	.frame = wl_touch_frame,
+	.cancel = wl_touch_cancel,
+	.shape = wl_touch_shape,
+	.orientation = wl_touch_orientation,
+};
+
+static void print_wl_seat(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	switch (ev->opcode) {
+	case WEV_WL_SEAT_CAPABILITIES:;
+		uint32_t capabilities = ev->args[0].u;
+		if (!event_log(state, ev)) {
+			break;
+		}
+		output_lit(out, ": ");
+		if (capabilities == 0) {
+			output_lit(out, " none");
+		}
+		if ((capabilities & WL_SEAT_CAPABILITY_POINTER)) {
+			output_lit(out, "pointer ");
+		}
+		if ((capabilities & WL_SEAT_CAPABILITY_KEYBOARD)) {
+			output_lit(out, "keyboard ");
+		}
+		if ((capabilities & WL_SEAT_CAPABILITY_TOUCH)) {
+			output_lit(out, "touch ");
+		}
+		output_char(out, '\n');
+		break;
+	case WEV_WL_SEAT_NAME:
+		if (event_log(state, ev)) {
+			output_lit(out, ": ");
+			output_str(out, wev_event_string(ev, 0));
+			output_char(out, '\n');
+		}
+		break;
+	}
+}
+
+static void input_timestamps_timestamp(void *data,
+		struct zwp_input_timestamps_v1 *timestamps,
+		uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) {
+	struct wl_proxy *device = data;
+	struct wev_seat *seat = wl_proxy_get_user_data(device);
+	seat_emit(seat, (struct wl_proxy *)timestamps,
+			WEV_ZWP_INPUT_TIMESTAMPS_V1, WEV_ZWP_INPUT_TIMESTAMPS_V1_TIMESTAMP,
+			"uuuo", tv_sec_hi, tv_sec_lo, tv_nsec, device);
+}
+
+static const struct zwp_input_timestamps_v1_listener input_timestamps_listener = {
+	.timestamp = input_timestamps_timestamp,
+};
+
+/* Destroys the objects wev made for the given capabilities of a seat */
+static void seat_release(struct wev_seat *seat, uint32_t capabilities) {
+	if ((capabilities & WL_SEAT_CAPABILITY_POINTER) && seat->pointer) {
+		if (seat->pointer_timestamps) {
+			zwp_input_timestamps_v1_destroy(seat->pointer_timestamps);
+			seat->pointer_timestamps = NULL;
+		}
+		if (seat->relative_pointer) {
+			zwp_relative_pointer_v1_destroy(seat->relative_pointer);
+			seat->relative_pointer = NULL;
+		}
+		if (seat->locked_pointer) {
+			zwp_locked_pointer_v1_destroy(seat->locked_pointer);
+			seat->locked_pointer = NULL;
+		}
+		wl_pointer_release(seat->pointer);
+		seat->pointer = NULL;
+	}
+	if ((capabilities & WL_SEAT_CAPABILITY_KEYBOARD) && seat->keyboard) {
+		if (seat->keyboard_timestamps) {
+			zwp_input_timestamps_v1_destroy(seat->keyboard_timestamps);
+			seat->keyboard_timestamps = NULL;
+		}
+		wl_keyboard_release(seat->keyboard);
+		seat->keyboard = NULL;
+	}
+	if ((capabilities & WL_SEAT_CAPABILITY_TOUCH) && seat->touch) {
+		if (seat->touch_timestamps) {
+			zwp_input_timestamps_v1_destroy(seat->touch_timestamps);
+			seat->touch_timestamps = NULL;
+		}
+		wl_touch_release(seat->touch);
+		seat->touch = NULL;
+	}
+}
+
+static void wl_seat_capabilities(void *data, struct wl_seat *wl_seat,
+		uint32_t capabilities) {
+	struct wev_seat *seat = data;
+	struct wev_state *state = seat->state;
+	struct zwp_input_timestamps_manager_v1 *manager = state->input_timestamps;
+	seat_emit(seat, (struct wl_proxy *)wl_seat,
+			WEV_WL_SEAT, WEV_WL_SEAT_CAPABILITIES, "u", capabilities);
+	// Devices come and go, as the compositor adds and removes capabilities
+	seat_release(seat, ~capabilities);
+	if ((capabilities & WL_SEAT_CAPABILITY_POINTER) && !seat->pointer) {
+		struct wl_pointer *pointer = wl_seat_get_pointer(wl_seat);
+		wl_pointer_add_listener(pointer, &wl_pointer_listener, seat);
+		seat->pointer = pointer;
+		if (manager) {
+			seat->pointer_timestamps =
+				zwp_input_timestamps_manager_v1_get_pointer_timestamps(
+					manager, pointer);
+			zwp_input_timestamps_v1_add_listener(seat->pointer_timestamps,
+					&input_timestamps_listener, pointer);
+		}
+		if (state->relative_pointer_manager) {
+			seat->relative_pointer =
+				zwp_relative_pointer_manager_v1_get_relative_pointer(
+					state->relative_pointer_manager, pointer);
+			zwp_relative_pointer_v1_add_listener(seat->relative_pointer,
+					&relative_pointer_listener, seat);
+		}
+		if (state->opts.lock_pointer && state->pointer_constraints) {
+			// Locked whenever the pointer is over the window, until Escape
+			seat->locked_pointer = zwp_pointer_constraints_v1_lock_pointer(
+					state->pointer_constraints, state->surface, pointer,
+					NULL, ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT);
+			zwp_locked_pointer_v1_add_listener(seat->locked_pointer,
+					&locked_pointer_listener, seat);
+		}
+	}
+	if ((capabilities & WL_SEAT_CAPABILITY_KEYBOARD) && !seat->keyboard) {
+		struct wl_keyboard *keyboard = wl_seat_get_keyboard(wl_seat);
+		wl_keyboard_add_listener(keyboard, &wl_keyboard_listener, seat);
+		seat->keyboard = keyboard;
+		if (manager) {
+			seat->keyboard_timestamps =
+				zwp_input_timestamps_manager_v1_get_keyboard_timestamps(
+					manager, keyboard);
+			zwp_input_timestamps_v1_add_listener(seat->keyboard_timestamps,
+					&input_timestamps_listener, keyboard);
+		}
+	}
+	if ((capabilities & WL_SEAT_CAPABILITY_TOUCH) && !seat->touch) {
+		struct wl_touch *touch = wl_seat_get_touch(wl_seat);
+		wl_touch_add_listener(touch, &wl_touch_listener, seat);
+		seat->touch = touch;
+		if (manager) {
+			seat->touch_timestamps =
+				zwp_input_timestamps_manager_v1_get_touch_timestamps(
+					manager, touch);
+			zwp_input_timestamps_v1_add_listener(seat->touch_timestamps,
+					&input_timestamps_listener, touch);
+		}
+	}
+}
+
+static void wl_seat_name(void *data, struct wl_seat *wl_seat,
+		const char *name) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)wl_seat,
+			WEV_WL_SEAT, WEV_WL_SEAT_NAME, "s", name);
+	free(seat->name);
+	seat->name = strdup(name);
+}
+
+static const struct wl_seat_listener wl_seat_listener = {
+	.capabilities = wl_seat_capabilities,
+	.name = wl_seat_name,
+};
+
+static void print_wp_presentation(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	uint32_t clock = ev->args[0].u;
+	if (event_log(state, ev)) {
+		output_lit(out, ": ");
+		output_uint(out, clock);
+		if (clock == CLOCK_MONOTONIC) {
+			output_lit(out, " (CLOCK_MONOTONIC)");
+		} else if (clock == CLOCK_MONOTONIC_RAW) {
+			output_lit(out, " (CLOCK_MONOTONIC_RAW)");
+		}
+		output_char(out, '\n');
+	}
+}
+
+static void print_wp_presentation_feedback(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const union wev_arg *arg = ev->args;
+	switch (ev->opcode) {
+	case WEV_WP_PRESENTATION_FEEDBACK_SYNC_OUTPUT:
+		if (event_log(state, ev)) {
+			output_lit(out, ": output: ");
+			output_uint(out, arg[0].u);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WP_PRESENTATION_FEEDBACK_PRESENTED:
+		if (!event_log(state, ev)) {
+			break;
+		}
+		uint64_t ns = (uint64_t)arg[0].u << 32 | arg[1].u;
+		uint32_t flags = arg[5].u;
+		output_lit(out, ": time: ");
+		output_uint64(out, ns / 1000000000);
+		output_char(out, '.');
+		output_uint_pad(out, ns % 1000000000, 9);
+		output_lit(out, " s; refresh: ");
+		output_uint(out, arg[2].u);
+		output_lit(out, " ns; seq: ");
+		output_uint64(out, (uint64_t)arg[3].u << 32 | arg[4].u);
+		output_lit(out, "; flags:");
+		if (flags == 0) {
+			output_lit(out, " none");
+		}
+		if ((flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC)) {
+			output_lit(out, " vsync");
+		}
+		if ((flags & WP_PRESENTATION_FEEDBACK_KIND_HW_CLOCK)) {
+			output_lit(out, " hw_clock");
+		}
+		if ((flags & WP_PRESENTATION_FEEDBACK_KIND_HW_COMPLETION)) {
+			output_lit(out, " hw_completion");
+		}
+		if ((flags & WP_PRESENTATION_FEEDBACK_KIND_ZERO_COPY)) {
+			output_lit(out, " zero_copy");
+		}
+		output_lit(out, "\n" SPACER);
+		if (arg[6].u != 0) {
+			output_lit(out, "input to commit: ");
+			print_duration(out, arg[6].u);
+			output_lit(out, "; ");
+		}
+		output_lit(out, "commit to presented: ");
+		print_duration(out, arg[7].u);
+		if (arg[6].u != 0) {
+			output_lit(out, "; input to presented: ");
+			print_duration(out, (uint64_t)arg[6].u + arg[7].u);
+		}
+		output_char(out, '\n');
+		break;
+	case WEV_WP_PRESENTATION_FEEDBACK_DISCARDED:
+		if (event_log(state, ev)) {
+			output_char(out, '\n');
+		}
+		break;
+	}
+}
+
+static void presentation_clock_id(void *data,
+		struct wp_presentation *presentation, uint32_t clk_id) {
+	struct wev_state *state = data;
+	event_emit(state, (struct wl_proxy *)presentation,
+			WEV_WP_PRESENTATION, WEV_WP_PRESENTATION_CLOCK_ID, "u", clk_id);
+	state->presentation_clock = clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+	.clock_id = presentation_clock_id,
+};
+
+static void presentation_feedback_sync_output(void *data,
+		struct wp_presentation_feedback *feedback, struct wl_output *output) {
+	struct wev_present_frame *frame = data;
+	event_emit(frame->state, (struct wl_proxy *)feedback,
+			WEV_WP_PRESENTATION_FEEDBACK,
+			WEV_WP_PRESENTATION_FEEDBACK_SYNC_OUTPUT, "o", output);
+}
+
+static uint32_t clamp_ns(uint64_t ns) {
+	return ns < UINT32_MAX ? ns : UINT32_MAX;
+}
+
+static void presentation_feedback_presented(void *data,
+		struct wp_presentation_feedback *feedback,
+		uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+		uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags) {
+	struct wev_present_frame *frame = data;
+	uint64_t ns = ((uint64_t)tv_sec_hi << 32 | tv_sec_lo) * 1000000000 +
+		tv_nsec;
+	uint32_t input_to_commit = 0, commit_to_presented = 0;
+	if (frame->input_ns != 0 && frame->input_ns < frame->commit_ns) {
+		input_to_commit = clamp_ns(frame->commit_ns - frame->input_ns);
+	}
+	if (frame->commit_clock_ns < ns) {
+		commit_to_presented = clamp_ns(ns - frame->commit_clock_ns);
+	}
+	event_emit(frame->state, (struct wl_proxy *)feedback,
+			WEV_WP_PRESENTATION_FEEDBACK,
+			WEV_WP_PRESENTATION_FEEDBACK_PRESENTED, "uuuuuuuu",
+			(uint32_t)(ns >> 32), (uint32_t)ns, refresh, seq_hi, seq_lo,
+			flags, input_to_commit, commit_to_presented);
+	wp_presentation_feedback_destroy(feedback);
+	free(frame);
+}
+
+static void presentation_feedback_discarded(void *data,
+		struct wp_presentation_feedback *feedback) {
+	struct wev_present_frame *frame = data;
+	event_emit(frame->state, (struct wl_proxy *)feedback,
+			WEV_WP_PRESENTATION_FEEDBACK,
+			WEV_WP_PRESENTATION_FEEDBACK_DISCARDED, "");
+	wp_presentation_feedback_destroy(feedback);
+	free(frame);
+}
+
+static const struct wp_presentation_feedback_listener
+		presentation_feedback_listener = {
+	.sync_output = presentation_feedback_sync_output,
+	.presented = presentation_feedback_presented,
+	.discarded = presentation_feedback_discarded,
+};
+
+static void frame_callback_done(void *data,
+		struct wl_callback *callback, uint32_t time) {
+	struct wev_state *state = data;
+	wl_callback_destroy(callback);
+	state->frame_callback = NULL;
+}
+
+static const struct wl_callback_listener frame_callback_listener = {
+	.done = frame_callback_done,
+};
+
+/*
+ * With --present, asks for feedback on the commit which follows, and for a
+ * frame callback, which holds off the next redraw until this frame is shown.
+ */
+static struct wev_present_frame *present_frame(struct wev_state *state) {
+	state->frame_callback = wl_surface_frame(state->surface);
+	wl_callback_add_listener(state->frame_callback,
+			&frame_callback_listener, state);
+
+	struct wev_present_frame *frame = calloc(1, sizeof(*frame));
+	if (!frame) {
+		return NULL;
+	}
+	frame->state = state;
+	frame->input_ns = state->redraw_pending ? state->redraw_input_ns : 0;
+	struct wp_presentation_feedback *feedback =
+		wp_presentation_feedback(state->presentation, state->surface);
+	wp_presentation_feedback_add_listener(feedback,
+			&presentation_feedback_listener, frame);
+	return frame;
+}
+
+static void draw(struct wev_state *state) {
+	bool fresh;
+	struct wev_shm_buffer *buffer = shm_pool_get_buffer(&state->shm_pool,
+			state->width, state->height, &fresh);
+	if (!buffer) {
+		// Every buffer is still held by the compositor; retry after the next
+		// batch of events, which should release one
+		return;
+	}
+
+	if (fresh || state->opts.present) {
+		// Only the first row of each of the two 8-row bands is computed; every
+		// other row is a copy of the one above, or of the one a period back.
+		// With --present, the pattern moves along by a pixel every frame.
+		uint32_t phase = state->opts.present ? state->frame_count++ % 16 : 0;
+		size_t width = buffer->width;
+		for (int32_t y = 0; y < buffer->height; ++y) {
+			uint32_t *row = buffer->data + y * width;
+			if (y >= 16) {
+				memcpy(row, row - 16 * width, width * 4);
+			} else if (y % 8 != 0) {
+				memcpy(row, row - width, width * 4);
+			} else {
+				for (size_t x = 0; x < width; ++x) {
+					row[x] = (x + y + phase) % 16 < 8 ?
+						0xFF666666 : 0xFFEEEEEE;
+				}
+			}
+		}
+	}
+
+	if (state->configure_pending) {
+		xdg_surface_ack_configure(state->xdg_surface, state->configure_serial);
+		state->configure_pending = false;
+	}
+	wl_surface_attach(state->surface, buffer->buffer, 0, 0);
+	wl_surface_damage_buffer(state->surface, 0, 0, INT32_MAX, INT32_MAX);
+	struct wev_present_frame *frame = NULL;
+	if (state->opts.present) {
+		frame = present_frame(state);
+		state->redraw_pending = false;
+	}
+	wl_surface_commit(state->surface);
+	if (frame) {
+		frame->commit_ns = monotonic_ns();
+		frame->commit_clock_ns = frame->commit_ns;
+		if (state->presentation_clock != CLOCK_MONOTONIC) {
+			struct timespec ts;
+			clock_gettime(state->presentation_clock, &ts);
+			frame->commit_clock_ns =
+				(uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+		}
+	}
+}
+
+static void print_xdg_toplevel(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	switch (ev->opcode) {
+	case WEV_XDG_TOPLEVEL_CONFIGURE:
+		if (!event_log(state, ev)) {
+			break;
+		}
+		output_lit(out, ": width: ");
+		output_int(out, ev->args[0].i);
+		output_lit(out, "; height: ");
+		output_int(out, ev->args[1].i);
+		uint32_t size;
+		const uint32_t *states = wev_event_array(ev, 2, &size);
+		if (size > 0) {
+			output_lit(out, "\n" SPACER);
+		}
+		for (size_t i = 0; i < size / sizeof(*states); ++i) {
+			switch (states[i]) {
+			case XDG_TOPLEVEL_STATE_MAXIMIZED:
+				output_lit(out, "maximized ");
+				break;
+			case XDG_TOPLEVEL_STATE_FULLSCREEN:
+				output_lit(out, "fullscreen ");
+				break;
+			case XDG_TOPLEVEL_STATE_RESIZING:
+				output_lit(out, "resizing ");
+				break;
+			case XDG_TOPLEVEL_STATE_ACTIVATED:
+				output_lit(out, "activated ");
+				break;
+			case XDG_TOPLEVEL_STATE_TILED_LEFT:
+				output_lit(out, "tiled-left ");
+				break;
+			case XDG_TOPLEVEL_STATE_TILED_RIGHT:
+				output_lit(out, "tiled-right ");
+				break;
+			case XDG_TOPLEVEL_STATE_TILED_TOP:
+				output_lit(out, "tiled-top ");
+				break;
+			case XDG_TOPLEVEL_STATE_TILED_BOTTOM:
+				output_lit(out, "tiled-bottom ");
+				break;
+			}
+		}
+		output_char(out, '\n');
+		break;
+	case WEV_XDG_TOPLEVEL_CLOSE:
+		if (event_log(state, ev)) {
+			output_char(out, '\n');
+		}
+		break;
+	}
+}
+
+static void xdg_toplevel_configure(void *data,
+		struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height,
+		struct wl_array *states) {
+	struct wev_state *state = data;
+	state->width = width;
+	state->height = height;
+	if (state->width == 0 || state->height == 0) {
+		state->width = 640;
+		state->height = 480;
+	}
+	event_emit(state, (struct wl_proxy *)xdg_toplevel,
+			WEV_XDG_TOPLEVEL, WEV_XDG_TOPLEVEL_CONFIGURE, "iia",
+			width, height, states);
+}
+
+static void xdg_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel) {
+	struct wev_state *state = data;
+	state->closed = true;
+	event_emit(state, (struct wl_proxy *)xdg_toplevel,
+			WEV_XDG_TOPLEVEL, WEV_XDG_TOPLEVEL_CLOSE, "");
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+	.configure = xdg_toplevel_configure,
+	.close = xdg_toplevel_close,
+};
+
+static void print_xdg_surface(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	switch (ev->opcode) {
+	case WEV_XDG_SURFACE_CONFIGURE:
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, ev->args[0].i);
+			output_char(out, '\n');
+		}
+		break;
+	}
+}
+
+static void xdg_surface_configure(
+		void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
+	struct wev_state *state = data;
+	event_emit(state, (struct wl_proxy *)xdg_surface,
+			WEV_XDG_SURFACE, WEV_XDG_SURFACE_CONFIGURE, "u", serial);
+	state->configure_serial = serial;
+	state->configure_pending = true;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+	.configure = xdg_surface_configure,
+};
+
+static void wm_base_ping(void *data,
+		struct xdg_wm_base *wm_base, uint32_t serial) {
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener xdg_wm_base_listener = {
+	.ping = wm_base_ping,
+};
+
+static const char *dnd_actions_str(uint32_t state) {
+	switch (state) {
+	case WL_DATA_DEVICE_MANAGER_DND_ACTION_NONE:
+		return "none";
+	case WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY:
+		return "copy";
+	case WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE:
+		return "move";
+	case WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY |
+			WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE:
+		return "copy, move";
+	case WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK:
+		return "ask";
+	case WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY |
+			WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK:
+		return "copy, ask";
+	case WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE |
+			WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK:
+		return "move, ask";
+	case WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY |
+			WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE |
+			WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK:
+		return "copy, move, ask";
+	default:
+		return "unknown";
+	}
+}
+
+static void print_wl_data_offer(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	uint32_t actions = ev->args[0].u;
+	switch (ev->opcode) {
+	case WEV_WL_DATA_OFFER_OFFER:
+		if (event_log(state, ev)) {
+			output_lit(out, ": mime_type: ");
+			output_str(out, wev_event_string(ev, 0));
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_DATA_OFFER_SOURCE_ACTIONS:
+		if (event_log(state, ev)) {
+			output_lit(out, ": actions: ");
+			output_uint(out, actions);
+			output_lit(out, " (");
+			output_str(out, dnd_actions_str(actions));
+			output_lit(out, ")\n");
+		}
+		break;
+	case WEV_WL_DATA_OFFER_ACTION:
+		if (event_log(state, ev)) {
+			output_lit(out, ": dnd_action: ");
+			output_uint(out, actions);
+			output_lit(out, " (");
+			output_str(out, dnd_actions_str(actions));
+			output_lit(out, ")\n");
+		}
+		break;
+	}
+}
+
+static void wl_data_offer_offer(void *data, struct wl_data_offer *offer,
+		const char * mime_type) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)offer,
+			WEV_WL_DATA_OFFER, WEV_WL_DATA_OFFER_OFFER, "s", mime_type);
+}
+
+static void wl_data_offer_source_actions(void *data,
+		struct wl_data_offer *offer, uint32_t actions) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)offer,
+			WEV_WL_DATA_OFFER, WEV_WL_DATA_OFFER_SOURCE_ACTIONS, "u",
+			actions);
+}
+
+static void wl_data_offer_action(void *data, struct wl_data_offer *offer,
+		uint32_t dnd_action) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)offer,
+			WEV_WL_DATA_OFFER, WEV_WL_DATA_OFFER_ACTION, "u", dnd_action);
+}
+
+static const struct wl_data_offer_listener wl_data_offer_listener = {
+	.offer = wl_data_offer_offer,
+	.source_actions = wl_data_offer_source_actions,
+	.action = wl_data_offer_action,
+};
+
+static void print_wl_data_device(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const union wev_arg *arg = ev->args;
+	switch (ev->opcode) {
+	case WEV_WL_DATA_DEVICE_DATA_OFFER:
+		if (event_log(state, ev)) {
+			output_lit(out, ": id: ");
+			output_uint(out, arg[0].u);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_DATA_DEVICE_ENTER:
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; surface: ");
+			output_int(out, arg[1].i);
+			output_lit(out, "; x, y: ");
+			output_fixed(out, arg[2].i);
+			output_lit(out, ", ");
+			output_fixed(out, arg[3].i);
+			output_lit(out, "; id: ");
+			output_uint(out, arg[4].u);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_DATA_DEVICE_LEAVE:
+		if (event_log(state, ev)) {
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_DATA_DEVICE_MOTION:
+		if (event_log(state, ev)) {
+			output_lit(out, ": serial: ");
+			output_int(out, arg[0].i);
+			output_lit(out, "; x, y: ");
+			output_fixed(out, arg[1].i);
+			output_lit(out, ", ");
+			output_fixed(out, arg[2].i);
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_DATA_DEVICE_DROP:
+		if (event_log(state, ev)) {
+			output_char(out, '\n');
+		}
+		break;
+	case WEV_WL_DATA_DEVICE_SELECTION:
+		if (!event_log(state, ev)) {
+			break;
+		}
+		if (arg[0].u == 0) {
+			output_lit(out, ": (cleared)\n");
+		} else {
+			output_lit(out, ": id: ");
+			output_uint(out, arg[0].u);
+			output_char(out, '\n');
+		}
+		break;
+	}
+}
+
+static void wl_data_device_data_offer(void *data,
+		struct wl_data_device *device, struct wl_data_offer *id) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)device,
+			WEV_WL_DATA_DEVICE, WEV_WL_DATA_DEVICE_DATA_OFFER, "o", id);
+
+	wl_data_offer_add_listener(id, &wl_data_offer_listener, seat);
+}
+
+static void wl_data_device_enter(void *data,
+		struct wl_data_device *device, uint32_t serial,
+		struct wl_surface *surface, wl_fixed_t x, wl_fixed_t y,
+		struct wl_data_offer *id) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)device,
+			WEV_WL_DATA_DEVICE, WEV_WL_DATA_DEVICE_ENTER, "uoffo",
+			serial, surface, x, y, id);
+
+	seat->dnd = id;
+	wl_data_offer_set_actions(id,
+			WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY |
+				WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE |
+				WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK,
+			WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY);
+
+	// Static accept just so we have something.
+	wl_data_offer_accept(id, serial, "text/plain");
+}
+
+static void wl_data_device_leave(void *data,
+		struct wl_data_device *device) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)device,
+			WEV_WL_DATA_DEVICE, WEV_WL_DATA_DEVICE_LEAVE, "");
+
+	// Might have already been destroyed during a drop event.
+	if (seat->dnd != NULL) {
+		wl_data_offer_destroy(seat->dnd);
+		seat->dnd = NULL;
+	}
+}
+
+static void wl_data_device_motion(void *data,
+		struct wl_data_device *device, uint32_t serial, wl_fixed_t x,
+		wl_fixed_t y) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)device,
+			WEV_WL_DATA_DEVICE, WEV_WL_DATA_DEVICE_MOTION, "uff",
+			serial, x, y);
+}
+
+static void wl_data_device_drop(void *data,
+		struct wl_data_device *device) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)device,
+			WEV_WL_DATA_DEVICE, WEV_WL_DATA_DEVICE_DROP, "");
+
+	// We don't actually want the data, so cancel the drop.
+	wl_data_offer_destroy(seat->dnd);
+	seat->dnd = NULL;
+}
+
+static void wl_data_device_selection(void *data,
+		struct wl_data_device *device, struct wl_data_offer *id) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)device,
+			WEV_WL_DATA_DEVICE, WEV_WL_DATA_DEVICE_SELECTION, "o", id);
+
+	if (seat->selection != NULL) {
+		wl_data_offer_destroy(seat->selection);
+	}
+	seat->selection = id;  // May be NULL.
+}
+
+static const struct wl_data_device_listener wl_data_device_listener = {
+	.data_offer = wl_data_device_data_offer,
+	.enter = wl_data_device_enter,
+	.leave = wl_data_device_leave,
+	.motion = wl_data_device_motion,
+	.drop = wl_data_device_drop,
+	.selection = wl_data_device_selection,
+};
+
+/* The version a message was added in, from its signature */
+static uint32_t message_since(const struct wl_message *message) {
+	uint32_t since = 0;
+	for (const char *p = message->signature; *p >= '0' && *p <= '9'; ++p) {
+		since = since * 10 + (*p - '0');
+	}
+	return since ? since : 1;
+}
+
+/* Leaves out the version and nullable markers, returns the argument count */
+static int message_types(const struct wl_message *message,
+		char types[static WEV_GENERIC_ARGS + 1]) {
+	int n = 0;
+	for (const char *p = message->signature; *p; ++p) {
+		if (strchr("iufsonah", *p) && n < WEV_GENERIC_ARGS) {
+			types[n++] = *p;
+		}
+	}
+	types[n] = '\0';
+	return n;
+}
+
+static uint8_t generic_register(struct wev_state *state,
+		const struct wl_interface *interface);
+
+/*
+ * Events after which objects of interfaces --bind can trace are gone, which
+ * their wl_message does not tell, and ones whose new object makes the one
+ * they made before obsolete.
+ */
+static const struct {
+	const char *interface, *event;
+	bool replacing;
+} wev_generic_lifetimes[] = {
+	{ "wl_data_device", "data_offer", true },
+	{ "zwp_tablet_v2", "removed", false },
+	{ "zwp_tablet_tool_v2", "removed", false },
+	{ "zwp_tablet_pad_v2", "removed", false },
+};
+
+static void generic_plan(struct wev_state *state,
+		struct wev_generic_message *plan, const struct wl_message *message) {
+	plan->message = message;
+	plan->args = message_types(message, plan->types);
+	char *p = plan->fields;
+	for (int i = 0; i < plan->args && i < WEV_EVENT_MAX_ARGS; ++i) {
+		// New objects and fds are recorded as their id and number
+		char type = plan->types[i];
+		type = type == 'n' ? 'o' : type == 'h' ? 'i' : type;
+		p += sprintf(p, "%s%carg%d", i > 0 ? " " : "", type, i);
+	}
+	for (int i = 0; i < plan->args; ++i) {
+		if (plan->types[i] == 'n' && message->types[i]) {
+			plan->children[i] = generic_register(state, message->types[i]);
+		}
+	}
+}
+
+/*
+ * Adds an interface for generic_dispatch to record the events of, along with
+ * those of the objects they make. Returns its index in wev_interfaces, or 0
+ * if there are too many.
+ */
+static uint8_t generic_register(struct wev_state *state,
+		const struct wl_interface *interface) {
+	for (size_t i = WEV_INTERFACE_COUNT; i < wev_interface_count; ++i) {
+		if (wev_interfaces[i] == interface) {
+			return i;
+		}
+	}
+	if (wev_interface_count == WEV_INTERFACE_MAX) {
+		fprintf(stderr, "Too many interfaces, not tracing %s\n",
+				interface->name);
+		return 0;
+	}
+	struct wev_generic *generic = calloc(1, sizeof(*generic));
+	if (generic) {
+		generic->events = calloc(interface->event_count,
+				sizeof(*generic->events));
+	}
+	if (!generic || (interface->event_count && !generic->events)) {
+		fprintf(stderr, "Failed to allocate %s\n", interface->name);
+		exit(1);
+	}
+	generic->state = state;
+	generic->interface = interface;
+	generic->destroy_request = -1;
+	// In the table first, so interfaces which refer back to it find it
+	uint8_t iface = generic->iface = wev_interface_count++;
+	wev_interfaces[iface] = interface;
+	state->generic[iface] = generic;
+
+	for (int op = 0; op < interface->event_count; ++op) {
+		struct wev_generic_message *plan = &generic->events[op];
+		generic_plan(state, plan, &interface->events[op]);
+		if (op < 32) {
+			wev_event_fields[iface][op] = plan->fields;
+		}
+	}
+	for (int op = 0; op < interface->method_count && op < 32; ++op) {
+		const struct wl_message *request = &interface->methods[op];
+		char types[WEV_GENERIC_ARGS + 1];
+		if (message_types(request, types) == 2 &&
+				strcmp(types, "no") == 0 && request->types[0] &&
+				request->types[1] == &wl_seat_interface) {
+			generic->seat_requests |= 1u << op;
+			generic->seat_children[op] =
+				generic_register(state, request->types[0]);
+		}
+		if (generic->destroy_request < 0 && request->signature[
+					strspn(request->signature, "0123456789")] == '\0' &&
+				(strcmp(request->name, "destroy") == 0 ||
+					strcmp(request->name, "release") == 0)) {
+			generic->destroy_request = op;
+		}
+	}
+	for (size_t i = 0; i < sizeof(wev_generic_lifetimes) /
+			sizeof(wev_generic_lifetimes[0]); ++i) {
+		if (strcmp(wev_generic_lifetimes[i].interface, interface->name)) {
+			continue;
+		}
+		for (int op = 0; op < interface->event_count && op < 32; ++op) {
+			if (strcmp(wev_generic_lifetimes[i].event,
+						interface->events[op].name) == 0) {
+				*(wev_generic_lifetimes[i].replacing ?
+						&generic->replacing : &generic->destructors) |=
+					1u << op;
+			}
+		}
+	}
+	return iface;
+}
+
+static struct wev_generic_object *generic_add(struct wev_state *state,
+		struct wev_generic_object *parent, struct wl_proxy *proxy,
+		uint8_t iface, uint8_t seat);
+
+/* Destroys the object and those it made, with its destroy request if any */
+static void generic_destroy(struct wev_generic_object *object) {
+	struct wev_generic_object *child, *tmp;
+	wl_list_for_each_safe(child, tmp, &object->children, link) {
+		generic_destroy(child);
+	}
+	const struct wev_generic *generic = object->generic;
+	int op = generic->destroy_request;
+	uint32_t version = wl_proxy_get_version(object->proxy);
+	if (op >= 0 && message_since(
+				&generic->interface->methods[op]) <= version) {
+		wl_proxy_marshal_flags(object->proxy, op, NULL, version,
+				WL_MARSHAL_FLAG_DESTROY);
+	} else {
+		wl_proxy_destroy(object->proxy);
+	}
+	wl_list_remove(&object->link);
+	free(object);
+}
+
+/*
+ * Records the events of objects of interfaces added with generic_register.
+ * The proxy's user data is the index of the seat it was made for, or 0.
+ */
+static int generic_dispatch(const void *data, void *target, uint32_t opcode,
+		const struct wl_message *message, union wl_argument *args) {
+	const struct wev_generic *generic = data;
+	struct wev_state *state = generic->state;
+	struct wl_proxy *proxy = target;
+	struct wev_generic_object *object = wl_proxy_get_user_data(proxy);
+	const struct wev_generic_message *plan = &generic->events[opcode];
+
+	if (opcode < 32 && (generic->replacing & (1u << opcode))) {
+		struct wev_generic_object *child, *tmp;
+		wl_list_for_each_safe(child, tmp, &object->children, link) {
+			if (child->opcode == opcode) {
+				generic_destroy(child);
+			}
+		}
+	}
+	for (int i = 0; i < plan->args; ++i) {
+		if (plan->types[i] == 'n' && plan->children[i]) {
+			struct wev_generic_object *child = generic_add(state, object,
+					(struct wl_proxy *)args[i].o, plan->children[i],
+					object->seat);
+			if (child) {
+				child->opcode = opcode;
+			}
+		}
+	}
+	if (opcode < 32) {
+		event_record(state, state->seats_by_index[object->seat], proxy,
+				generic->iface, opcode, plan->types, args);
+	}
+	for (int i = 0; i < plan->args; ++i) {
+		if (plan->types[i] == 'h') {
+			close(args[i].h);
+		} else if (plan->types[i] == 'n' && !plan->children[i] &&
+				args[i].o) {
+			/* Not traced, as its interface did not fit in the table */
+			wl_proxy_destroy((struct wl_proxy *)args[i].o);
+		}
+	}
+	if (opcode < 32 && (generic->destructors & (1u << opcode))) {
+		generic_destroy(object);
+	}
+	return 0;
+}
+
+/* Parents which do not have a list of children pass NULL */
+static struct wev_generic_object *generic_add(struct wev_state *state,
+		struct wev_generic_object *parent, struct wl_proxy *proxy,
+		uint8_t iface, uint8_t seat) {
+	struct wev_generic_object *object = calloc(1, sizeof(*object));
+	if (!object) {
+		fprintf(stderr, "Failed to allocate %s\n",
+				wev_interfaces[iface]->name);
+		wl_proxy_destroy(proxy);
+		return NULL;
+	}
+	object->proxy = proxy;
+	object->generic = state->generic[iface];
+	object->seat = seat;
+	object->opcode = UINT32_MAX;
+	wl_list_init(&object->children);
+	if (parent) {
+		wl_list_insert(parent->children.prev, &object->link);
+	} else {
+		wl_list_init(&object->link);
+	}
+	wl_proxy_add_dispatcher(proxy, generic_dispatch,
+			state->generic[iface], object);
+	return object;
+}
+
+/* Makes the objects a global bound with --bind has for each seat */
+static void generic_seat_add(struct wev_bound *bound, struct wev_seat *seat) {
+	const struct wev_generic *generic = bound->bind->generic;
+	const struct wl_interface *interface = generic->interface;
+	struct wl_proxy *parent = bound->object->proxy;
+	uint32_t version = wl_proxy_get_version(parent);
+	for (int op = 0; op < interface->method_count && op < 32; ++op) {
+		const struct wl_message *request = &interface->methods[op];
+		if (!(generic->seat_requests & (1u << op)) ||
+				message_since(request) > version) {
+			continue;
+		}
+		struct wl_proxy *proxy = wl_proxy_marshal_flags(parent, op,
+				request->types[0], version, 0, NULL, seat->wl_seat);
+		generic_add(seat->state, bound->object, proxy,
+				generic->seat_children[op], seat->index);
+	}
+}
+
+static void generic_bind(struct wev_state *state, struct wev_bind *bind,
+		uint32_t name, uint32_t version) {
+	struct wev_bound *bound = calloc(1, sizeof(*bound));
+	if (!bound) {
+		fprintf(stderr, "Failed to allocate %s\n",
+				bind->generic->interface->name);
+		return;
+	}
+	bound->bind = bind;
+	bound->global = name;
+	struct wl_proxy *proxy = wl_registry_bind(state->registry, name,
+			bind->generic->interface,
+			version < bind->version ? version : bind->version);
+	bound->object = generic_add(state, NULL, proxy, bind->generic->iface, 0);
+	if (!bound->object) {
+		free(bound);
+		return;
+	}
+	wl_list_insert(state->bound.prev, &bound->link);
+	bind->present = true;
+
+	struct wev_seat *seat;
+	wl_list_for_each(seat, &state->seats, link) {
+		generic_seat_add(bound, seat);
+	}
+}
+
+static void print_generic(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const struct wev_generic_message *plan =
+		&state->generic[ev->iface]->events[ev->opcode];
+	if (!event_log(state, ev)) {
+		return;
+	}
+	for (int i = 0; i < plan->args && i < WEV_EVENT_MAX_ARGS; ++i) {
+		output_str(out, i == 0 ? ": " : ", ");
+		union wev_arg value = ev->args[i];
+		uint32_t size;
+		switch (plan->types[i]) {
+		case 'i':
+			output_int(out, value.i);
+			break;
+		case 'u':
+			output_uint(out, value.u);
+			break;
+		case 'f':
+			output_fixed(out, value.i);
+			break;
+		case 'o':
+			if (value.u == 0) {
+				output_lit(out, "null");
+			} else {
+				output_uint(out, value.u);
+			}
+			break;
+		case 'n':
+			output_lit(out, "new id ");
+			output_uint(out, value.u);
+			if (plan->children[i]) {
+				output_lit(out, " (");
+				output_str(out, wev_interfaces[plan->children[i]]->name);
+				output_char(out, ')');
+			}
+			break;
+		case 's':;
+			const char *str = wev_event_array(ev, i, &size);
+			if (size == 0) {
+				output_lit(out, "null");
+				break;
+			}
+			output_char(out, '\'');
+			output_write(out, str, size - 1);
+			output_char(out, '\'');
+			break;
+		case 'a':
+			wev_event_array(ev, i, &size);
+			output_lit(out, "array[");
+			output_uint(out, size);
+			output_char(out, ']');
+			break;
+		case 'h':
+			output_lit(out, "fd ");
+			output_int(out, value.i);
+			break;
+		}
+	}
+	if (plan->args > WEV_EVENT_MAX_ARGS) {
+		output_lit(out, ", ...");
+	}
+	output_char(out, '\n');
+}
+
+static const char *tablet_tool_capability_str(uint32_t capability) {
+	switch (capability) {
+	case ZWP_TABLET_TOOL_V2_CAPABILITY_TILT:
+		return "tilt";
+	case ZWP_TABLET_TOOL_V2_CAPABILITY_PRESSURE:
+		return "pressure";
+	case ZWP_TABLET_TOOL_V2_CAPABILITY_DISTANCE:
+		return "distance";
+	case ZWP_TABLET_TOOL_V2_CAPABILITY_ROTATION:
+		return "rotation";
+	case ZWP_TABLET_TOOL_V2_CAPABILITY_SLIDER:
+		return "slider";
+	case ZWP_TABLET_TOOL_V2_CAPABILITY_WHEEL:
+		return "wheel";
+	default:
+		return "unknown";
+	}
+}
+
+static const char *tablet_button_str(uint32_t button) {
+	switch (button) {
+	case BTN_STYLUS:
+		return "stylus";
+	case BTN_STYLUS2:
+		return "stylus2";
+#ifdef BTN_STYLUS3
+	case BTN_STYLUS3:
+		return "stylus3";
+#endif
+	default:
+		return pointer_button_str(button);
+	}
+}
+
+static void print_tablet_button(struct wev_state *state,
+		uint32_t button, uint32_t button_state) {
+	struct wev_output *out = &state->out;
+	output_lit(out, "button: ");
+	output_uint(out, button);
+	output_lit(out, " (");
+	output_str(out, tablet_button_str(button));
+	output_lit(out, "), state: ");
+	output_uint(out, button_state);
+	output_lit(out, " (");
+	output_str(out, pointer_state_str(button_state));
+	output_char(out, ')');
+}
+
+static void print_zwp_tablet_seat_v2(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	if (event_log(state, ev)) {
+		output_lit(out, ": id: ");
+		output_uint(out, ev->args[0].u);
+		output_char(out, '\n');
+	}
+}
+
+static void print_zwp_tablet_v2(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	if (!event_log(state, ev)) {
+		return;
+	}
+	switch (ev->opcode) {
+	case WEV_ZWP_TABLET_V2_NAME:
+	case WEV_ZWP_TABLET_V2_PATH:
+		output_lit(out, ": ");
+		output_str(out, wev_event_string(ev, 0));
+		break;
+	case WEV_ZWP_TABLET_V2_ID:
+		output_lit(out, ": vid: 0x");
+		output_hex_pad(out, ev->args[0].u, 4);
+		output_lit(out, ", pid: 0x");
+		output_hex_pad(out, ev->args[1].u, 4);
+		break;
+	}
+	output_char(out, '\n');
+}
+
+/* Returns the formatter state of the tool with the given object id */
+static struct wev_tool_state *tool_state(struct wev_seat_state *seat,
+		uint32_t id) {
+	struct wev_tool_state *unused = NULL;
+	for (size_t i = 0; i < WEV_TABLET_TOOLS; ++i) {
+		struct wev_tool_state *tool = &seat->tools[i];
+		if (tool->id == id) {
+			return tool;
+		} else if (tool->id == 0 && !unused) {
+			unused = tool;
+		}
+	}
+	if (unused) {
+		memset(unused, 0, sizeof(*unused));
+		unused->id = id;
+	}
+	return unused;
+}
+
+static void print_tool_frame(struct wev_state *state,
+		const struct wev_event *ev, const struct wev_tool_state *tool) {
+	struct wev_output *out = &state->out;
+	uint32_t changes = tool->changes;
+	event_prefix(state, ev);
+	output_lit(out, ": ");
+	output_uint(out, tool->events);
+	output_str(out, tool->events == 1 ? " event" : " events");
+	output_lit(out, "; time: ");
+	print_time(state, ev->args[0].u, state->event_ns);
+	output_lit(out, "; tool: ");
+	output_str(out, tablet_tool_type_str(tool->type));
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_IN)) {
+		output_lit(out, "; proximity_in: tablet: ");
+		output_uint(out, tool->tablet);
+		output_lit(out, ", surface: ");
+		output_uint(out, tool->surface);
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_DOWN)) {
+		output_lit(out, "; down");
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_MOTION)) {
+		output_lit(out, "; x, y: ");
+		output_fixed(out, tool->x);
+		output_lit(out, ", ");
+		output_fixed(out, tool->y);
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_PRESSURE)) {
+		output_lit(out, "; pressure: ");
+		output_uint(out, tool->pressure);
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_DISTANCE)) {
+		output_lit(out, "; distance: ");
+		output_uint(out, tool->distance);
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_TILT)) {
+		output_lit(out, "; tilt: ");
+		output_fixed(out, tool->tilt_x);
+		output_lit(out, ", ");
+		output_fixed(out, tool->tilt_y);
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_ROTATION)) {
+		output_lit(out, "; rotation: ");
+		output_fixed(out, tool->rotation);
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_SLIDER)) {
+		output_lit(out, "; slider: ");
+		output_int(out, tool->slider);
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_WHEEL)) {
+		output_lit(out, "; wheel: ");
+		output_fixed(out, tool->wheel);
+		output_lit(out, ", clicks: ");
+		output_int(out, tool->wheel_clicks);
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_BUTTON)) {
+		output_lit(out, "; ");
+		print_tablet_button(state, tool->button, tool->button_state);
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_UP)) {
+		output_lit(out, "; up");
+	}
+	if (changes & (1u << WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_OUT)) {
+		output_lit(out, "; proximity_out");
+	}
+	output_char(out, '\n');
+}
+
+/* Folds a tool event into the tool's current frame, for --frames */
+static void tool_frame_add(struct wev_state *state,
+		const struct wev_event *ev, struct wev_tool_state *tool) {
+	const union wev_arg *arg = ev->args;
+	if (ev->opcode == WEV_ZWP_TABLET_TOOL_V2_FRAME) {
+		if (tool->events > 0 || event_visible(state, ev)) {
+			print_tool_frame(state, ev, tool);
+		}
+		tool->events = tool->changes = 0;
+		tool->wheel = tool->wheel_clicks = 0;
+		return;
+	}
+	if (!event_visible(state, ev)) {
+		return;
+	}
+
+	++tool->events;
+	tool->changes |= 1u << ev->opcode;
+	switch (ev->opcode) {
+	case WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_IN:
+		tool->tablet = arg[1].u;
+		tool->surface = arg[2].u;
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_MOTION:
+		tool->x = arg[0].i;
+		tool->y = arg[1].i;
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_PRESSURE:
+		tool->pressure = arg[0].u;
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_DISTANCE:
+		tool->distance = arg[0].u;
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_TILT:
+		tool->tilt_x = arg[0].i;
+		tool->tilt_y = arg[1].i;
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_ROTATION:
+		tool->rotation = arg[0].i;
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_SLIDER:
+		tool->slider = arg[0].i;
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_WHEEL:
+		tool->wheel += arg[0].i;
+		tool->wheel_clicks += arg[1].i;
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_BUTTON:
+		tool->button = arg[1].u;
+		tool->button_state = arg[2].u;
+		break;
+	}
+}
+
+static void print_zwp_tablet_tool_v2(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const union wev_arg *arg = ev->args;
+	struct wev_tool_state *tool = tool_state(state->seat, ev->id);
+	if (tool && ev->opcode == WEV_ZWP_TABLET_TOOL_V2_TYPE) {
+		tool->type = arg[0].u;
+	}
+	if (tool && ev->opcode == WEV_ZWP_TABLET_TOOL_V2_REMOVED) {
+		tool->id = 0;
+	}
+	// Only what happens while the tool is in use comes in frames
+	if (state->opts.frames && tool &&
+			ev->opcode >= WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_IN) {
+		tool_frame_add(state, ev, tool);
+		return;
+	}
+	if (!event_log(state, ev)) {
+		return;
+	}
+	switch (ev->opcode) {
+	case WEV_ZWP_TABLET_TOOL_V2_TYPE:
+		output_lit(out, ": 0x");
+		output_hex_pad(out, arg[0].u, 0);
+		output_lit(out, " (");
+		output_str(out, tablet_tool_type_str(arg[0].u));
+		output_char(out, ')');
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_HARDWARE_SERIAL:
+	case WEV_ZWP_TABLET_TOOL_V2_HARDWARE_ID_WACOM:
+		output_lit(out, ": 0x");
+		output_hex_pad(out, arg[0].u, 8);
+		output_hex_pad(out, arg[1].u, 8);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_CAPABILITY:
+		output_lit(out, ": ");
+		output_uint(out, arg[0].u);
+		output_lit(out, " (");
+		output_str(out, tablet_tool_capability_str(arg[0].u));
+		output_char(out, ')');
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_IN:
+		output_lit(out, ": serial: ");
+		output_uint(out, arg[0].u);
+		output_lit(out, "; tablet: ");
+		output_uint(out, arg[1].u);
+		output_lit(out, ", surface: ");
+		output_uint(out, arg[2].u);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_DOWN:
+		output_lit(out, ": serial: ");
+		output_uint(out, arg[0].u);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_MOTION:
+		output_lit(out, ": x, y: ");
+		output_fixed(out, arg[0].i);
+		output_lit(out, ", ");
+		output_fixed(out, arg[1].i);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_TILT:
+		output_lit(out, ": tilt: ");
+		output_fixed(out, arg[0].i);
+		output_lit(out, ", ");
+		output_fixed(out, arg[1].i);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_PRESSURE:
+	case WEV_ZWP_TABLET_TOOL_V2_DISTANCE:
+		output_lit(out, ": ");
+		output_uint(out, arg[0].u);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_ROTATION:
+		output_lit(out, ": degrees: ");
+		output_fixed(out, arg[0].i);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_SLIDER:
+		output_lit(out, ": position: ");
+		output_int(out, arg[0].i);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_WHEEL:
+		output_lit(out, ": degrees: ");
+		output_fixed(out, arg[0].i);
+		output_lit(out, ", clicks: ");
+		output_int(out, arg[1].i);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_BUTTON:
+		output_lit(out, ": serial: ");
+		output_uint(out, arg[0].u);
+		output_lit(out, "; ");
+		print_tablet_button(state, arg[1].u, arg[2].u);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2_FRAME:
+		output_lit(out, ": time: ");
+		print_time(state, arg[0].u, state->event_ns);
+		break;
+	}
+	output_char(out, '\n');
+}
+
+static void print_zwp_tablet_pad_v2(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const union wev_arg *arg = ev->args;
+	if (!event_log(state, ev)) {
+		return;
+	}
+	switch (ev->opcode) {
+	case WEV_ZWP_TABLET_PAD_V2_GROUP:
+		output_lit(out, ": id: ");
+		output_uint(out, arg[0].u);
+		break;
+	case WEV_ZWP_TABLET_PAD_V2_PATH:
+		output_lit(out, ": ");
+		output_str(out, wev_event_string(ev, 0));
+		break;
+	case WEV_ZWP_TABLET_PAD_V2_BUTTONS:
+		output_lit(out, ": ");
+		output_uint(out, arg[0].u);
+		break;
+	case WEV_ZWP_TABLET_PAD_V2_BUTTON:
+		output_lit(out, ": time: ");
+		print_time(state, arg[0].u, state->event_ns);
+		output_lit(out, "; button: ");
+		output_uint(out, arg[1].u);
+		output_lit(out, ", state: ");
+		output_uint(out, arg[2].u);
+		output_lit(out, " (");
+		output_str(out, pointer_state_str(arg[2].u));
+		output_char(out, ')');
+		break;
+	case WEV_ZWP_TABLET_PAD_V2_ENTER:
+		output_lit(out, ": serial: ");
+		output_uint(out, arg[0].u);
+		output_lit(out, "; tablet: ");
+		output_uint(out, arg[1].u);
+		output_lit(out, ", surface: ");
+		output_uint(out, arg[2].u);
+		break;
+	case WEV_ZWP_TABLET_PAD_V2_LEAVE:
+		output_lit(out, ": serial: ");
+		output_uint(out, arg[0].u);
+		output_lit(out, "; surface: ");
+		output_uint(out, arg[1].u);
+		break;
+	}
+	output_char(out, '\n');
+}
+
+static struct wev_tablet_device *tablet_device_add(struct wev_seat *seat,
+		enum wev_interface iface, void *proxy) {
+	struct wev_tablet_device *device = calloc(1, sizeof(*device));
+	if (!device) {
+		fprintf(stderr, "Failed to allocate %s\n", wev_interfaces[iface]->name);
+		return NULL;
+	}
+	device->seat = seat;
+	device->iface = iface;
+	device->proxy = proxy;
+	device->id = wl_proxy_get_id(proxy);
+	wl_list_init(&device->groups);
+	wl_list_insert(seat->tablet_devices.prev, &device->link);
+	return device;
+}
+
+/* Tools are kept once removed, for --stats */
+static void tablet_device_release(struct wev_tablet_device *device) {
+	switch (device->iface) {
+	case WEV_ZWP_TABLET_V2:
+		zwp_tablet_v2_destroy((struct zwp_tablet_v2 *)device->proxy);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2:
+		if (device->proxy) {
+			zwp_tablet_tool_v2_destroy(
+					(struct zwp_tablet_tool_v2 *)device->proxy);
+			device->proxy = NULL;
+		}
+		return;
+	case WEV_ZWP_TABLET_PAD_V2:;
+		struct wev_generic_object *group, *tmp;
+		wl_list_for_each_safe(group, tmp, &device->groups, link) {
+			generic_destroy(group);
+		}
+		zwp_tablet_pad_v2_destroy((struct zwp_tablet_pad_v2 *)device->proxy);
+		break;
+	default:
+		abort();
+	}
+	wl_list_remove(&device->link);
+	free(device);
+}
+
+static void tablet_emit(struct wev_tablet_device *device, uint32_t opcode,
+		const char *signature, ...) {
+	va_list ap;
+	va_start(ap, signature);
+	event_vemit(device->seat->state, device->seat, device->proxy,
+			device->iface, opcode, signature, ap);
+	va_end(ap);
+}
+
+static void tablet_name(void *data, struct zwp_tablet_v2 *tablet,
+		const char *name) {
+	tablet_emit(data, WEV_ZWP_TABLET_V2_NAME, "s", name);
+}
+
+static void tablet_id(void *data, struct zwp_tablet_v2 *tablet,
+		uint32_t vid, uint32_t pid) {
+	tablet_emit(data, WEV_ZWP_TABLET_V2_ID, "uu", vid, pid);
+}
+
+static void tablet_path(void *data, struct zwp_tablet_v2 *tablet,
+		const char *path) {
+	tablet_emit(data, WEV_ZWP_TABLET_V2_PATH, "s", path);
+}
+
+static void tablet_done(void *data, struct zwp_tablet_v2 *tablet) {
+	tablet_emit(data, WEV_ZWP_TABLET_V2_DONE, "");
+}
+
+static void tablet_removed(void *data, struct zwp_tablet_v2 *tablet) {
+	tablet_emit(data, WEV_ZWP_TABLET_V2_REMOVED, "");
+	tablet_device_release(data);
+}
+
+static const struct zwp_tablet_v2_listener tablet_listener = {
+	.name = tablet_name,
+	.id = tablet_id,
+	.path = tablet_path,
+	.done = tablet_done,
+	.removed = tablet_removed,
+};
+
+static void tablet_tool_type(void *data, struct zwp_tablet_tool_v2 *tool,
+		uint32_t tool_type) {
+	struct wev_tablet_device *device = data;
+	device->tool_type = tool_type;
+	tablet_emit(device, WEV_ZWP_TABLET_TOOL_V2_TYPE, "u", tool_type);
+}
+
+static void tablet_tool_hardware_serial(void *data,
+		struct zwp_tablet_tool_v2 *tool, uint32_t hi, uint32_t lo) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_HARDWARE_SERIAL, "uu", hi, lo);
+}
+
+static void tablet_tool_hardware_id_wacom(void *data,
+		struct zwp_tablet_tool_v2 *tool, uint32_t hi, uint32_t lo) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_HARDWARE_ID_WACOM, "uu", hi, lo);
+}
+
+static void tablet_tool_capability(void *data,
+		struct zwp_tablet_tool_v2 *tool, uint32_t capability) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_CAPABILITY, "u", capability);
+}
+
+static void tablet_tool_done(void *data, struct zwp_tablet_tool_v2 *tool) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_DONE, "");
+}
+
+static void tablet_tool_removed(void *data, struct zwp_tablet_tool_v2 *tool) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_REMOVED, "");
+	tablet_device_release(data);
+}
+
+static void tablet_tool_proximity_in(void *data,
+		struct zwp_tablet_tool_v2 *tool, uint32_t serial,
+		struct zwp_tablet_v2 *tablet, struct wl_surface *surface) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_IN, "uoo",
+			serial, tablet, surface);
+}
+
+static void tablet_tool_proximity_out(void *data,
+		struct zwp_tablet_tool_v2 *tool) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_PROXIMITY_OUT, "");
+}
+
+static void tablet_tool_down(void *data, struct zwp_tablet_tool_v2 *tool,
+		uint32_t serial) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_DOWN, "u", serial);
+}
+
+static void tablet_tool_up(void *data, struct zwp_tablet_tool_v2 *tool) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_UP, "");
+}
+
+static void tablet_tool_motion(void *data, struct zwp_tablet_tool_v2 *tool,
+		wl_fixed_t x, wl_fixed_t y) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_MOTION, "ff", x, y);
+}
+
+static void tablet_tool_pressure(void *data, struct zwp_tablet_tool_v2 *tool,
+		uint32_t pressure) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_PRESSURE, "u", pressure);
+}
+
+static void tablet_tool_distance(void *data, struct zwp_tablet_tool_v2 *tool,
+		uint32_t distance) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_DISTANCE, "u", distance);
+}
+
+static void tablet_tool_tilt(void *data, struct zwp_tablet_tool_v2 *tool,
+		wl_fixed_t tilt_x, wl_fixed_t tilt_y) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_TILT, "ff", tilt_x, tilt_y);
+}
+
+static void tablet_tool_rotation(void *data, struct zwp_tablet_tool_v2 *tool,
+		wl_fixed_t degrees) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_ROTATION, "f", degrees);
+}
+
+static void tablet_tool_slider(void *data, struct zwp_tablet_tool_v2 *tool,
+		int32_t position) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_SLIDER, "i", position);
+}
+
+static void tablet_tool_wheel(void *data, struct zwp_tablet_tool_v2 *tool,
+		wl_fixed_t degrees, int32_t clicks) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_WHEEL, "fi", degrees, clicks);
+}
+
+static void tablet_tool_button(void *data, struct zwp_tablet_tool_v2 *tool,
+		uint32_t serial, uint32_t button, uint32_t state) {
+	tablet_emit(data, WEV_ZWP_TABLET_TOOL_V2_BUTTON, "uuu",
+			serial, button, state);
+}
+
+static void tablet_tool_frame(void *data, struct zwp_tablet_tool_v2 *tool,
+		uint32_t time) {
+	struct wev_tablet_device *device = data;
+	if (device->seat->state->opts.stats_interval) {
+		++device->frames;
+	}
+	tablet_emit(device, WEV_ZWP_TABLET_TOOL_V2_FRAME, "u", time);
+}
+
+static const struct zwp_tablet_tool_v2_listener tablet_tool_listener = {
+	.type = tablet_tool_type,
+	.hardware_serial = tablet_tool_hardware_serial,
+	.hardware_id_wacom = tablet_tool_hardware_id_wacom,
+	.capability = tablet_tool_capability,
+	.done = tablet_tool_done,
+	.removed = tablet_tool_removed,
+	.proximity_in = tablet_tool_proximity_in,
+	.proximity_out = tablet_tool_proximity_out,
+	.down = tablet_tool_down,
+	.up = tablet_tool_up,
+	.motion = tablet_tool_motion,
+	.pressure = tablet_tool_pressure,
+	.distance = tablet_tool_distance,
+	.tilt = tablet_tool_tilt,
+	.rotation = tablet_tool_rotation,
+	.slider = tablet_tool_slider,
+	.wheel = tablet_tool_wheel,
+	.button = tablet_tool_button,
+	.frame = tablet_tool_frame,
+};
+
+static void tablet_pad_group(void *data, struct zwp_tablet_pad_v2 *pad,
+		struct zwp_tablet_pad_group_v2 *group) {
+	struct wev_tablet_device *device = data;
+	struct wev_state *state = device->seat->state;
+	tablet_emit(device, WEV_ZWP_TABLET_PAD_V2_GROUP, "o", group);
+	if (state->pad_group_iface) {
+		struct wev_generic_object *object = generic_add(state, NULL,
+				(struct wl_proxy *)group, state->pad_group_iface,
+				device->seat->index);
+		if (object) {
+			wl_list_insert(&device->groups, &object->link);
+		}
+	}
+}
+
+static void tablet_pad_path(void *data, struct zwp_tablet_pad_v2 *pad,
+		const char *path) {
+	tablet_emit(data, WEV_ZWP_TABLET_PAD_V2_PATH, "s", path);
+}
+
+static void tablet_pad_buttons(void *data, struct zwp_tablet_pad_v2 *pad,
+		uint32_t buttons) {
+	tablet_emit(data, WEV_ZWP_TABLET_PAD_V2_BUTTONS, "u", buttons);
+}
+
+static void tablet_pad_done(void *data, struct zwp_tablet_pad_v2 *pad) {
+	tablet_emit(data, WEV_ZWP_TABLET_PAD_V2_DONE, "");
+}
+
+static void tablet_pad_button(void *data, struct zwp_tablet_pad_v2 *pad,
+		uint32_t time, uint32_t button, uint32_t state) {
+	tablet_emit(data, WEV_ZWP_TABLET_PAD_V2_BUTTON, "uuu",
+			time, button, state);
+}
+
+static void tablet_pad_enter(void *data, struct zwp_tablet_pad_v2 *pad,
+		uint32_t serial, struct zwp_tablet_v2 *tablet,
+		struct wl_surface *surface) {
+	tablet_emit(data, WEV_ZWP_TABLET_PAD_V2_ENTER, "uoo",
+			serial, tablet, surface);
+}
+
+static void tablet_pad_leave(void *data, struct zwp_tablet_pad_v2 *pad,
+		uint32_t serial, struct wl_surface *surface) {
+	tablet_emit(data, WEV_ZWP_TABLET_PAD_V2_LEAVE, "uo", serial, surface);
+}
+
+static void tablet_pad_removed(void *data, struct zwp_tablet_pad_v2 *pad) {
+	tablet_emit(data, WEV_ZWP_TABLET_PAD_V2_REMOVED, "");
+	tablet_device_release(data);
+}
+
+static const struct zwp_tablet_pad_v2_listener tablet_pad_listener = {
+	.group = tablet_pad_group,
+	.path = tablet_pad_path,
+	.buttons = tablet_pad_buttons,
+	.done = tablet_pad_done,
+	.button = tablet_pad_button,
+	.enter = tablet_pad_enter,
+	.leave = tablet_pad_leave,
+	.removed = tablet_pad_removed,
+};
+
+static void tablet_seat_tablet_added(void *data,
+		struct zwp_tablet_seat_v2 *tablet_seat, struct zwp_tablet_v2 *tablet) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)tablet_seat, WEV_ZWP_TABLET_SEAT_V2,
+			WEV_ZWP_TABLET_SEAT_V2_TABLET_ADDED, "o", tablet);
+	struct wev_tablet_device *device =
+		tablet_device_add(seat, WEV_ZWP_TABLET_V2, tablet);
+	if (device) {
+		zwp_tablet_v2_add_listener(tablet, &tablet_listener, device);
+	}
+}
+
+static void tablet_seat_tool_added(void *data,
+		struct zwp_tablet_seat_v2 *tablet_seat,
+		struct zwp_tablet_tool_v2 *tool) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)tablet_seat, WEV_ZWP_TABLET_SEAT_V2,
+			WEV_ZWP_TABLET_SEAT_V2_TOOL_ADDED, "o", tool);
+	struct wev_tablet_device *device =
+		tablet_device_add(seat, WEV_ZWP_TABLET_TOOL_V2, tool);
+	if (device) {
+		zwp_tablet_tool_v2_add_listener(tool, &tablet_tool_listener, device);
+	}
+}
+
+static void tablet_seat_pad_added(void *data,
+		struct zwp_tablet_seat_v2 *tablet_seat, struct zwp_tablet_pad_v2 *pad) {
+	struct wev_seat *seat = data;
+	seat_emit(seat, (struct wl_proxy *)tablet_seat, WEV_ZWP_TABLET_SEAT_V2,
+			WEV_ZWP_TABLET_SEAT_V2_PAD_ADDED, "o", pad);
+	struct wev_tablet_device *device =
+		tablet_device_add(seat, WEV_ZWP_TABLET_PAD_V2, pad);
+	if (device) {
+		zwp_tablet_pad_v2_add_listener(pad, &tablet_pad_listener, device);
+	}
+}
+
+static const struct zwp_tablet_seat_v2_listener tablet_seat_listener = {
+	.tablet_added = tablet_seat_tablet_added,
+	.tool_added = tablet_seat_tool_added,
+	.pad_added = tablet_seat_pad_added,
+};
+
+static void seat_get_tablet_seat(struct wev_seat *seat) {
+	struct zwp_tablet_manager_v2 *manager = seat->state->tablet_manager;
+	if (!manager || seat->tablet_seat) {
+		return;
+	}
+	seat->tablet_seat =
+		zwp_tablet_manager_v2_get_tablet_seat(manager, seat->wl_seat);
+	zwp_tablet_seat_v2_add_listener(seat->tablet_seat,
+			&tablet_seat_listener, seat);
+}
+
+static void seat_get_data_device(struct wev_seat *seat) {
+	struct wl_data_device_manager *manager = seat->state->data_device_manager;
+	if (!manager || seat->data_device) {
+		return;
+	}
+	seat->data_device =
+		wl_data_device_manager_get_data_device(manager, seat->wl_seat);
+	wl_data_device_add_listener(seat->data_device,
+			&wl_data_device_listener, seat);
+}
+
+static void seat_bind(struct wev_state *state, uint32_t name, int version) {
+	if (state->seat_count == WEV_SEAT_MAX - 1) {
+		fprintf(stderr, "Too many seats, ignoring seat %" PRIu32 "\n", name);
+		return;
+	}
+	struct wev_seat *seat = calloc(1, sizeof(*seat));
+	if (!seat) {
+		fprintf(stderr, "Failed to allocate seat\n");
+		return;
+	}
+	seat->state = state;
+	seat->index = ++state->seat_count;
+	seat->global = name;
+	wl_list_init(&seat->tablet_devices);
+	seat->wl_seat = wl_registry_bind(state->registry,
+			name, &wl_seat_interface, version);
+	wl_seat_add_listener(seat->wl_seat, &wl_seat_listener, seat);
+	wl_list_insert(state->seats.prev, &seat->link);
+	state->seats_by_index[seat->index] = seat;
+	// Otherwise done once the managers are bound too, see main
+	seat_get_data_device(seat);
+	seat_get_tablet_seat(seat);
+	struct wev_bound *bound;
+	wl_list_for_each(bound, &state->bound, link) {
+		generic_seat_add(bound, seat);
+	}
+}
+
+static void seat_destroy(struct wev_seat *seat) {
+	seat_release(seat, WL_SEAT_CAPABILITY_POINTER |
+			WL_SEAT_CAPABILITY_KEYBOARD | WL_SEAT_CAPABILITY_TOUCH);
+	if (seat->dnd) {
+		wl_data_offer_destroy(seat->dnd);
+	}
+	if (seat->selection) {
+		wl_data_offer_destroy(seat->selection);
+	}
+	if (seat->data_device) {
+		wl_data_device_release(seat->data_device);
+	}
+	struct wev_tablet_device *device, *tmp;
+	wl_list_for_each_safe(device, tmp, &seat->tablet_devices, link) {
+		tablet_device_release(device);
+		if (device->iface == WEV_ZWP_TABLET_TOOL_V2) {
+			wl_list_remove(&device->link);
+			free(device);
+		}
+	}
+	if (seat->tablet_seat) {
+		zwp_tablet_seat_v2_destroy(seat->tablet_seat);
+	}
+	struct wev_bound *bound;
+	wl_list_for_each(bound, &seat->state->bound, link) {
+		struct wev_generic_object *object, *tmp_object;
+		wl_list_for_each_safe(object, tmp_object,
+				&bound->object->children, link) {
+			if (object->seat == seat->index) {
+				generic_destroy(object);
+			}
+		}
+	}
+	wl_seat_release(seat->wl_seat);
+	wl_list_remove(&seat->link);
+	seat->state->seats_by_index[seat->index] = NULL;
+	free(seat->name);
+	free(seat);
+}
+
+static void print_wl_registry(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	switch (ev->opcode) {
+	case WEV_WL_REGISTRY_GLOBAL:
+		if (event_log(state, ev)) {
+			output_lit(out, ": interface: '");
+			output_str(out, wev_event_string(ev, 1));
+			output_lit(out, "', version: ");
+			output_int(out, ev->args[2].i);
+			output_lit(out, ", name: ");
+			output_int(out, ev->args[0].i);
+			output_char(out, '\n');
+		}
+		break;
+	}
+}
+
+static void registry_global(void *data, struct wl_registry *wl_registry,
+		uint32_t name, const char *interface, uint32_t version) {
+	struct wev_state *state = data;
+	struct {
+		const struct wl_interface *interface;
+		int version;
+		void **ptr;
+	} handles[] = {
+		{ &wl_compositor_interface, 4, (void **)&state->compositor },
+		{ &wl_shm_interface, 1, (void **)&state->shm },
+		{ &xdg_wm_base_interface, 2, (void **)&state->wm_base },
+		{ &wl_data_device_manager_interface, 3,
+			(void **)&state->data_device_manager },
+		{ &zwp_input_timestamps_manager_v1_interface, 1,
+			(void **)&state->input_timestamps },
+		{ &zwp_relative_pointer_manager_v1_interface, 1,
+			(void **)&state->relative_pointer_manager },
+		{ &zwp_pointer_constraints_v1_interface, 1,
+			(void **)&state->pointer_constraints },
+		{ &wp_presentation_interface, 1, (void **)&state->presentation },
+		{ &zwp_tablet_manager_v2_interface, 1,
+			(void **)&state->tablet_manager },
+	};
+	char *xdg_current_desktop = getenv("XDG_CURRENT_DESKTOP");
+	int seat_version = 6;
+
+	/* Mutter currently implements wl_seat version 5, not 6 */
+	if (xdg_current_desktop && !strcmp(xdg_current_desktop, "GNOME"))
+		seat_version = 5;
+
+	for (size_t i = 0; i < sizeof(handles) / sizeof(handles[0]); ++i) {
+		if (strcmp(interface, handles[i].interface->name) == 0) {
+			*handles[i].ptr = wl_registry_bind(wl_registry,
+					name, handles[i].interface, handles[i].version);
+		}
+	}
+	if (strcmp(interface, wl_seat_interface.name) == 0) {
+		seat_bind(state, name, seat_version);
+	}
+	struct wev_bind *bind;
+	wl_list_for_each(bind, &state->opts.binds, link) {
+		if (strcmp(interface, bind->generic->interface->name) == 0) {
+			generic_bind(state, bind, name, version);
 		}
 	}
-	printf("\n");
-}
 
-static void wl_keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard,
-		uint32_t serial, uint32_t mods_depressed, uint32_t mods_latched,
-		uint32_t mods_locked, uint32_t group) {
-	struct wev_state *state = data;
-	int n = proxy_log(state, (struct wl_proxy *)wl_keyboard, "modifiers",
-			"serial: %d; group: %d\n", group);
-	if (n != 0) {
-		printf(SPACER "depressed: %08X", mods_depressed);
-		print_modifiers(state, mods_depressed);
-		printf(SPACER "latched: %08X", mods_latched);
-		print_modifiers(state, mods_latched);
-		printf(SPACER "locked: %08X", mods_locked);
-		print_modifiers(state, mods_locked);
+	if (state->opts.print_globals) {
+		event_emit(state, (struct wl_proxy *)wl_registry,
+				WEV_WL_REGISTRY, WEV_WL_REGISTRY_GLOBAL, "usu",
+				name, interface, version);
 	}
-	xkb_state_update_mask(state->xkb_state,
-		mods_depressed, mods_latched, mods_locked, 0, 0, group);
 }
 
-static void wl_keyboard_repeat_info(void *data, struct wl_keyboard *wl_keyboard,
-		int32_t rate, int32_t delay) {
+static void registry_global_remove(
+		void *data, struct wl_registry *wl_registry, uint32_t name) {
 	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_keyboard, "repeat_info",
-			"rate: %d keys/sec; delay: %d ms\n", rate, delay);
+	struct wev_seat *seat, *tmp;
+	wl_list_for_each_safe(seat, tmp, &state->seats, link) {
+		if (seat->global == name) {
+			seat_destroy(seat);
+		}
+	}
+	struct wev_bound *bound, *tmp_bound;
+	wl_list_for_each_safe(bound, tmp_bound, &state->bound, link) {
+		if (bound->global == name) {
+			generic_destroy(bound->object);
+			wl_list_remove(&bound->link);
+			free(bound);
+		}
+	}
 }
 
-static const struct wl_keyboard_listener wl_keyboard_listener = {
-	.keymap = wl_keyboard_keymap,
-	.enter = wl_keyboard_enter,
-	.leave = wl_keyboard_leave,
-	.key = wl_keyboard_key,
-	.modifiers = wl_keyboard_modifiers,
-	.repeat_info = wl_keyboard_repeat_info,
+static const struct wl_registry_listener wl_registry_listener = {
+	.global = registry_global,
+	.global_remove = registry_global_remove,
 };
 
-void wl_touch_down(void *data, struct wl_touch *wl_touch,
-		uint32_t serial, uint32_t time, struct wl_surface *surface, int32_t id,
-		wl_fixed_t x, wl_fixed_t y) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_touch, "down",
-			"serial: %d; time: %d; surface: %d; id: %d; x, y: %f, %f\n",
-			serial, time, wl_proxy_get_id((struct wl_proxy *)surface),
-			id, wl_fixed_to_double(x), wl_fixed_to_double(y));
+/*
+ * Fixed values are written both as a decimal and as the raw wl_fixed, and key
+ * codes with their keysym name and text, each as a field of its own.
+ */
+static int field_parts(char type) {
+	switch (type) {
+	case 'f':
+		return 2;
+	case 'k':
+		return 3;
+	default:
+		return 1;
+	}
 }
 
-void wl_touch_up(void *data, struct wl_touch *wl_touch,
-		uint32_t serial, uint32_t time, int32_t id) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_touch, "up",
-			"serial: %d; time: %d; id: %d\n", serial, time, id);
+static const char *field_suffix(char type, int part) {
+	static const char *const fixed[] = { "", "_raw" };
+	static const char *const key[] = { "", "_sym", "_utf8" };
+	return type == 'k' ? key[part] : fixed[part];
 }
 
-void wl_touch_motion(void *data, struct wl_touch *wl_touch,
-		uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_touch, "motion",
-			"time: %d; id: %d; x, y: %f, %f\n",
-			time, id, wl_fixed_to_double(x), wl_fixed_to_double(y));
+static void format_str(struct wev_state *state, const char *s, size_t len) {
+	if (state->opts.format == WEV_FORMAT_JSONL) {
+		output_json_str(&state->out, s, len);
+	} else {
+		output_csv_str(&state->out, s, len);
+	}
 }
 
-void wl_touch_frame(void *data, struct wl_touch *wl_touch) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_touch, "frame", "\n");
+static void format_value(struct wev_state *state, const struct wev_event *ev,
+		int arg, char type, int part) {
+	struct wev_output *out = &state->out;
+	bool json = state->opts.format == WEV_FORMAT_JSONL;
+	union wev_arg value = ev->args[arg];
+	uint32_t size;
+	switch (type) {
+	case 'i':
+		output_int(out, value.i);
+		break;
+	case 'u':
+		output_uint(out, value.u);
+		break;
+	case 't':
+		output_uint64(out, (uint64_t)value.u << 32 | ev->args[arg + 1].u);
+		break;
+	case 'o':
+		if (value.u != 0) {
+			output_uint(out, value.u);
+		} else if (json) {
+			output_lit(out, "null");
+		}
+		break;
+	case 'f':
+		if (part == 0) {
+			output_fixed_exact(out, value.i);
+		} else {
+			output_int(out, value.i);
+		}
+		break;
+	case 's':;
+		const char *str = wev_event_array(ev, arg, &size);
+		// Recorded with its NUL terminator, unless it is NULL
+		if (size > 0) {
+			format_str(state, str, size - 1);
+		} else if (json) {
+			output_lit(out, "null");
+		}
+		break;
+	case 'a':;
+		const uint32_t *array = wev_event_array(ev, arg, &size);
+		if (json) {
+			output_char(out, '[');
+		}
+		for (size_t i = 0; i < size / sizeof(*array); ++i) {
+			if (i > 0) {
+				output_char(out, json ? ',' : ' ');
+			}
+			output_uint(out, array[i]);
+		}
+		if (json) {
+			output_char(out, ']');
+		}
+		break;
+	case 'k':
+		if (part == 0) {
+			output_uint(out, value.u);
+			break;
+		}
+		struct wev_seat_state *seat = state->seat;
+		if (!seat->xkb_state) {
+			if (json) {
+				output_lit(out, "null");
+			}
+			break;
+		}
+		const struct wev_keycache_entry *key = keycache_get(&seat->keycache,
+				seat->xkb_state, value.u + 8, seat->xkb_mods, seat->xkb_layout);
+		if (part == 1) {
+			format_str(state, key->sym_text, key->name_len);
+		} else {
+			format_str(state, key->text, key->text_len);
+		}
+		break;
+	}
 }
 
-void wl_touch_cancel(void *data, struct wl_touch *wl_touch) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_touch, "cancel", "\n");
-}
+static void format_json(struct wev_state *state, const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const struct wl_interface *iface = wev_interfaces[ev->iface];
+	output_lit(out, "{\"received\":");
+	output_uint64(out, ev->time);
+	output_lit(out, ",\"object\":");
+	output_uint(out, ev->id);
+	const char *seat = state->seat->name;
+	if (seat) {
+		output_lit(out, ",\"seat\":");
+		output_json_str(out, seat, strlen(seat));
+	}
+	output_lit(out, ",\"interface\":\"");
+	output_str(out, iface->name);
+	output_lit(out, "\",\"event\":\"");
+	output_str(out, iface->events[ev->opcode].name);
+	output_char(out, '"');
 
-void wl_touch_shape(void *data, struct wl_touch *wl_touch,
-		int32_t id, wl_fixed_t major, wl_fixed_t minor) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_touch, "shape",
-			"id: %d; major, minor: %f, %f\n",
-			id, wl_fixed_to_double(major), wl_fixed_to_double(minor));
+	const char *fields = wev_event_fields[ev->iface][ev->opcode];
+	struct wev_field field;
+	for (int arg = 0; wev_next_field(&fields, &field);
+			arg += wev_field_args(field.type)) {
+		for (int part = 0; part < field_parts(field.type); ++part) {
+			output_lit(out, ",\"");
+			output_write(out, field.name, field.len);
+			output_str(out, field_suffix(field.type, part));
+			output_lit(out, "\":");
+			format_value(state, ev, arg, field.type, part);
+		}
+	}
+	if (state->event_ns != 0) {
+		output_lit(out, ",\"time_ns\":");
+		output_uint64(out, state->event_ns);
+	}
+	output_lit(out, "}\n");
 }
 
-void wl_touch_orientation(void *data, struct wl_touch *wl_touch,
-		int32_t id, wl_fixed_t orientation) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)wl_touch, "shape",
-			"id: %d; orientation: %f\n",
-			id, wl_fixed_to_double(orientation));
+static void csv_header(struct wev_state *state) {
+	struct wev_output *out = &state->out;
+	output_lit(out, "received,object,seat,interface,event");
+	for (int c = 0; c < state->csv_columns; ++c) {
+		const struct wev_csv_column *column = &state->csv_names[c];
+		output_char(out, ',');
+		output_write(out, column->name, column->len);
+		output_str(out, column->suffix);
+	}
+	if (state->csv_time_ns) {
+		output_lit(out, ",time_ns");
+	}
+	output_char(out, '\n');
 }
 
-static const struct wl_touch_listener wl_touch_listener = {
-	.down = wl_touch_down,
-	.up = wl_touch_up,
-	.motion = wl_touch_motion,
-	.frame = wl_touch_frame,
-	.cancel = wl_touch_cancel,
-	.shape = wl_touch_shape,
-	.orientation = wl_touch_orientation,
-};
+/*
+ * Every event goes in the same table, which has a column for each field of
+ * the events which pass the filters. Events sharing a field name share its
+ * column, and leave the columns of fields they do not have empty.
+ */
+static bool csv_init(struct wev_state *state) {
+	struct wev_csv_column *columns = state->csv_names;
+	int count = 0;
 
-static void wl_seat_capabilities(void *data, struct wl_seat *wl_seat,
-		uint32_t capabilities) {
-	struct wev_state *state = data;
-	int n = proxy_log(state, (struct wl_proxy *)wl_seat, "capabilities", "");
-	if (capabilities == 0 && n != 0) {
-		printf(" none");
-	}
-	if ((capabilities & WL_SEAT_CAPABILITY_POINTER)) {
-		if (n != 0) {
-			printf("pointer ");
-		}
-		struct wl_pointer *pointer = wl_seat_get_pointer(wl_seat);
-		wl_pointer_add_listener(pointer, &wl_pointer_listener, data);
-	}
-	if ((capabilities & WL_SEAT_CAPABILITY_KEYBOARD)) {
-		if (n != 0) {
-			printf("keyboard ");
-		}
-		struct wl_keyboard *keyboard = wl_seat_get_keyboard(wl_seat);
-		wl_keyboard_add_listener(keyboard, &wl_keyboard_listener, data);
-	}
-	if ((capabilities & WL_SEAT_CAPABILITY_TOUCH)) {
-		if (n != 0) {
-			printf("touch ");
+	for (size_t i = 0; i < wev_interface_count; ++i) {
+		for (int op = 0; op < wev_interfaces[i]->event_count && op < 32; ++op) {
+			if (!(state->opts.event_mask[i] & (1u << op))) {
+				continue;
+			}
+			struct wev_event probe = { .iface = i, .opcode = op };
+			if (event_time_arg(&probe) >= 0 ||
+					i == WEV_ZWP_RELATIVE_POINTER_V1) {
+				state->csv_time_ns = true;
+			}
+			const char *fields = wev_event_fields[i][op];
+			struct wev_field field;
+			for (int arg = 0; wev_next_field(&fields, &field);
+					arg += wev_field_args(field.type)) {
+				for (int part = 0; part < field_parts(field.type); ++part) {
+					const char *suffix = field_suffix(field.type, part);
+					int c = 0;
+					while (c < count && (columns[c].len != field.len ||
+							strncmp(columns[c].name, field.name, field.len) ||
+							strcmp(columns[c].suffix, suffix))) {
+						++c;
+					}
+					if (c == WEV_CSV_COLUMNS) {
+						fprintf(stderr, "Too many CSV columns, "
+								"filter out some events with -f or -F\n");
+						return false;
+					}
+					if (c == count) {
+						columns[count].name = field.name;
+						columns[count].len = field.len;
+						columns[count].suffix = suffix;
+						++count;
+					}
+					state->csv_cells[i][op][c] = (arg << 2 | part) + 1;
+				}
+			}
 		}
-		struct wl_touch *touch = wl_seat_get_touch(wl_seat);
-		wl_touch_add_listener(touch, &wl_touch_listener, data);
 	}
-	if (n != 0) {
-		printf("\n");
+	state->csv_columns = count;
+	// With --flight, each dump has its own
+	if (!state->opts.flight) {
+		csv_header(state);
 	}
+	return true;
 }
 
-static void wl_seat_name(void *data, struct wl_seat *seat, const char *name) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)seat, "name", "%s\n", name);
-}
-
-static const struct wl_seat_listener wl_seat_listener = {
-	.capabilities = wl_seat_capabilities,
-	.name = wl_seat_name,
-};
+static void format_csv(struct wev_state *state, const struct wev_event *ev) {
+	struct wev_output *out = &state->out;
+	const struct wl_interface *iface = wev_interfaces[ev->iface];
+	output_uint64(out, ev->time);
+	output_char(out, ',');
+	output_uint(out, ev->id);
+	output_char(out, ',');
+	const char *seat = state->seat->name;
+	if (seat) {
+		output_csv_str(out, seat, strlen(seat));
+	}
+	output_char(out, ',');
+	output_str(out, iface->name);
+	output_char(out, ',');
+	output_str(out, iface->events[ev->opcode].name);
 
-static void wl_buffer_release(void *data, struct wl_buffer *wl_buffer) {
-	wl_buffer_destroy(wl_buffer);
+	char types[WEV_EVENT_MAX_ARGS];
+	const char *fields = wev_event_fields[ev->iface][ev->opcode];
+	struct wev_field field;
+	for (int arg = 0; wev_next_field(&fields, &field);
+			arg += wev_field_args(field.type)) {
+		types[arg] = field.type;
+	}
+	const uint8_t *cells = state->csv_cells[ev->iface][ev->opcode];
+	for (int c = 0; c < state->csv_columns; ++c) {
+		output_char(out, ',');
+		if (cells[c]) {
+			int arg = (cells[c] - 1) >> 2, part = (cells[c] - 1) & 3;
+			format_value(state, ev, arg, types[arg], part);
+		}
+	}
+	if (state->csv_time_ns) {
+		output_char(out, ',');
+		if (state->event_ns != 0) {
+			output_uint64(out, state->event_ns);
+		}
+	}
+	output_char(out, '\n');
 }
 
-static const struct wl_buffer_listener wl_buffer_listener = {
-	.release = wl_buffer_release,
-};
-
-static struct wl_buffer *create_buffer(struct wev_state *state) {
-	int stride = state->width * 4;
-	int size = stride * state->height;
-
-	int fd = allocate_shm_file(size);
-	if (fd == -1) {
-		fprintf(stderr, "Failed to create shm pool file: %s", strerror(errno));
-		return NULL;
+static void print_event(struct wev_state *state, const struct wev_event *ev) {
+	// By index, so just as cheap however many seats there are
+	struct wev_seat_state **seat = &state->seat_states[ev->seat];
+	if (!*seat && !(*seat = calloc(1, sizeof(**seat)))) {
+		fprintf(stderr, "Failed to allocate seat state\n");
+		return;
 	}
-
-	uint32_t *data = mmap(NULL, size,
-			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	if (data == MAP_FAILED) {
-		fprintf(stderr, "shm buffer mmap failed\n");
-		close(fd);
-		return NULL;
+	state->seat = *seat;
+	if (ev->iface == WEV_WL_SEAT && ev->opcode == WEV_WL_SEAT_NAME) {
+		free((*seat)->name);
+		(*seat)->name = strdup(wev_event_string(ev, 0));
 	}
 
-	struct wl_shm_pool *pool = wl_shm_create_pool(state->shm, fd, size);
-	struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0,
-			state->width, state->height, stride, WL_SHM_FORMAT_XRGB8888);
-	wl_shm_pool_destroy(pool);
-	close(fd);
+	state->event_ns = input_time(&state->input_time, ev);
+	if (ev->iface == WEV_ZWP_INPUT_TIMESTAMPS_V1) {
+		// Only shown along with the event it is for
+		return;
+	}
 
-	for (int y = 0; y < state->height; ++y) {
-		for (int x = 0; x < state->width; ++x) {
-			if ((x + y / 8 * 8) % 16 < 8) {
-				data[y * state->width + x] = 0xFF666666;
-			} else {
-				data[y * state->width + x] = 0xFFEEEEEE;
-			}
+	if (state->opts.format != WEV_FORMAT_TEXT) {
+		if (ev->iface == WEV_WL_KEYBOARD) {
+			keyboard_update(state, ev);
+		}
+		if (!event_visible(state, ev)) {
+			return;
 		}
+		if (state->opts.format == WEV_FORMAT_JSONL) {
+			format_json(state, ev);
+		} else {
+			format_csv(state, ev);
+		}
+		return;
 	}
-	munmap(data, size);
 
-	wl_buffer_add_listener(buffer, &wl_buffer_listener, NULL);
-
-	return buffer;
+	switch (ev->iface) {
+	case WEV_WL_REGISTRY:
+		print_wl_registry(state, ev);
+		break;
+	case WEV_WL_SEAT:
+		print_wl_seat(state, ev);
+		break;
+	case WEV_WL_POINTER:
+		print_wl_pointer(state, ev);
+		break;
+	case WEV_WL_KEYBOARD:
+		print_wl_keyboard(state, ev);
+		break;
+	case WEV_WL_TOUCH:
+		print_wl_touch(state, ev);
+		break;
+	case WEV_XDG_SURFACE:
+		print_xdg_surface(state, ev);
+		break;
+	case WEV_XDG_TOPLEVEL:
+		print_xdg_toplevel(state, ev);
+		break;
+	case WEV_WL_DATA_OFFER:
+		print_wl_data_offer(state, ev);
+		break;
+	case WEV_WL_DATA_DEVICE:
+		print_wl_data_device(state, ev);
+		break;
+	case WEV_ZWP_RELATIVE_POINTER_V1:
+		print_zwp_relative_pointer_v1(state, ev);
+		break;
+	case WEV_ZWP_LOCKED_POINTER_V1:
+		print_zwp_locked_pointer_v1(state, ev);
+		break;
+	case WEV_WP_PRESENTATION:
+		print_wp_presentation(state, ev);
+		break;
+	case WEV_WP_PRESENTATION_FEEDBACK:
+		print_wp_presentation_feedback(state, ev);
+		break;
+	case WEV_ZWP_TABLET_SEAT_V2:
+		print_zwp_tablet_seat_v2(state, ev);
+		break;
+	case WEV_ZWP_TABLET_V2:
+		print_zwp_tablet_v2(state, ev);
+		break;
+	case WEV_ZWP_TABLET_TOOL_V2:
+		print_zwp_tablet_tool_v2(state, ev);
+		break;
+	case WEV_ZWP_TABLET_PAD_V2:
+		print_zwp_tablet_pad_v2(state, ev);
+		break;
+	default:
+		print_generic(state, ev);
+		break;
+	}
 }
 
-static void xdg_toplevel_configure(void *data,
-		struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height,
-		struct wl_array *states) {
+static void *formatter_thread(void *data) {
 	struct wev_state *state = data;
-	state->width = width;
-	state->height = height;
-	if (state->width == 0 || state->height == 0) {
-		state->width = 640;
-		state->height = 480;
-	}
-	int n = proxy_log(state, (struct wl_proxy *)xdg_toplevel, "configure",
-			"width: %d; height: %d", width, height);
-	if (n != 0) {
-		if (states->size > 0) {
-			printf("\n" SPACER);
+	while (true) {
+		bool done = atomic_load(&state->formatter_done);
+		const struct wev_event *ev;
+		while ((ev = ring_peek(&state->ring))) {
+			print_event(state, ev);
+			ring_pop(&state->ring);
 		}
-		uint32_t *s;
-		wl_array_for_each(s, states) {
-			switch (*s) {
-			case XDG_TOPLEVEL_STATE_MAXIMIZED:
-				printf("maximized ");
-				break;
-			case XDG_TOPLEVEL_STATE_FULLSCREEN:
-				printf("fullscreen ");
-				break;
-			case XDG_TOPLEVEL_STATE_RESIZING:
-				printf("resizing ");
-				break;
-			case XDG_TOPLEVEL_STATE_ACTIVATED:
-				printf("activated ");
-				break;
-			case XDG_TOPLEVEL_STATE_TILED_LEFT:
-				printf("tiled-left ");
-				break;
-			case XDG_TOPLEVEL_STATE_TILED_RIGHT:
-				printf("tiled-right ");
-				break;
-			case XDG_TOPLEVEL_STATE_TILED_TOP:
-				printf("tiled-top ");
-				break;
-			case XDG_TOPLEVEL_STATE_TILED_BOTTOM:
-				printf("tiled-bottom ");
-				break;
-			}
+		output_flush(&state->out);
+		if (done) {
+			break;
+		}
+		uint64_t count;
+		if (read(state->ring_fd, &count, sizeof(count)) < 0 &&
+				errno != EINTR) {
+			break;
 		}
-		printf("\n");
 	}
+	return NULL;
 }
 
-static void xdg_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel) {
-	struct wev_state *state = data;
-	state->closed = true;
-	proxy_log(state, (struct wl_proxy *)xdg_toplevel, "close", "\n");
-}
-
-static const struct xdg_toplevel_listener xdg_toplevel_listener = {
-	.configure = xdg_toplevel_configure,
-	.close = xdg_toplevel_close,
-};
-
-static void xdg_surface_configure(
-		void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)xdg_surface, "configure",
-			"serial: %d\n", serial);
-	xdg_surface_ack_configure(xdg_surface, serial);
-	struct wl_buffer *buffer = create_buffer(state);
-	wl_surface_attach(state->surface, buffer, 0, 0);
-	wl_surface_damage_buffer(state->surface, 0, 0, INT32_MAX, INT32_MAX);
-	wl_surface_commit(state->surface);
+static int formatter_start(struct wev_state *state) {
+	if (ring_init(&state->ring, WEV_RING_SIZE) < 0) {
+		return -1;
+	}
+	state->ring_fd = eventfd(0, EFD_CLOEXEC);
+	if (state->ring_fd < 0) {
+		ring_finish(&state->ring);
+		return -1;
+	}
+	atomic_init(&state->formatter_done, false);
+	errno = pthread_create(&state->formatter, NULL, formatter_thread, state);
+	if (errno != 0) {
+		close(state->ring_fd);
+		ring_finish(&state->ring);
+		return -1;
+	}
+	return 0;
 }
 
-static const struct xdg_surface_listener xdg_surface_listener = {
-	.configure = xdg_surface_configure,
-};
-
-static void wm_base_ping(void *data,
-		struct xdg_wm_base *wm_base, uint32_t serial) {
-	xdg_wm_base_pong(wm_base, serial);
+static void formatter_wake(struct wev_state *state) {
+	uint64_t one = 1;
+	if (write(state->ring_fd, &one, sizeof(one)) < 0) {
+		fprintf(stderr, "Failed to wake formatter: %s\n", strerror(errno));
+	}
 }
 
-static const struct xdg_wm_base_listener xdg_wm_base_listener = {
-	.ping = wm_base_ping,
-};
+static void formatter_stop(struct wev_state *state) {
+	atomic_store(&state->formatter_done, true);
+	formatter_wake(state);
+	pthread_join(state->formatter, NULL);
+	close(state->ring_fd);
 
-static void wl_data_offer_offer(void *data, struct wl_data_offer *offer,
-		const char * mime_type) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)offer, "offer",
-			"mime_type: %s\n", mime_type);
+	struct wev_ring *ring = &state->ring;
+	fprintf(stderr, "Event ring: high water %zu of %zu bytes; "
+			"%" PRIu64 " events queued, %" PRIu64 " dropped\n",
+			ring->high_water, ring->cap, ring->pushed, ring->dropped);
+	ring_finish(ring);
 }
 
-static const char *dnd_actions_str(uint32_t state) {
-	switch (state) {
-	case WL_DATA_DEVICE_MANAGER_DND_ACTION_NONE:
-		return "none";
-	case WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY:
-		return "copy";
-	case WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE:
-		return "move";
-	case WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY |
-			WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE:
-		return "copy, move";
-	case WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK:
-		return "ask";
-	case WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY |
-			WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK:
-		return "copy, ask";
-	case WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE |
-			WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK:
-		return "move, ask";
-	case WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY |
-			WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE |
-			WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK:
-		return "copy, move, ask";
-	default:
-		return "unknown";
+/* Appends the events in the --flight window to its file, and forgets them */
+static void flight_dump(struct wev_state *state) {
+	int fd = open(state->opts.flight,
+			O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n",
+				state->opts.flight, strerror(errno));
+		return;
 	}
+	struct wev_output *out = &state->out;
+	output_flush(out);
+	int out_fd = out->fd;
+	out->fd = fd;
+	if (state->opts.format == WEV_FORMAT_TEXT) {
+		output_lit(out, "Flight recorder dump: ");
+		output_str(out, state->flight_reason);
+		output_char(out, '\n');
+	} else if (state->opts.format == WEV_FORMAT_CSV) {
+		csv_header(state);
+	}
+	size_t count = state->flight_count;
+	const struct wev_event *ev;
+	while ((ev = ring_peek(&state->flight))) {
+		print_event(state, ev);
+		ring_pop(&state->flight);
+	}
+	state->flight_count = 0;
+	output_flush(out);
+	out->fd = out_fd;
+	close(fd);
+	fprintf(stderr, "Dumped %zu events to %s: %s\n",
+			count, state->opts.flight, state->flight_reason);
 }
 
-static void wl_data_offer_source_actions(void *data,
-		struct wl_data_offer *offer, uint32_t actions) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)offer, "source_actions",
-			"actions: %u (%s)\n", actions, dnd_actions_str(actions));
-}
-
-static void wl_data_offer_action(void *data, struct wl_data_offer *offer,
-		uint32_t dnd_action) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)offer, "action",
-			"dnd_action: %u (%s)\n", dnd_action, dnd_actions_str(dnd_action));
+/* Called after each batch of events has been dispatched */
+static void flush_events(struct wev_state *state) {
+	if (!state->opts.threaded) {
+		output_flush(&state->out);
+	} else if (state->ring.pushed != state->ring_signaled) {
+		state->ring_signaled = state->ring.pushed;
+		formatter_wake(state);
+	}
+	if (state->latency_report_pending) {
+		state->latency_report_pending = false;
+		latency_report(state);
+	}
+	if (state->flight_pending) {
+		flight_dump(state);
+		state->flight_pending = false;
+	}
 }
 
-static const struct wl_data_offer_listener wl_data_offer_listener = {
-	.offer = wl_data_offer_offer,
-	.source_actions = wl_data_offer_source_actions,
-	.action = wl_data_offer_action,
+enum wev_loop_source {
+	WEV_LOOP_DISPLAY,
+	WEV_LOOP_SIGNAL,
+	WEV_LOOP_TIMER,
+	WEV_LOOP_RATE_TIMER,
+	WEV_LOOP_PUBLISH,
 };
 
-static void wl_data_device_data_offer(void *data,
-		struct wl_data_device *device, struct wl_data_offer *id) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)device, "data_offer",
-			"id: %u\n", wl_proxy_get_id((struct wl_proxy *)id));
-
-	wl_data_offer_add_listener(id, &wl_data_offer_listener, data);
+static int loop_add(struct wev_state *state, int fd, uint32_t events,
+		enum wev_loop_source source) {
+	struct epoll_event ev = { .events = events, .data.u32 = source };
+	return epoll_ctl(state->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
 }
 
-static void wl_data_device_enter(void *data,
-		struct wl_data_device *device, uint32_t serial,
-		struct wl_surface *surface, wl_fixed_t x, wl_fixed_t y,
-		struct wl_data_offer *id) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)device, "enter",
-			"serial: %d; surface: %d; x, y: %f, %f; id: %u\n", serial,
-			wl_proxy_get_id((struct wl_proxy *)surface),
-			wl_fixed_to_double(x), wl_fixed_to_double(y),
-			wl_proxy_get_id((struct wl_proxy *)id));
-
-	state->dnd = id;
-	wl_data_offer_set_actions(id,
-			WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY |
-				WL_DATA_DEVICE_MANAGER_DND_ACTION_MOVE |
-				WL_DATA_DEVICE_MANAGER_DND_ACTION_ASK,
-			WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY);
+/* Returns a timerfd which fires every interval nanoseconds */
+static int loop_add_timer(struct wev_state *state, uint64_t interval_ns,
+		enum wev_loop_source source) {
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	struct timespec interval = {
+		.tv_sec = interval_ns / 1000000000,
+		.tv_nsec = interval_ns % 1000000000,
+	};
+	struct itimerspec spec = { .it_interval = interval, .it_value = interval };
+	if (timerfd_settime(fd, 0, &spec, NULL) < 0 ||
+			loop_add(state, fd, EPOLLIN, source) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
 
-	// Static accept just so we have something.
-	wl_data_offer_accept(id, serial, "text/plain");
+/*
+ * Sets up the fds dispatch_events waits on: the Wayland display, a signalfd
+ * for the signals we handle, and with --stats and --pointer-rate timerfds
+ * for the reports.
+ * The signals must be blocked before any other thread is started.
+ */
+static int loop_init(struct wev_state *state) {
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) {
+		return -1;
+	}
+	state->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	state->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (state->signal_fd < 0 || state->epoll_fd < 0 ||
+			loop_add(state, state->signal_fd, EPOLLIN, WEV_LOOP_SIGNAL) < 0) {
+		return -1;
+	}
+
+	state->timer_fd = -1;
+	state->rate_timer_fd = -1;
+	if (state->opts.stats_interval && (state->timer_fd = loop_add_timer(state,
+				state->opts.stats_interval, WEV_LOOP_TIMER)) < 0) {
+		return -1;
+	}
+	if (state->opts.pointer_rate_interval &&
+			(state->rate_timer_fd = loop_add_timer(state,
+				state->opts.pointer_rate_interval, WEV_LOOP_RATE_TIMER)) < 0) {
+		return -1;
+	}
+	return 0;
 }
 
-static void wl_data_device_leave(void *data,
-		struct wl_data_device *device) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)device, "leave", "\n");
+static int loop_add_display(struct wev_state *state) {
+	return loop_add(state, wl_display_get_fd(state->display), EPOLLIN,
+			WEV_LOOP_DISPLAY);
+}
 
-	// Might have already been destroyed during a drop event.
-	if (state->dnd != NULL) {
-		wl_data_offer_destroy(state->dnd);
-		state->dnd = NULL;
+static void loop_finish(struct wev_state *state) {
+	close(state->epoll_fd);
+	close(state->signal_fd);
+	if (state->timer_fd >= 0) {
+		close(state->timer_fd);
+	}
+	if (state->rate_timer_fd >= 0) {
+		close(state->rate_timer_fd);
 	}
 }
 
-static void wl_data_device_motion(void *data,
-		struct wl_data_device *device, uint32_t serial, wl_fixed_t x,
-		wl_fixed_t y) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)device, "motion",
-			"serial: %d; x, y: %f, %f\n", serial, wl_fixed_to_double(x),
-			wl_fixed_to_double(y));
+static void handle_signals(struct wev_state *state) {
+	struct signalfd_siginfo info;
+	while (read(state->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+		switch (info.ssi_signo) {
+		case SIGINT:
+		case SIGTERM:
+			// Leave the loop, so whatever is buffered still gets printed
+			state->closed = true;
+			break;
+		case SIGUSR1:
+			state->latency_report_pending = state->opts.latency;
+			if (state->opts.flight) {
+				flight_trigger(state, "SIGUSR1");
+			}
+			break;
+		}
+	}
 }
 
-static void wl_data_device_drop(void *data,
-		struct wl_data_device *device) {
-	struct wev_state *state = data;
-	proxy_log(state, (struct wl_proxy *)device, "drop", "\n");
+static void handle_timer(struct wev_state *state) {
+	uint64_t expirations;
+	// Missed ticks are folded into one report
+	if (read(state->timer_fd, &expirations, sizeof(expirations)) > 0) {
+		stats_report(state, monotonic_ns());
+	}
+}
 
-	// We don't actually want the data, so cancel the drop.
-	wl_data_offer_destroy(state->dnd);
-	state->dnd = NULL;
+static void handle_rate_timer(struct wev_state *state) {
+	uint64_t expirations;
+	if (read(state->rate_timer_fd, &expirations, sizeof(expirations)) > 0) {
+		pointer_rate_summary(state, monotonic_ns());
+	}
 }
 
-static void wl_data_device_selection(void *data,
-		struct wl_data_device *device, struct wl_data_offer *id) {
-	struct wev_state *state = data;
-	if (id == NULL) {
-		proxy_log(state, (struct wl_proxy *)device, "selection",
-				"(cleared)\n");
+/*
+ * Sends our requests, waits until something happens and dispatches the events
+ * read from the display. Only the socket buffer filling up makes us wait for
+ * the display to become writable; we never block in wl_display_flush.
+ */
+static int dispatch_events(struct wev_state *state) {
+	struct wl_display *display = state->display;
+	int display_fd = wl_display_get_fd(display);
+	while (wl_display_prepare_read(display) != 0) {
+		if (wl_display_dispatch_pending(display) < 0) {
+			return -1;
+		}
+	}
+
+	bool blocked = false;
+	if (wl_display_flush(display) < 0) {
+		if (errno != EAGAIN) {
+			wl_display_cancel_read(display);
+			return -1;
+		}
+		blocked = true;
 	}
-	else {
-		proxy_log(state, (struct wl_proxy *)device, "selection", "id: %u\n",
-				wl_proxy_get_id((struct wl_proxy *)id));
+	if (blocked != state->display_blocked) {
+		struct epoll_event ev = {
+			.events = blocked ? EPOLLIN | EPOLLOUT : EPOLLIN,
+			.data.u32 = WEV_LOOP_DISPLAY,
+		};
+		epoll_ctl(state->epoll_fd, EPOLL_CTL_MOD, display_fd, &ev);
+		state->display_blocked = blocked;
 	}
 
-	if (state->selection != NULL) {
-		wl_data_offer_destroy(state->selection);
+	struct epoll_event events[5];
+	int n = epoll_wait(state->epoll_fd, events,
+			sizeof(events) / sizeof(events[0]), -1);
+	if (n < 0 && errno != EINTR) {
+		wl_display_cancel_read(display);
+		return -1;
 	}
-	state->selection = id;  // May be NULL.
-}
 
-static const struct wl_data_device_listener wl_data_device_listener = {
-	.data_offer = wl_data_device_data_offer,
-	.enter = wl_data_device_enter,
-	.leave = wl_data_device_leave,
-	.motion = wl_data_device_motion,
-	.drop = wl_data_device_drop,
-	.selection = wl_data_device_selection,
-};
+	bool readable = false;
+	for (int i = 0; i < n; ++i) {
+		switch (events[i].data.u32) {
+		case WEV_LOOP_DISPLAY:
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				// Let read_events report the error, if there is one
+				readable = true;
+			}
+			readable |= events[i].events & EPOLLIN;
+			break;
+		case WEV_LOOP_SIGNAL:
+			handle_signals(state);
+			break;
+		case WEV_LOOP_TIMER:
+			handle_timer(state);
+			break;
+		case WEV_LOOP_RATE_TIMER:
+			handle_rate_timer(state);
+			break;
+		case WEV_LOOP_PUBLISH:
+			publish_accept(&state->publish);
+			break;
+		}
+	}
 
-static void registry_global(void *data, struct wl_registry *wl_registry,
-		uint32_t name, const char *interface, uint32_t version) {
-	struct wev_state *state = data;
-	struct {
-		const struct wl_interface *interface;
-		int version;
-		void **ptr;
-	} handles[] = {
-		{ &wl_compositor_interface, 4, (void **)&state->compositor },
-		{ &wl_seat_interface, 6, (void **)&state->seat },
-		{ &wl_shm_interface, 1, (void **)&state->shm },
-		{ &xdg_wm_base_interface, 2, (void **)&state->wm_base },
-		{ &wl_data_device_manager_interface, 3,
-			(void **)&state->data_device_manager },
-	};
-	char *xdg_current_desktop = getenv("XDG_CURRENT_DESKTOP");
+	if (!readable) {
+		wl_display_cancel_read(display);
+		return wl_display_dispatch_pending(display);
+	}
+	if (wl_display_read_events(display) < 0) {
+		return -1;
+	}
+	return wl_display_dispatch_pending(display);
+}
 
-	/* Mutter currently implements wl_seat version 5, not 6 */
-	if (xdg_current_desktop && !strcmp(xdg_current_desktop, "GNOME"))
-		handles[1].version = 5;
+/* Lists the interfaces numbered from WEV_INTERFACE_COUNT on */
+static void interface_table(struct wev_interface_table *table) {
+	memset(table, 0, sizeof(*table));
+	for (size_t i = WEV_INTERFACE_COUNT; i < wev_interface_count; ++i) {
+		struct wev_interface_name *entry =
+			&table->interfaces[table->count++];
+		snprintf(entry->name, sizeof(entry->name), "%s",
+				wev_interfaces[i]->name);
+		entry->version = wev_interfaces[i]->version;
+	}
+}
 
-	for (size_t i = 0; i < sizeof(handles) / sizeof(handles[0]); ++i) {
-		if (strcmp(interface, handles[i].interface->name) == 0) {
-			*handles[i].ptr = wl_registry_bind(wl_registry,
-					name, handles[i].interface, handles[i].version);
+/*
+ * Matches the interfaces of a trace or publisher up with ours by name, since
+ * they could have been numbered in another order, or not be ours at all.
+ */
+static void replay_interfaces(struct wev_state *state,
+		const struct wev_interface_table *table) {
+	for (size_t i = 0; i < WEV_INTERFACE_MAX; ++i) {
+		state->replay_ifaces[i] = i < WEV_INTERFACE_COUNT ?
+			i : WEV_INTERFACE_MAX;
+	}
+	for (uint32_t n = 0; n < table->count; ++n) {
+		const char *name = table->interfaces[n].name;
+		for (size_t i = WEV_INTERFACE_COUNT; i < wev_interface_count; ++i) {
+			if (strcmp(wev_interfaces[i]->name, name) == 0) {
+				state->replay_ifaces[WEV_INTERFACE_COUNT + n] = i;
+			}
 		}
 	}
+}
 
-	if (state->opts.print_globals) {
-		proxy_log(state, (struct wl_proxy *)wl_registry, "global",
-				"interface: '%s', version: %d, name: %d\n",
-				interface, version, name);
+static struct wev_event *replay_copy(struct wev_state *state,
+		const struct wev_event *ev) {
+	struct wev_event *copy = event_reserve(state, ev->size);
+	if (!copy) {
+		fprintf(stderr, "Failed to allocate event record\n");
+		return NULL;
 	}
+	memcpy(copy, ev, ev->size);
+	return copy;
 }
 
-static void registry_global_remove(
-		void *data, struct wl_registry *wl_registry, uint32_t name) {
-	/* Who cares */
+/*
+ * Prints an event recorded by wev -w or published with --publish, with our
+ * own filters. Returns false if its interface is unknown.
+ */
+static bool replay_event(struct wev_state *state, const struct wev_event *ev) {
+	uint8_t iface = ev->iface < WEV_INTERFACE_MAX ?
+		state->replay_ifaces[ev->iface] : WEV_INTERFACE_MAX;
+	if (iface >= wev_interface_count || ev->opcode >= 32 ||
+			ev->opcode >= wev_interfaces[iface]->event_count) {
+		return false;
+	}
+	if (!wev_event_valid(ev, wev_event_fields[iface][ev->opcode])) {
+		++state->replay_malformed;
+		return true;
+	}
+	struct wev_event *copy = NULL;
+	if (iface != ev->iface) {
+		if (!(copy = replay_copy(state, ev))) {
+			return true;
+		}
+		copy->iface = iface;
+		ev = copy;
+	}
+	const struct wev_predicate_program *where =
+		state->opts.where_programs[ev->iface][ev->opcode];
+	if (where && event_visible(state, ev) && !predicate_run(where, ev)) {
+		if (!(state->opts.stateful_mask[ev->iface] & (1u << ev->opcode))) {
+			return true;
+		}
+		if (!copy && !(copy = replay_copy(state, ev))) {
+			return true;
+		}
+		copy->flags |= WEV_EVENT_HIDDEN;
+		ev = copy;
+	}
+	if (state->opts.latency) {
+		latency_record(state, ev);
+	}
+	print_event(state, ev);
+	return true;
 }
 
-static const struct wl_registry_listener wl_registry_listener = {
-	.global = registry_global,
-	.global_remove = registry_global_remove,
-};
+static int decode(struct wev_state *state) {
+	struct wev_trace trace;
+	if (trace_open(&trace, state->opts.decode) < 0) {
+		fprintf(stderr, "Failed to open trace %s: %s\n",
+				state->opts.decode, strerror(errno));
+		return 1;
+	}
+	replay_interfaces(state, trace.interfaces);
+	size_t offset = 0;
+	const struct wev_event *ev;
+	bool unknown = false;
+	while ((ev = trace_next(&trace, &offset))) {
+		unknown |= !replay_event(state, ev);
+	}
+	output_flush(&state->out);
+	trace_close(&trace);
+	if (unknown) {
+		fprintf(stderr, "Skipped events of unknown interfaces, "
+				"pass the --bind options the trace was recorded with\n");
+	}
+	if (state->replay_malformed) {
+		fprintf(stderr, "Skipped %" PRIu64 " malformed events\n",
+				state->replay_malformed);
+	}
+	if (state->opts.latency) {
+		latency_report(state);
+	}
+	if (state->opts.touch_contacts) {
+		touch_contacts_report(state);
+	}
+	return 0;
+}
+
+/*
+ * Prints the events another wev publishes, until it exits. Nothing tells
+ * when there are new ones, so the ring is polled every millisecond.
+ */
+static int subscribe(struct wev_state *state) {
+	struct wev_subscription sub;
+	if (subscription_open(&sub, state->opts.subscribe) < 0) {
+		fprintf(stderr, "Failed to subscribe to %s: %s\n",
+				state->opts.subscribe, strerror(errno));
+		return 1;
+	}
+	replay_interfaces(state, &sub.header->interfaces);
+	const struct wev_event *ev;
+	uint64_t missed = 0, truncated = 0;
+	bool unknown = false, closed = false;
+	while (!closed) {
+		// Checked first, so that the last events are not left behind
+		closed = subscription_closed(&sub);
+		while ((ev = subscription_next(&sub, &missed))) {
+			if (ev->flags & WEV_EVENT_TRUNCATED) {
+				++truncated;
+				continue;
+			}
+			unknown |= !replay_event(state, ev);
+		}
+		output_flush(&state->out);
+		if (!closed) {
+			nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+		}
+	}
+	subscription_close(&sub);
+	if (missed) {
+		fprintf(stderr, "Missed %" PRIu64 " events which were overwritten "
+				"before they were read\n", missed);
+	}
+	if (truncated) {
+		fprintf(stderr, "Skipped %" PRIu64 " events which were too large "
+				"to publish\n", truncated);
+	}
+	if (unknown) {
+		fprintf(stderr, "Skipped events of unknown interfaces, "
+				"pass the --bind options of the publisher\n");
+	}
+	if (state->replay_malformed) {
+		fprintf(stderr, "Skipped %" PRIu64 " malformed events\n",
+				state->replay_malformed);
+	}
+	if (state->opts.latency) {
+		latency_report(state);
+	}
+	if (state->opts.touch_contacts) {
+		touch_contacts_report(state);
+	}
+	return 0;
+}
 
 void show_usage(void) {
 	printf("Usage: wev [-g] "
-			"[-f <interface[:event]>] [-F <interface[:event]>] [-M <path>]\n");
+			"[-f <interface[:event]>] [-F <interface[:event]>] [-M <path>]\n"
+			"           [-w <path>] [--threaded] [--latency] [--frames]\n"
+			"           [--stats <seconds>] [--stats-file <path>]\n"
+			"           [--format <text|jsonl|csv>] [--lock-pointer] [--present]\n"
+			"           [--bind <interface[:version]>] [--where <expression>]\n"
+			"           [--publish <path>] [--flight <path>] "
+			"[--flight-window <events|seconds>]\n"
+			"           [--flight-chord <key+key...>] "
+			"[--pointer-rate <seconds>] [--touch-contacts]\n"
+			"       wev --decode <path> "
+			"[-f <interface[:event]>] [-F <interface[:event]>] [--latency]\n"
+			"           [--frames] [--format <text|jsonl|csv>] "
+			"[--bind <interface[:version]>]\n"
+			"           [--where <expression>] [--touch-contacts]\n"
+			"       wev --subscribe <path> "
+			"[-f <interface[:event]>] [-F <interface[:event]>]\n"
+			"           [--latency] [--frames] [--format <text|jsonl|csv>]\n"
+			"           [--bind <interface[:version]>] "
+			"[--where <expression>] [--touch-contacts]\n");
 }
 
 void add_filter(struct wl_list *list, char *filter) {
@@ -859,14 +5515,269 @@ void add_filter(struct wl_list *list, char *filter) {
 	wl_list_insert(list, &f->link);
 }
 
+/* Globals --bind can trace, which needs their wl_interface built in */
+static const struct wl_interface *const wev_bindable[] = {
+	&wl_compositor_interface,
+	&wl_shm_interface,
+	&wl_seat_interface,
+	&wl_output_interface,
+	&wl_data_device_manager_interface,
+	&xdg_wm_base_interface,
+	&zwp_input_timestamps_manager_v1_interface,
+	&zwp_relative_pointer_manager_v1_interface,
+	&zwp_pointer_constraints_v1_interface,
+	&wp_presentation_interface,
+	&zwp_tablet_manager_v2_interface,
+};
+
+static bool add_bind(struct wev_state *state, char *arg) {
+	char *version = strchr(arg, ':');
+	if (version) {
+		*version++ = '\0';
+	}
+	const struct wl_interface *interface = NULL;
+	for (size_t i = 0; i < sizeof(wev_bindable) / sizeof(wev_bindable[0]);
+			++i) {
+		if (strcmp(arg, wev_bindable[i]->name) == 0) {
+			interface = wev_bindable[i];
+		}
+	}
+	if (!interface) {
+		fprintf(stderr, "Cannot bind %s, it is not built in\n", arg);
+		return false;
+	}
+
+	struct wev_bind *bind = calloc(1, sizeof(*bind));
+	if (!bind) {
+		fprintf(stderr, "Failed to allocate %s\n", arg);
+		return false;
+	}
+	bind->version = interface->version;
+	if (version) {
+		char *end;
+		unsigned long v = strtoul(version, &end, 10);
+		if (*end || v == 0 || v > (unsigned long)interface->version) {
+			fprintf(stderr, "Invalid %s version: %s\n", arg, version);
+			free(bind);
+			return false;
+		}
+		bind->version = v;
+	}
+	uint8_t iface = generic_register(state, interface);
+	if (iface == 0) {
+		free(bind);
+		return false;
+	}
+	bind->generic = state->generic[iface];
+	wl_list_insert(state->opts.binds.prev, &bind->link);
+	return true;
+}
+
+static bool add_where(struct wev_options *opts, const char *expr) {
+	struct wev_predicate_error error;
+	struct wev_predicate *pred = predicate_parse(expr, &error);
+	if (!pred) {
+		fprintf(stderr, "Invalid expression: %s\n    %s\n    %*s^\n",
+				error.message, expr, (int)error.offset, "");
+		return false;
+	}
+	if (opts->where && !(pred = predicate_and(opts->where, pred))) {
+		fprintf(stderr, "Too many --where expressions\n");
+		return false;
+	}
+	opts->where = pred;
+	return true;
+}
+
+/* A number of events, or of seconds if followed by s */
+static bool set_flight_window(struct wev_options *opts, const char *arg) {
+	char *end;
+	double window = strtod(arg, &end);
+	if (strcmp(end, "s") == 0 && window > 0) {
+		opts->flight_window = window * 1e9;
+		opts->flight_events = 0;
+		return true;
+	}
+	if (*end || window < 1 || window != (size_t)window) {
+		fprintf(stderr, "Invalid flight recorder window: %s\n", arg);
+		return false;
+	}
+	opts->flight_window = 0;
+	opts->flight_events = window;
+	return true;
+}
+
+/* Key codes as wev shows them, joined with + */
+static bool set_flight_chord(struct wev_options *opts, const char *arg) {
+	opts->flight_chord_len = 0;
+	const char *key = arg;
+	do {
+		char *end;
+		unsigned long code = strtoul(key, &end, 10);
+		if (end == key || (*end && *end != '+') || code < 8 ||
+				code - 8 >= WEV_FLIGHT_KEYS ||
+				opts->flight_chord_len == WEV_FLIGHT_CHORD_KEYS) {
+			fprintf(stderr, "Invalid key chord: %s\n", arg);
+			return false;
+		}
+		opts->flight_chord[opts->flight_chord_len++] = code - 8;
+		key = *end ? end + 1 : NULL;
+	} while (key);
+	return true;
+}
+
+static bool filter_match(struct wl_list *list,
+		const char *iface, const char *event) {
+	struct wev_filter *filter;
+	wl_list_for_each(filter, list, link) {
+		if (strcmp(filter->interface, iface) == 0 &&
+				(!filter->event || strcmp(filter->event, event) == 0)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Specializes --where for each event which passes -f/-F. Events it cannot be
+ * true for are filtered out, and those it is always true for need no program.
+ */
+static bool compile_where(struct wev_options *opts) {
+	for (size_t i = 0; i < wev_interface_count; ++i) {
+		for (int op = 0; op < wev_interfaces[i]->event_count && op < 32; ++op) {
+			if (!(opts->event_mask[i] & (1u << op))) {
+				continue;
+			}
+			enum wev_predicate_result result;
+			if (predicate_compile(opts->where, wev_event_fields[i][op],
+						&result, &opts->where_programs[i][op]) < 0) {
+				fprintf(stderr, "Failed to allocate --where program\n");
+				return false;
+			}
+			if (result == WEV_PREDICATE_FALSE) {
+				opts->event_mask[i] &= ~(1u << op);
+			}
+		}
+	}
+
+	const struct wev_predicate *unresolved = predicate_unresolved(opts->where);
+	if (unresolved) {
+		fprintf(stderr, "No event which passes the filters has a field %s "
+				"which can be compared with %s\n",
+				unresolved->field, unresolved->value);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Resolves the -f/-F lists against every event of every interface we listen
+ * to, so event_emit only has to test one bit per event, then --where.
+ */
+static bool compile_filters(struct wev_options *opts) {
+	for (size_t i = 0; i < wev_interface_count; ++i) {
+		const struct wl_interface *iface = wev_interfaces[i];
+		uint32_t mask = 0;
+		for (int op = 0; op < iface->event_count && op < 32; ++op) {
+			const char *event = iface->events[op].name;
+			if (!wl_list_empty(&opts->filters) &&
+					!filter_match(&opts->filters, iface->name, event)) {
+				continue;
+			}
+			if (filter_match(&opts->inverse_filters, iface->name, event)) {
+				continue;
+			}
+			mask |= 1u << op;
+		}
+		opts->event_mask[i] = mask;
+		opts->stateful_mask[i] = wev_stateful_events[i];
+	}
+
+	if (opts->frames) {
+		// Frame events tell when to print the others, and the rest are
+		// needed to track where the pointer and touch points are
+		opts->stateful_mask[WEV_WL_POINTER] |=
+			1u << WEV_WL_POINTER_FRAME | 1u << WEV_WL_POINTER_ENTER;
+		opts->stateful_mask[WEV_WL_TOUCH] |=
+			1u << WEV_WL_TOUCH_FRAME | 1u << WEV_WL_TOUCH_DOWN |
+			1u << WEV_WL_TOUCH_UP | 1u << WEV_WL_TOUCH_CANCEL;
+		opts->stateful_mask[WEV_ZWP_TABLET_TOOL_V2] |=
+			1u << WEV_ZWP_TABLET_TOOL_V2_FRAME;
+	}
+	if (opts->touch_contacts) {
+		opts->stateful_mask[WEV_WL_TOUCH] |=
+			1u << WEV_WL_TOUCH_DOWN | 1u << WEV_WL_TOUCH_UP |
+			1u << WEV_WL_TOUCH_MOTION | 1u << WEV_WL_TOUCH_FRAME |
+			1u << WEV_WL_TOUCH_CANCEL;
+	}
+	if (opts->pointer_rate_interval) {
+		opts->stateful_mask[WEV_WL_POINTER] |=
+			1u << WEV_WL_POINTER_MOTION | 1u << WEV_WL_POINTER_FRAME;
+		opts->stateful_mask[WEV_ZWP_RELATIVE_POINTER_V1] |=
+			1u << WEV_ZWP_RELATIVE_POINTER_V1_RELATIVE_MOTION;
+	}
+	if (opts->flight) {
+		// Watched for anomalies and the key chord, even if not dumped
+		opts->stateful_mask[WEV_WL_KEYBOARD] |=
+			1u << WEV_WL_KEYBOARD_ENTER | 1u << WEV_WL_KEYBOARD_LEAVE |
+			1u << WEV_WL_KEYBOARD_KEY;
+		opts->stateful_mask[WEV_WL_TOUCH] |=
+			1u << WEV_WL_TOUCH_DOWN | 1u << WEV_WL_TOUCH_UP |
+			1u << WEV_WL_TOUCH_MOTION | 1u << WEV_WL_TOUCH_CANCEL;
+	}
+	return !opts->where || compile_where(opts);
+}
+
 int main(int argc, char *argv[]) {
 	struct wev_state state = { 0 };
+	state.out.fd = STDOUT_FILENO;
 	wl_list_init(&state.opts.filters);
 	wl_list_init(&state.opts.inverse_filters);
+	wl_list_init(&state.opts.binds);
+	// Before any --bind, so that their index does not depend on those
+	state.pad_group_iface =
+		generic_register(&state, &zwp_tablet_pad_group_v2_interface);
+	state.opts.flight_window = 10 * UINT64_C(1000000000);
+
+	static const struct option long_options[] = {
+		{ "decode", required_argument, NULL, 'd' },
+		{ "threaded", no_argument, NULL, 't' },
+		{ "latency", no_argument, NULL, 'l' },
+		{ "frames", no_argument, NULL, 'r' },
+		{ "stats", required_argument, NULL, 's' },
+		{ "stats-file", required_argument, NULL, 'S' },
+		{ "format", required_argument, NULL, 'o' },
+		{ "lock-pointer", no_argument, NULL, 'L' },
+		{ "present", no_argument, NULL, 'p' },
+		{ "bind", required_argument, NULL, 'b' },
+		{ "where", required_argument, NULL, 'W' },
+		{ "publish", required_argument, NULL, 'P' },
+		{ "subscribe", required_argument, NULL, 'U' },
+		{ "flight", required_argument, NULL, 'R' },
+		{ "flight-window", required_argument, NULL, 'N' },
+		{ "flight-chord", required_argument, NULL, 'C' },
+		{ "pointer-rate", required_argument, NULL, 'T' },
+		{ "touch-contacts", no_argument, NULL, 'K' },
+		{ 0 },
+	};
 
 	int opt;
-	while ((opt = getopt(argc, argv, "f:F:ghM:")) != -1) {
+	while ((opt = getopt_long(argc, argv, "f:F:ghM:w:",
+					long_options, NULL)) != -1) {
 		switch (opt) {
+		case 'b':
+			if (!add_bind(&state, optarg)) {
+				return 1;
+			}
+			break;
+		case 'C':
+			if (!set_flight_chord(&state.opts, optarg)) {
+				return 1;
+			}
+			break;
+		case 'd':
+			state.opts.decode = optarg;
+			break;
 		case 'f':
 			add_filter(&state.opts.filters, optarg);
 			break;
@@ -879,9 +5790,82 @@ int main(int argc, char *argv[]) {
 		case 'h':
 			show_usage();
 			return 0;
+		case 'l':
+			state.opts.latency = true;
+			break;
+		case 'K':
+			state.opts.touch_contacts = true;
+			break;
+		case 'L':
+			state.opts.lock_pointer = true;
+			break;
 		case 'M':
 			state.opts.dump_map = optarg;
 			break;
+		case 'N':
+			if (!set_flight_window(&state.opts, optarg)) {
+				return 1;
+			}
+			break;
+		case 'o':
+			if (strcmp(optarg, "text") == 0) {
+				state.opts.format = WEV_FORMAT_TEXT;
+			} else if (strcmp(optarg, "jsonl") == 0) {
+				state.opts.format = WEV_FORMAT_JSONL;
+			} else if (strcmp(optarg, "csv") == 0) {
+				state.opts.format = WEV_FORMAT_CSV;
+			} else {
+				fprintf(stderr, "Invalid format: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			state.opts.present = true;
+			break;
+		case 'P':
+			state.opts.publish = optarg;
+			break;
+		case 'r':
+			state.opts.frames = true;
+			break;
+		case 'R':
+			state.opts.flight = optarg;
+			break;
+		case 's':;
+			char *end;
+			double interval = strtod(optarg, &end);
+			if (*end || !(interval > 0)) {
+				fprintf(stderr, "Invalid stats interval: %s\n", optarg);
+				return 1;
+			}
+			state.opts.stats_interval = interval * 1e9;
+			break;
+		case 'S':
+			state.opts.stats_file = optarg;
+			break;
+		case 't':
+			state.opts.threaded = true;
+			break;
+		case 'T':;
+			double rate_interval = strtod(optarg, &end);
+			if (*end || !(rate_interval > 0)) {
+				fprintf(stderr, "Invalid pointer rate interval: %s\n",
+						optarg);
+				return 1;
+			}
+			state.opts.pointer_rate_interval = rate_interval * 1e9;
+			break;
+		case 'U':
+			state.opts.subscribe = optarg;
+			break;
+		case 'w':
+			state.opts.record = optarg;
+			break;
+		case 'W':
+			if (!add_where(&state.opts, optarg)) {
+				return 1;
+			}
+			break;
 		default:
 			show_usage();
 			return 1;
@@ -891,9 +5875,82 @@ int main(int argc, char *argv[]) {
 		show_usage();
 		return 1;
 	}
+	if (!compile_filters(&state.opts)) {
+		return 1;
+	}
+	if (state.opts.format == WEV_FORMAT_CSV && !csv_init(&state)) {
+		return 1;
+	}
 
 	state.xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
 
+	state.event_cap = 4096;
+	state.event = malloc(state.event_cap);
+	if (!state.event) {
+		fprintf(stderr, "Failed to allocate event record\n");
+		return 1;
+	}
+
+	if (state.opts.decode) {
+		return decode(&state);
+	}
+	if (state.opts.subscribe) {
+		return subscribe(&state);
+	}
+
+	if (loop_init(&state) < 0) {
+		fprintf(stderr, "Failed to set up event loop: %s\n", strerror(errno));
+		return 1;
+	}
+	struct wev_interface_table interfaces;
+	interface_table(&interfaces);
+	if (state.opts.publish) {
+		if (publish_create(&state.publish, state.opts.publish,
+					&interfaces) < 0) {
+			fprintf(stderr, "Failed to publish events on %s: %s\n",
+					state.opts.publish, strerror(errno));
+			return 1;
+		}
+		if (loop_add(&state, state.publish.listen_fd, EPOLLIN,
+					WEV_LOOP_PUBLISH) < 0) {
+			fprintf(stderr, "Failed to set up event loop: %s\n",
+					strerror(errno));
+			return 1;
+		}
+	}
+	if (state.opts.record &&
+			trace_create(&state.trace, state.opts.record, &interfaces) < 0) {
+		fprintf(stderr, "Failed to create trace %s: %s\n",
+				state.opts.record, strerror(errno));
+		return 1;
+	}
+	if (state.opts.flight) {
+		if (state.opts.record) {
+			fprintf(stderr, "-w cannot be used with --flight\n");
+			return 1;
+		}
+		if (ring_init(&state.flight, WEV_FLIGHT_SIZE) < 0) {
+			fprintf(stderr, "Failed to allocate flight recorder\n");
+			return 1;
+		}
+	}
+	if (state.opts.record || state.opts.stats_interval || state.opts.flight ||
+			state.opts.pointer_rate_interval) {
+		// Each of these does little enough per event to do it in line
+		state.opts.threaded = false;
+	}
+	if (state.opts.stats_interval) {
+		// Events are still formatted, to tell how much output was saved
+		state.out.fd = -1;
+		state.stats_report_time = monotonic_ns();
+	}
+	state.rate_report_time = monotonic_ns();
+	if (state.opts.threaded && formatter_start(&state) < 0) {
+		fprintf(stderr, "Failed to start formatter thread: %s\n",
+				strerror(errno));
+		return 1;
+	}
+
 	state.display = wl_display_connect(NULL);
 	if (!state.display) {
 		fprintf(stderr, "Failed to connect to Wayland display\n");
@@ -904,6 +5961,12 @@ int main(int argc, char *argv[]) {
 		fprintf(stderr, "Failed to obtain Wayland registry\n");
 		return 1;
 	}
+	if (loop_add_display(&state) < 0) {
+		fprintf(stderr, "Failed to set up event loop: %s\n", strerror(errno));
+		return 1;
+	}
+	wl_list_init(&state.seats);
+	wl_list_init(&state.bound);
 	wl_registry_add_listener(state.registry, &wl_registry_listener, &state);
 	wl_display_roundtrip(state.display);
 
@@ -912,20 +5975,44 @@ int main(int argc, char *argv[]) {
 		void *ptr;
 	} required[] = {
 		{ "wl_compositor", state.compositor, },
-		{ "wl_seat", state.seat, },
 		{ "wl_shm", state.shm, },
 		{ "xdg_wm_base", state.wm_base, },
 		{ "wl_data_device_manager", state.data_device_manager, },
 	};
 	for (size_t i = 0; i < sizeof(required) / sizeof(required[0]); ++i) {
-		if (required->ptr == NULL) {
+		if (required[i].ptr == NULL) {
 			fprintf(stderr, "%s is required but is not present.\n",
 					required[i].name);
 			return 1;
 		}
 	}
 
+	if (wl_list_empty(&state.seats)) {
+		fprintf(stderr, "wl_seat is required but is not present.\n");
+		return 1;
+	}
+
+	struct wev_bind *bind;
+	wl_list_for_each(bind, &state.opts.binds, link) {
+		if (!bind->present) {
+			fprintf(stderr, "%s is not present, not tracing it.\n",
+					bind->generic->interface->name);
+		}
+	}
+
+	if (state.opts.present && !state.presentation) {
+		fprintf(stderr, "wp_presentation is required for --present "
+				"but is not present.\n");
+		return 1;
+	}
+
 	xdg_wm_base_add_listener(state.wm_base, &xdg_wm_base_listener, NULL);
+	if (state.presentation) {
+		state.presentation_clock = CLOCK_MONOTONIC;
+		wp_presentation_add_listener(state.presentation,
+				&presentation_listener, &state);
+	}
+	shm_pool_init(&state.shm_pool, state.shm);
 
 	state.surface = wl_compositor_create_surface(state.compositor);
 	state.xdg_surface = xdg_wm_base_get_xdg_surface(
@@ -938,19 +6025,58 @@ int main(int argc, char *argv[]) {
 	xdg_toplevel_add_listener(state.xdg_toplevel,
 			&xdg_toplevel_listener, &state);
 
-	wl_seat_add_listener(state.seat, &wl_seat_listener, &state);
-
-	struct wl_data_device *data_device =
-		wl_data_device_manager_get_data_device(state.data_device_manager,
-				state.seat);
-	wl_data_device_add_listener(data_device, &wl_data_device_listener, &state);
+	struct wev_seat *seat;
+	wl_list_for_each(seat, &state.seats, link) {
+		seat_get_data_device(seat);
+		seat_get_tablet_seat(seat);
+	}
 
 	wl_surface_commit(state.surface);
 	wl_display_roundtrip(state.display);
+	flush_events(&state);
 
-	while (wl_display_dispatch(state.display) && !state.closed) {
-		/* This space deliberately left blank */
+	// Everything printed for one batch of events goes out in a single write
+	while (!state.closed) {
+		if (state.configure_pending || (state.redraw_pending &&
+					!state.frame_callback && state.width != 0)) {
+			draw(&state);
+		}
+		if (dispatch_events(&state) < 0) {
+			break;
+		}
+		flush_events(&state);
+	}
+	if (state.opts.threaded) {
+		formatter_stop(&state);
+	} else {
+		output_flush(&state.out);
+	}
+	if (state.opts.latency) {
+		latency_report(&state);
+	}
+	if (state.opts.touch_contacts) {
+		touch_contacts_report(&state);
+	}
+	if (state.opts.stats_interval) {
+		stats_report(&state, monotonic_ns());
+	}
+	if (state.opts.pointer_rate_interval) {
+		pointer_rate_summary(&state, monotonic_ns());
 	}
 
+	if (state.opts.record) {
+		trace_close(&state.trace);
+	}
+	if (state.opts.publish) {
+		if (state.publish.truncated) {
+			fprintf(stderr, "%" PRIu64 " events were too large to publish "
+					"whole\n", state.publish.truncated);
+		}
+		publish_close(&state.publish);
+	}
+	if (state.opts.flight) {
+		ring_finish(&state.flight);
+	}
+	loop_finish(&state);
 	return 0;
 }